@@ -35,6 +35,11 @@
    private static *** getSingleInterface(...);
    private static *** weightObject(...);
    private static *** findMembers(...);
+   private static *** findAllMembers(...);
    private static *** findMockName(...);
 }
+-keep class com.oslorde.luadroid.ScriptContext$ScriptFuture{
+   private *** begin();
+   private *** done(...);
+}
 -dontnote
\ No newline at end of file
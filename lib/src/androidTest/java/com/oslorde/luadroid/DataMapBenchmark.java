@@ -0,0 +1,68 @@
+package com.oslorde.luadroid;
+
+import android.support.test.runner.AndroidJUnit4;
+import android.util.Log;
+import org.junit.Test;
+import org.junit.runner.RunWith;
+
+import java.util.LinkedHashMap;
+import java.util.Map;
+
+import static org.junit.Assert.assertEquals;
+
+/**
+ * Compares get,put and iteration of DataMap with LinkedHashMap.
+ */
+@RunWith(AndroidJUnit4.class)
+public class DataMapBenchmark {
+    private static final int[] SIZES = {10, 1000, 100000};
+    private static final int OPERATIONS = 1000000;
+
+    @Test
+    public void benchmark() {
+        for (int size : SIZES) {
+            String[] keys = new String[size];
+            for (int i = 0; i < size; ++i) {
+                keys[i] = "key" + i;
+            }
+            //twice so that the second round runs jitted
+            for (int round = 0; round < 2; ++round) {
+                run("DataMap", new DataMap<>(size), keys, round == 1);
+                run("LinkedHashMap", new LinkedHashMap<>(size), keys, round == 1);
+            }
+        }
+    }
+
+    private static void run(String name, Map<String, Integer> map, String[] keys, boolean report) {
+        int size = keys.length;
+        int repeat = Math.max(1, OPERATIONS / size);
+        long t = System.nanoTime();
+        for (int i = 0; i < size; ++i) {
+            map.put(keys[i], i);
+        }
+        long put = System.nanoTime() - t;
+        t = System.nanoTime();
+        long sum = 0;
+        for (int r = 0; r < repeat; ++r) {
+            for (String key : keys) {
+                sum += map.get(key);
+            }
+        }
+        long get = System.nanoTime() - t;
+        t = System.nanoTime();
+        int index = 0;
+        for (int r = 0; r < repeat; ++r) {
+            index = 0;
+            for (Map.Entry<String, Integer> entry : map.entrySet()) {
+                assertEquals(index++, (int) entry.getValue());
+            }
+        }
+        long iterate = System.nanoTime() - t;
+        assertEquals(size, index);
+        assertEquals((long) size * (size - 1) / 2 * repeat, sum);
+        if (report) {
+            Log.d("datamap", name + " size=" + size + " put " + put / size + "ns,get "
+                    + get / repeat / size + "ns,iterate " + iterate / repeat / size + "ns");
+        }
+    }
+}
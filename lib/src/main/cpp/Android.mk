@@ -14,6 +14,8 @@ LOCAL_CFLAGS  += -Os -fno-math-errno -fvisibility=hidden
 LOCAL_CPPFLAGS += -Os
 LOCAL_LDFLAGS += -Wl,--gc-sections
 endif
+#use the below statement to report the peak local refs of the bridge calls in java.stats()
+#LOCAL_CFLAGS += -DLOCAL_FRAME_STATS
 LOCAL_LDLIBS := -ldl -llog
 LOCAL_MODULE :=luadroid
 $(info local c includes=$(LOCAL_C_INCLUDES))
@@ -0,0 +1,129 @@
+
+
+#ifndef LUADROID_ARENA_H
+#define LUADROID_ARENA_H
+
+#include <cstdlib>
+#include <cstdint>
+#include <new>
+#include "macros.h"
+
+#define ARENA_BLOCK_SIZE 4096
+#define ARENA_ALIGN 8
+
+/**
+ * Bump allocator for temporaries of a bridge call.
+ * Memory is only handed out inside a Scope and is taken back when the scope closes,
+ * so objects allocated here must be destroyed(not freed) before that.
+ * Scopes skipped by a longjmp are closed by the next scope opened at the same or an outer frame.
+ */
+class Arena {
+    struct Block {
+        Block *next;
+        size_t size;
+        char data[0];
+    };
+public:
+    class Scope {
+        Arena &arena;
+        Scope *const prev;
+        Block *const block;
+        const size_t offset;
+    public:
+        explicit Scope(Arena &arena) : arena(arena), prev(arena.dropStaleScopes(this)),
+                                       block(arena.current), offset(arena.offset) {
+            arena.top = this;
+        }
+
+        Scope(const Scope &) = delete;
+
+        ~Scope() {
+            arena.current = block;
+            arena.offset = offset;
+            arena.top = prev;
+        }
+
+        friend class Arena;
+    };
+
+private:
+    Block *head = nullptr;
+    Block *current = nullptr;
+    size_t offset = 0;
+    Scope *top = nullptr;
+
+    //Scopes are on the stack,so a live scope always sits in an outer frame of a new one
+    Scope *dropStaleScopes(Scope *scope) {
+        while (top != nullptr && (uintptr_t) top <= (uintptr_t) scope) {
+            current = top->block;
+            offset = top->offset;
+            top = top->prev;
+        }
+        return top;
+    }
+
+    Block *nextBlock(size_t size) {
+        Block *block = current ? current->next : head;
+        while (block != nullptr && block->size < size)
+            block = block->next;
+        if (block == nullptr) {
+            if (size < ARENA_BLOCK_SIZE) size = ARENA_BLOCK_SIZE;
+            block = (Block *) malloc(sizeof(Block) + size);
+            block->size = size;
+            ++mallocCount;
+            //new blocks are kept at the tail so that they can be reused by later scopes
+            Block **tail = &head;
+            while (*tail != nullptr) tail = &(*tail)->next;
+            block->next = nullptr;
+            *tail = block;
+        }
+        return block;
+    }
+
+public:
+    uintptr_t allocCount = 0;
+    uintptr_t mallocCount = 0;
+    uintptr_t fallbackCount = 0;//requests the callers took to the heap instead
+    bool enabled = true;
+
+    Arena() {}
+
+    Arena(const Arena &) = delete;
+
+    bool inScope() const {
+        return top != nullptr;
+    }
+
+    //nullptr outside a scope,the caller must then allocate on the heap
+    void *alloc(size_t size) {
+        if (unlikely(top == nullptr || !enabled)) {
+            ++fallbackCount;
+            return nullptr;
+        }
+        size = (size + ARENA_ALIGN - 1) & ~size_t(ARENA_ALIGN - 1);
+        ++allocCount;
+        if (current == nullptr || offset + size > current->size) {
+            current = nextBlock(size);
+            offset = 0;
+        }
+        void *ret = current->data + offset;
+        offset += size;
+        return ret;
+    }
+
+    template<typename T, typename ...Args>
+    T *make(Args &&... args) {
+        void *p = alloc(sizeof(T));
+        return p ? new(p) T(std::forward<Args>(args)...) : nullptr;
+    }
+
+    ~Arena() {
+        for (Block *block = head; block != nullptr;) {
+            Block *next = block->next;
+            free(block);
+            block = next;
+        }
+    }
+};
+
+#endif //LUADROID_ARENA_H
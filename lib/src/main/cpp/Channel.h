@@ -0,0 +1,202 @@
+
+
+#ifndef LUADROID_CHANNEL_H
+#define LUADROID_CHANNEL_H
+
+#include <climits>
+#include <ctime>
+#include "lua_object.h"
+#include "myarray.h"
+#include "atomic.h"
+
+/**
+ * Bounded multi-producer multi-consumer ring of cross thread values.
+ * Slots are claimed without locking,blocked senders and receivers sleep on futexes.
+ * Deadlines are absolute monotonic nanos,0 never waits and a negative one waits forever.
+ */
+class Channel {
+public:
+    enum Status {
+        OK,
+        TIMEOUT,
+        CLOSED
+    };
+private:
+    struct Cell {
+        volatile at_int sequence;
+        CrossThreadLuaObject value;
+    };
+    volatile at_int refCount = 1;
+    volatile at_int closed = 0;
+    volatile at_int head = 0;
+    volatile at_int tail = 0;
+    volatile at_int notEmpty = 0;
+    volatile at_int notFull = 0;
+    volatile at_int waiters = 0;
+    Array<Cell> cells;
+    const uint32_t mask;
+
+    static uint32_t capacityFor(uint32_t capacity) {
+        uint32_t ret = 1;
+        while (ret < capacity) ret <<= 1;
+        return ret;
+    }
+
+    static volatile at_int &selectSignal() {
+        static volatile at_int signal = 0;
+        return signal;
+    }
+
+    static volatile at_int &selectWaiters() {
+        static volatile at_int count = 0;
+        return count;
+    }
+
+    static void notify(volatile at_int *signal, volatile at_int *waiters) {
+        at_int_add(signal, 1);
+        if (at_int_add(waiters, 0) > 0)
+            at_futex_wake(signal, INT_MAX);
+    }
+
+    static bool wait(volatile at_int *signal, volatile at_int *waiters, int seen, int64_t deadline) {
+        int64_t timeout = -1;
+        if (deadline == 0) return false;
+        if (deadline > 0) {
+            timeout = deadline - nowNanos();
+            if (timeout <= 0) return false;
+        }
+        at_int_add(waiters, 1);
+        at_futex_wait_timeout(signal, seen, timeout);
+        at_int_add(waiters, -1);
+        return true;
+    }
+
+    void pushed() {
+        notify(&notEmpty, &waiters);
+        notify(&selectSignal(), &selectWaiters());
+    }
+
+    bool tryPush(CrossThreadLuaObject &value) {
+        auto pos = (uint32_t) at_int_load(&tail);
+        for (;;) {
+            Cell &cell = cells[pos & mask];
+            auto diff = int32_t((uint32_t) at_int_load_acquire(&cell.sequence) - pos);
+            if (diff == 0) {
+                int old = at_int_cas(&tail, int(pos), int(pos + 1));
+                if (old == int(pos)) {
+                    cell.value = std::move(value);
+                    at_int_store(&cell.sequence, int(pos + 1));
+                    return true;
+                }
+                pos = (uint32_t) old;
+            } else if (diff < 0) {
+                return false;
+            } else pos = (uint32_t) at_int_load(&tail);
+        }
+    }
+
+    bool tryPop(CrossThreadLuaObject &out) {
+        auto pos = (uint32_t) at_int_load(&head);
+        for (;;) {
+            Cell &cell = cells[pos & mask];
+            auto diff = int32_t((uint32_t) at_int_load_acquire(&cell.sequence) - (pos + 1));
+            if (diff == 0) {
+                int old = at_int_cas(&head, int(pos), int(pos + 1));
+                if (old == int(pos)) {
+                    out = std::move(cell.value);
+                    at_int_store(&cell.sequence, int(pos + mask + 1));
+                    return true;
+                }
+                pos = (uint32_t) old;
+            } else if (diff < 0) {
+                return false;
+            } else pos = (uint32_t) at_int_load(&head);
+        }
+    }
+
+public:
+    explicit Channel(uint32_t capacity) : cells(capacityFor(capacity)), mask(capacityFor(capacity) - 1) {
+        for (uint32_t i = 0; i <= mask; ++i) {
+            at_int_store(&cells[i].sequence, int(i));
+        }
+    }
+
+    Channel(const Channel &) = delete;
+
+    static int64_t nowNanos() {
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return int64_t(now.tv_sec) * 1000000000 + now.tv_nsec;
+    }
+
+    static int64_t deadlineAfter(int64_t timeoutNanos) {
+        if (timeoutNanos <= 0) return timeoutNanos;
+        return nowNanos() + timeoutNanos;
+    }
+
+    Status send(CrossThreadLuaObject &value, int64_t deadline) {
+        for (;;) {
+            int seen = at_int_load_acquire(&notFull);
+            if (at_int_load(&closed)) return CLOSED;
+            if (tryPush(value)) {
+                pushed();
+                return OK;
+            }
+            if (!wait(&notFull, &waiters, seen, deadline)) return TIMEOUT;
+        }
+    }
+
+    bool tryRecv(CrossThreadLuaObject &out) {
+        if (!tryPop(out)) return false;
+        notify(&notFull, &waiters);
+        return true;
+    }
+
+    Status recv(CrossThreadLuaObject &out, int64_t deadline) {
+        for (;;) {
+            int seen = at_int_load_acquire(&notEmpty);
+            if (tryRecv(out)) return OK;
+            if (at_int_load(&closed)) return tryRecv(out) ? OK : CLOSED;
+            if (!wait(&notEmpty, &waiters, seen, deadline)) return TIMEOUT;
+        }
+    }
+
+    //values already sent can still be received after closing
+    void close() {
+        if (at_int_exchange(&closed, 1)) return;
+        notify(&notFull, &waiters);
+        pushed();
+    }
+
+    bool isClosed() {
+        return at_int_load(&closed) != 0;
+    }
+
+    uint32_t size() {
+        return (uint32_t) at_int_load(&tail) - (uint32_t) at_int_load(&head);
+    }
+
+    uint32_t capacity() const {
+        return mask + 1;
+    }
+
+    //bumped whenever any channel gets a value or is closed,take it before polling the channels to select
+    static int selectVersion() {
+        return at_int_load_acquire(&selectSignal());
+    }
+
+    static bool waitSelect(int seen, int64_t deadline) {
+        return wait(&selectSignal(), &selectWaiters(), seen, deadline);
+    }
+
+    void addRef() {
+        at_int_add(&refCount, 1);
+    }
+
+    void release() {
+        if (at_int_add(&refCount, -1) == 0)
+            delete this;
+    }
+};
+
+#endif //LUADROID_CHANNEL_H
@@ -0,0 +1,188 @@
+
+
+#ifndef LUADROID_CODECACHE_H
+#define LUADROID_CODECACHE_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "lua.hpp"
+#include "common.h"
+#include "farmhash.h"
+
+#define CODE_CACHE_SUFFIX ".luac"
+
+/**
+ * Directory of bytecode dumps named by the fingerprint of their source and chunk name.
+ * Each name also carries a tag of the vm build and of the strip setting,dumps with
+ * another tag are removed when the cache is opened and a dump the vm refuses is
+ * removed when loaded. Stripped dumps lose the line info of error messages.
+ */
+class CodeCache {
+    struct MappedFile {
+        void *data = MAP_FAILED;
+        size_t size = 0;
+
+        explicit MappedFile(const char *path) {
+            int fd = open(path, O_RDONLY | O_CLOEXEC);
+            if (fd < 0) return;
+            struct stat st;
+            if (fstat(fd, &st) == 0 && st.st_size > 0) {
+                size = size_t(st.st_size);
+                data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            }
+            close(fd);
+        }
+
+        bool valid() const {
+            return data != MAP_FAILED;
+        }
+
+        ~MappedFile() {
+            if (valid()) munmap(data, size);
+        }
+    };
+
+    const String dir;
+    const bool strip;
+    const uint32_t buildTag;
+
+    //the switches the lua module exports with its build,see its Android.mk
+    static const char *vmConfig() {
+        return ""
+#ifdef LUA_COMPAT_5_1
+                " compat5.1"
+#endif
+#ifdef LUA_COMPAT_5_2
+                " compat5.2"
+#endif
+#ifdef LUA_COMPAT_FLOATSTRING
+                " floatstring"
+#endif
+#ifdef LUA_USE_SUPERINSTRUCTIONS
+                " superinstructions"
+#endif
+#ifdef LUA_FARMHASH
+                " farmhash"
+#endif
+                ;
+    }
+
+    static uint32_t computeBuildTag(bool strip) {
+        //the last one tells the byte order
+        uint32_t layout[] = {sizeof(lua_Integer), sizeof(lua_Number), sizeof(void *), sizeof(size_t),
+                             sizeof(int), strip, 1};
+        String signature(LUA_RELEASE);
+        signature.append(vmConfig());
+        signature.append((const char *) layout, sizeof(layout));
+        return util::Fingerprint32(signature.data(), signature.length());
+    }
+
+    static int writeDump(lua_State *, const void *p, size_t size, void *file) {
+        return fwrite(p, 1, size, (FILE *) file) == size ? 0 : 1;
+    }
+
+    //a dump keeps the chunk name it was compiled with,so the same source under another name is another dump
+    static uint64_t keyOf(const char *source, size_t length, const char *chunkName) {
+        if (chunkName == nullptr) chunkName = "?";//as lua_load names it
+        return util::Fingerprint(util::Uint128(util::Fingerprint64(source, length),
+                                               util::Fingerprint64(chunkName, strlen(chunkName))));
+    }
+
+    String pathOf(uint64_t key) const {
+        char name[48];
+        snprintf(name, sizeof(name), "/%016llx.%08x" CODE_CACHE_SUFFIX, (unsigned long long) key, buildTag);
+        return dir + name;
+    }
+
+    //written to a temporary file first so that readers never see a partial dump
+    void store(lua_State *L, const String &path) {
+        String temp = dir + "/dump-XXXXXX";
+        int fd = mkstemp(&temp[0]);
+        if (fd < 0) return;
+        FILE *file = fdopen(fd, "wb");
+        if (file == nullptr) {
+            close(fd);
+            unlink(temp.data());
+            return;
+        }
+        bool ok = lua_dump(L, writeDump, file, strip) == 0;
+        ok = fclose(file) == 0 && ok;
+        if (!ok || rename(temp.data(), path.data()) != 0)
+            unlink(temp.data());
+    }
+
+    void prune() {
+        DIR *d = opendir(dir.data());
+        if (d == nullptr) return;
+        char tag[16];
+        snprintf(tag, sizeof(tag), ".%08x" CODE_CACHE_SUFFIX, buildTag);
+        size_t tagLen = strlen(tag);
+        size_t suffixLen = sizeof(CODE_CACHE_SUFFIX) - 1;
+        while (dirent *entry = readdir(d)) {
+            size_t len = strlen(entry->d_name);
+            bool isDump = len > suffixLen && strcmp(entry->d_name + len - suffixLen, CODE_CACHE_SUFFIX) == 0;
+            bool isStale = isDump && (len < tagLen || strcmp(entry->d_name + len - tagLen, tag) != 0);
+            if (isStale || strncmp(entry->d_name, "dump-", 5) == 0) {
+                unlinkat(dirfd(d), entry->d_name, 0);
+            }
+        }
+        closedir(d);
+    }
+
+public:
+    CodeCache(const char *dir, bool strip) : dir(dir), strip(strip), buildTag(computeBuildTag(strip)) {
+        mkdir(dir, 0700);
+        prune();
+    }
+
+    CodeCache(const CodeCache &) = delete;
+
+    //same results as luaL_loadbuffer on the source
+    int load(lua_State *L, const char *source, size_t length, const char *chunkName) {
+        if (length > 0 && source[0] == LUA_SIGNATURE[0])
+            return luaL_loadbufferx(L, source, length, chunkName, "b");
+        String path = pathOf(keyOf(source, length, chunkName));
+        {
+            MappedFile dump(path.data());
+            if (dump.valid()) {
+                if (luaL_loadbufferx(L, (const char *) dump.data, dump.size, chunkName, "b") == LUA_OK)
+                    return LUA_OK;
+                lua_pop(L, 1);
+                unlink(path.data());
+            }
+        }
+        int ret = luaL_loadbufferx(L, source, length, chunkName, "t");
+        if (ret == LUA_OK) store(L, path);
+        return ret;
+    }
+
+    //same results as luaL_loadfile
+    int loadFile(lua_State *L, const char *fileName) {
+        MappedFile file(fileName);
+        if (!file.valid()) return luaL_loadfile(L, fileName);
+        const char *source = (const char *) file.data;
+        size_t length = file.size;
+        //skipped like luaL_loadfile does:a utf-8 bom,then a first line starting with #
+        if (length >= 3 && memcmp(source, "\xEF\xBB\xBF", 3) == 0) {
+            source += 3;
+            length -= 3;
+        }
+        if (length > 0 && source[0] == '#') {//keep the newline so that line numbers still match
+            while (length > 0 && *source != '\n') {
+                ++source;
+                --length;
+            }
+        }
+        String chunkName("@");
+        chunkName += fileName;
+        return load(L, source, length, chunkName.data());
+    }
+};
+
+#endif //LUADROID_CODECACHE_H
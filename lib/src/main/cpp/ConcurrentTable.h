@@ -0,0 +1,107 @@
+
+
+#ifndef LUADROID_CONCURRENTTABLE_H
+#define LUADROID_CONCURRENTTABLE_H
+
+#include <cstdlib>
+#include <cstdint>
+#include "atomic.h"
+#include "Vector.h"
+
+/**
+ * Open addressed table for read-mostly pointers keyed by a precomputed hash.
+ * Lookups never lock; insertions must be serialized by the caller.
+ * Replaced tables are retired rather than freed since readers may still walk them.
+ */
+template<typename T>
+class ConcurrentTable {
+    struct Slot {
+        uint32_t hash;
+        volatile at_ptr value;
+    };
+    struct Table {
+        uint32_t mask;
+        Slot slots[0];
+    };
+    volatile at_ptr current;
+    uint32_t count = 0;
+    Vector<Table *> retired;
+
+    static Table *newTable(uint32_t capacity) {
+        auto *table = (Table *) calloc(1, sizeof(Table) + capacity * sizeof(Slot));
+        table->mask = capacity - 1;
+        return table;
+    }
+
+    static inline uint32_t mix(uint32_t hash) {
+        return hash * 0x9E3779B1u;
+    }
+
+    static void put(Table *table, uint32_t hash, T *value) {
+        for (uint32_t i = mix(hash) & table->mask;; i = (i + 1) & table->mask) {
+            Slot &slot = table->slots[i];
+            if (at_ptr_load(&slot.value) == nullptr) {
+                slot.hash = hash;
+                at_ptr_store(&slot.value, value);
+                return;
+            }
+        }
+    }
+
+public:
+    ConcurrentTable(uint32_t capacity = 64) : current(newTable(capacity)) {}
+
+    ConcurrentTable(const ConcurrentTable &) = delete;
+
+    template<typename Matcher>
+    T *find(uint32_t hash, const Matcher &matcher) {
+        auto *table = (Table *) at_ptr_load(&current);
+        for (uint32_t i = mix(hash) & table->mask;; i = (i + 1) & table->mask) {
+            Slot &slot = table->slots[i];
+            T *value = (T *) at_ptr_load(&slot.value);
+            if (value == nullptr) return nullptr;
+            if (slot.hash == hash && matcher(value)) return value;
+        }
+    }
+
+    void insert(uint32_t hash, T *value) {
+        auto *table = (Table *) at_ptr_load(&current);
+        if ((count + 1) * 4 > (table->mask + 1) * 3) {
+            Table *newOne = newTable((table->mask + 1) << 1);
+            for (uint32_t i = 0; i <= table->mask; ++i) {
+                Slot &slot = table->slots[i];
+                T *old = (T *) at_ptr_load(&slot.value);
+                if (old != nullptr)
+                    put(newOne, slot.hash, old);
+            }
+            at_ptr_store(&current, newOne);
+            retired.push_back(table);
+            table = newOne;
+        }
+        put(table, hash, value);
+        ++count;
+    }
+
+    uint32_t size() const {
+        return count;
+    }
+
+    template<typename Func>
+    void forEach(const Func &func) {
+        auto *table = (Table *) at_ptr_load(&current);
+        for (uint32_t i = 0; i <= table->mask; ++i) {
+            T *value = (T *) at_ptr_load(&table->slots[i].value);
+            if (value != nullptr)
+                func(value);
+        }
+    }
+
+    ~ConcurrentTable() {
+        free(at_ptr_load(&current));
+        for (auto table:retired) {
+            free(table);
+        }
+    }
+};
+
+#endif //LUADROID_CONCURRENTTABLE_H
@@ -0,0 +1,189 @@
+
+
+#ifndef LUADROID_LOCALREFSTATS_H
+#define LUADROID_LOCALREFSTATS_H
+
+#include <cstdarg>
+#include <jni.h>
+#include "atomic.h"
+#include "macros.h"
+
+#define MAX_COUNTED_FRAMES 64
+
+/**
+ * Debug only count of the local refs held by each thread,kept by a copy of the jni
+ * function table whose ref making functions count what they return.
+ * Each bridge call site records the most refs its frame held at once.
+ */
+class LocalFrameSite {
+    static volatile at_ptr &sites() {
+        static volatile at_ptr head = nullptr;
+        return head;
+    }
+
+    static bool raiseTo(volatile at_int *value, int v) {
+        int old = at_int_load(value);
+        while (old < v) {
+            int seen = at_int_cas(value, old, v);
+            if (seen == old) return true;
+            old = seen;
+        }
+        return false;
+    }
+
+public:
+    const char *const name;
+    LocalFrameSite *next = nullptr;
+    volatile at_int calls = 0;
+    volatile at_int capacity = 0;
+    volatile at_int peak = 0;
+
+    explicit LocalFrameSite(const char *name) : name(name) {
+        do next = (LocalFrameSite *) at_ptr_load(&sites());
+        while (!at_ptr_cas(&sites(), next, this));
+    }
+
+    LocalFrameSite(const LocalFrameSite &) = delete;
+
+    static LocalFrameSite *first() {
+        return (LocalFrameSite *) at_ptr_load(&sites());
+    }
+
+    void record(int reserved, int used) {
+        at_int_add(&calls, 1);
+        raiseTo(&capacity, reserved);
+        if (raiseTo(&peak, used) && used > reserved)
+            LOGW("%s held %d local refs with %d reserved", name, used, reserved);
+    }
+};
+
+namespace LocalRefStats {
+    struct Counts {
+        int live;
+        int peak;
+        int depth;
+        int saved[MAX_COUNTED_FRAMES];
+    };
+    static __thread Counts counts;
+    static __thread const JNINativeInterface *original;
+    static __thread JNINativeInterface table;
+
+    static inline jobject counted(jobject ref) {
+        if (ref != nullptr && ++counts.live > counts.peak) counts.peak = counts.live;
+        return ref;
+    }
+
+#define COUNT_REF(name, type, params, args) \
+    static type JNICALL name##Counted params { return (type) counted(original->name args); }
+#define STRIP(...) __VA_ARGS__
+#define COUNT_CALL_REF(name, params, args) \
+    COUNT_REF(name##A, jobject, (JNIEnv *env, STRIP params, const jvalue *values), (env, STRIP args, values))\
+    COUNT_REF(name##V, jobject, (JNIEnv *env, STRIP params, va_list values), (env, STRIP args, values))\
+    static jobject JNICALL name##Counted(JNIEnv *env, STRIP params, ...) {\
+        va_list values;\
+        va_start(values, methodID);\
+        jobject ret = counted(original->name##V(env, STRIP args, values));\
+        va_end(values);\
+        return ret;\
+    }
+#define COUNT_ARRAY(type) COUNT_REF(New##type##Array, j##type##Array, (JNIEnv *env, jsize len), (env, len))
+
+    COUNT_REF(FindClass, jclass, (JNIEnv *env, const char *name), (env, name))
+    COUNT_REF(GetSuperclass, jclass, (JNIEnv *env, jclass clazz), (env, clazz))
+    COUNT_REF(GetObjectClass, jclass, (JNIEnv *env, jobject obj), (env, obj))
+    COUNT_REF(ToReflectedMethod, jobject, (JNIEnv *env, jclass clazz, jmethodID id, jboolean isStatic),
+              (env, clazz, id, isStatic))
+    COUNT_REF(ToReflectedField, jobject, (JNIEnv *env, jclass clazz, jfieldID id, jboolean isStatic),
+              (env, clazz, id, isStatic))
+    COUNT_REF(ExceptionOccurred, jthrowable, (JNIEnv *env), (env))
+    COUNT_REF(NewLocalRef, jobject, (JNIEnv *env, jobject obj), (env, obj))
+    COUNT_REF(AllocObject, jobject, (JNIEnv *env, jclass clazz), (env, clazz))
+    COUNT_REF(GetObjectField, jobject, (JNIEnv *env, jobject obj, jfieldID id), (env, obj, id))
+    COUNT_REF(GetStaticObjectField, jobject, (JNIEnv *env, jclass clazz, jfieldID id), (env, clazz, id))
+    COUNT_REF(NewString, jstring, (JNIEnv *env, const jchar *chars, jsize len), (env, chars, len))
+    COUNT_REF(NewStringUTF, jstring, (JNIEnv *env, const char *chars), (env, chars))
+    COUNT_REF(NewObjectArray, jobjectArray, (JNIEnv *env, jsize len, jclass clazz, jobject init),
+              (env, len, clazz, init))
+    COUNT_REF(GetObjectArrayElement, jobject, (JNIEnv *env, jobjectArray array, jsize index), (env, array, index))
+    COUNT_REF(NewDirectByteBuffer, jobject, (JNIEnv *env, void *address, jlong capacity), (env, address, capacity))
+    COUNT_ARRAY(Boolean)
+    COUNT_ARRAY(Byte)
+    COUNT_ARRAY(Char)
+    COUNT_ARRAY(Short)
+    COUNT_ARRAY(Int)
+    COUNT_ARRAY(Long)
+    COUNT_ARRAY(Float)
+    COUNT_ARRAY(Double)
+    COUNT_CALL_REF(NewObject, (jclass clazz, jmethodID methodID), (clazz, methodID))
+    COUNT_CALL_REF(CallObjectMethod, (jobject obj, jmethodID methodID), (obj, methodID))
+    COUNT_CALL_REF(CallStaticObjectMethod, (jclass clazz, jmethodID methodID), (clazz, methodID))
+    COUNT_CALL_REF(CallNonvirtualObjectMethod, (jobject obj, jclass clazz, jmethodID methodID),
+                   (obj, clazz, methodID))
+
+    static void JNICALL DeleteLocalRefCounted(JNIEnv *env, jobject ref) {
+        if (ref != nullptr) --counts.live;
+        original->DeleteLocalRef(env, ref);
+    }
+
+    static jint JNICALL PushLocalFrameCounted(JNIEnv *env, jint capacity) {
+        jint ret = original->PushLocalFrame(env, capacity);
+        if (ret == JNI_OK) {
+            if (counts.depth < MAX_COUNTED_FRAMES) counts.saved[counts.depth] = counts.live;
+            ++counts.depth;
+        }
+        return ret;
+    }
+
+    static jobject JNICALL PopLocalFrameCounted(JNIEnv *env, jobject result) {
+        if (counts.depth > 0 && --counts.depth < MAX_COUNTED_FRAMES) counts.live = counts.saved[counts.depth];
+        return counted(original->PopLocalFrame(env, result));
+    }
+
+    static void install(JNIEnv *env) {
+        if (env->functions == &table) return;
+        original = env->functions;
+        table = *original;
+#define SET_COUNTED(name) table.name = name##Counted;
+#define SET_COUNTED_CALL(name) SET_COUNTED(name) SET_COUNTED(name##V) SET_COUNTED(name##A)
+        SET_COUNTED(FindClass)
+        SET_COUNTED(GetSuperclass)
+        SET_COUNTED(GetObjectClass)
+        SET_COUNTED(ToReflectedMethod)
+        SET_COUNTED(ToReflectedField)
+        SET_COUNTED(ExceptionOccurred)
+        SET_COUNTED(NewLocalRef)
+        SET_COUNTED(DeleteLocalRef)
+        SET_COUNTED(PushLocalFrame)
+        SET_COUNTED(PopLocalFrame)
+        SET_COUNTED(AllocObject)
+        SET_COUNTED(GetObjectField)
+        SET_COUNTED(GetStaticObjectField)
+        SET_COUNTED(NewString)
+        SET_COUNTED(NewStringUTF)
+        SET_COUNTED(NewObjectArray)
+        SET_COUNTED(GetObjectArrayElement)
+        SET_COUNTED(NewDirectByteBuffer)
+        SET_COUNTED(NewBooleanArray)
+        SET_COUNTED(NewByteArray)
+        SET_COUNTED(NewCharArray)
+        SET_COUNTED(NewShortArray)
+        SET_COUNTED(NewIntArray)
+        SET_COUNTED(NewLongArray)
+        SET_COUNTED(NewFloatArray)
+        SET_COUNTED(NewDoubleArray)
+        SET_COUNTED_CALL(NewObject)
+        SET_COUNTED_CALL(CallObjectMethod)
+        SET_COUNTED_CALL(CallStaticObjectMethod)
+        SET_COUNTED_CALL(CallNonvirtualObjectMethod)
+#undef SET_COUNTED_CALL
+#undef SET_COUNTED
+        env->functions = &table;
+    }
+
+#undef COUNT_ARRAY
+#undef COUNT_CALL_REF
+#undef COUNT_REF
+#undef STRIP
+}
+
+#endif //LUADROID_LOCALREFSTATS_H
@@ -0,0 +1,320 @@
+
+
+#ifndef LUADROID_LUAHEAP_H
+#define LUADROID_LUAHEAP_H
+
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include "atomic.h"
+#include "macros.h"
+#include "lua.hpp"
+
+#define HEAP_GRAIN 16
+#define HEAP_CLASSES 16 //blocks up to HEAP_GRAIN*HEAP_CLASSES bytes come from slabs
+#define HEAP_SLAB_SIZE 16384
+
+/**
+ * Memory taken from the system by the lua states of a context.
+ * Allocations beyond the limit fail,0 for no limit.
+ */
+struct HeapAccount {
+    volatile at_counter reserved = 0;
+    volatile at_counter limit = 0;
+};
+
+/**
+ * Size class allocator used as the lua_Alloc of a bridge state.
+ * A state only runs on the thread that created it,so the heap is that thread's cache and
+ * needs no lock. Small blocks are carved from slabs and go back to the free list of their
+ * class,larger ones are left to malloc. Slabs whose blocks are all free are given back by
+ * trim,which runs after the full collections of the bridge and before an allocation fails
+ * on the limit. A failed allocation makes lua run an emergency gc and then raise LUA_ERRMEM.
+ */
+class LuaHeap {
+    struct alignas(HEAP_GRAIN) Slab {
+        Slab *next;
+        size_t freeBytes;//only valid during trim
+    };
+    struct FreeBlock {
+        FreeBlock *next;
+    };
+
+    FreeBlock *freeLists[HEAP_CLASSES] = {};
+    Slab *slabs = nullptr;
+    char *cursor = nullptr;
+    char *end = nullptr;
+    HeapAccount *const account;
+    bool enforce = false;
+
+    static inline int sizeClass(size_t size) {
+        return int((size - 1) / HEAP_GRAIN);
+    }
+
+    bool tryReserve(size_t size) {
+        uintptr_t total = at_counter_add(&account->reserved, intptr_t(size));
+        uintptr_t limit = at_counter_get(&account->limit);
+        if (limit != 0 && total > limit) {
+            at_counter_add(&account->reserved, -intptr_t(size));
+            return false;
+        }
+        return true;
+    }
+
+    bool reserve(size_t size, bool force) {
+        if (!enforce || force) {
+            at_counter_add(&account->reserved, intptr_t(size));
+        } else if (unlikely(!tryReserve(size))) {
+            //empty slabs are given back before failing
+            if (trim() == 0 || !tryReserve(size))
+                return false;
+        }
+        reserved += size;
+        return true;
+    }
+
+    void unreserve(size_t size) {
+        at_counter_add(&account->reserved, -intptr_t(size));
+        reserved -= size;
+    }
+
+    bool newSlab(bool force) {
+        //the tail of the old slab goes to the class it fits
+        size_t left = size_t(end - cursor);
+        if (left >= HEAP_GRAIN) {
+            auto *block = (FreeBlock *) cursor;
+            int index = int(left / HEAP_GRAIN) - 1;
+            block->next = freeLists[index];
+            freeLists[index] = block;
+        }
+        cursor = end = nullptr;
+        if (!reserve(HEAP_SLAB_SIZE, force)) return false;
+        auto *slab = (Slab *) malloc(HEAP_SLAB_SIZE);
+        if (slab == nullptr) {
+            unreserve(HEAP_SLAB_SIZE);
+            return false;
+        }
+        slab->next = slabs;
+        slabs = slab;
+        cursor = (char *) (slab + 1);
+        end = (char *) slab + HEAP_SLAB_SIZE;
+        return true;
+    }
+
+    void *allocate(size_t size, bool force) {
+        void *ret;
+        if (size <= HEAP_GRAIN * HEAP_CLASSES) {
+            int index = sizeClass(size);
+            FreeBlock *block = freeLists[index];
+            if (block != nullptr) {
+                freeLists[index] = block->next;
+                ret = block;
+            } else {
+                size_t blockSize = size_t(index + 1) * HEAP_GRAIN;
+                if (size_t(end - cursor) < blockSize && !newSlab(force))
+                    return nullptr;
+                ret = cursor;
+                cursor += blockSize;
+            }
+        } else {
+            if (!reserve(size, force)) return nullptr;
+            ret = malloc(size);
+            if (ret == nullptr) {
+                unreserve(size);
+                return nullptr;
+            }
+        }
+        bytes += size;
+        ++allocs;
+        return ret;
+    }
+
+    void release(void *ptr, size_t size) {
+        if (size <= HEAP_GRAIN * HEAP_CLASSES) {
+            int index = sizeClass(size);
+            auto *block = (FreeBlock *) ptr;
+            block->next = freeLists[index];
+            freeLists[index] = block;
+        } else {
+            free(ptr);
+            unreserve(size);
+        }
+        bytes -= size;
+        ++frees;
+    }
+
+    void *reallocate(void *ptr, size_t osize, size_t nsize) {
+        bool small = osize <= HEAP_GRAIN * HEAP_CLASSES;
+        if (small && nsize <= HEAP_GRAIN * HEAP_CLASSES && sizeClass(osize) == sizeClass(nsize)) {
+            bytes += nsize - osize;
+            return ptr;
+        }
+        if (!small && nsize > HEAP_GRAIN * HEAP_CLASSES) {
+            if (nsize > osize && !reserve(nsize - osize, false))
+                return nullptr;
+            void *ret = realloc(ptr, nsize);
+            //a failed shrink keeps the old block,it is accounted with the size lua frees it with
+            if (nsize < osize) unreserve(osize - nsize);
+            if (ret == nullptr) {
+                if (nsize > osize) {
+                    unreserve(nsize - osize);
+                    return nullptr;
+                }
+                ret = ptr;
+            }
+            bytes += nsize - osize;
+            return ret;
+        }
+        //lua assumes a shrink never fails
+        void *ret = allocate(nsize, nsize < osize);
+        if (ret == nullptr) {
+            if (nsize > osize) return nullptr;
+            //the old block is kept and later freed as a small one into a free list,
+            //a malloc block that ends there is no longer accounted and only freed with the process
+            if (!small) unreserve(osize);
+            bytes += nsize - osize;
+            return ptr;
+        }
+        memcpy(ret, ptr, nsize < osize ? nsize : osize);
+        release(ptr, osize);
+        return ret;
+    }
+
+    static int compareSlabs(const void *l, const void *r) {
+        uintptr_t a = uintptr_t(*(Slab **) l), b = uintptr_t(*(Slab **) r);
+        return a < b ? -1 : a > b;
+    }
+
+    //the slab holding the block,nullptr for a block that did not come from a slab
+    static Slab *findSlab(Slab **sorted, size_t count, void *block) {
+        size_t low = 0, high = count;
+        while (low < high) {
+            size_t mid = (low + high) / 2;
+            if ((char *) sorted[mid] + HEAP_SLAB_SIZE <= (char *) block) low = mid + 1;
+            else high = mid;
+        }
+        return low < count && (char *) sorted[low] < (char *) block ? sorted[low] : nullptr;
+    }
+
+public:
+    size_t bytes = 0;//in use by lua
+    size_t reserved = 0;//taken from the system
+    size_t allocs = 0;
+    size_t frees = 0;
+
+    explicit LuaHeap(HeapAccount *account) : account(account) {}
+
+    LuaHeap(const LuaHeap &) = delete;
+
+    ~LuaHeap() {
+        while (slabs != nullptr) {
+            Slab *next = slabs->next;
+            free(slabs);
+            unreserve(HEAP_SLAB_SIZE);
+            slabs = next;
+        }
+    }
+
+    //the limit is only applied once the state is set up
+    void setEnforced(bool enforced) {
+        enforce = enforced;
+    }
+
+    /**
+     * Frees the slabs whose blocks are all in the free lists,the one being carved is kept.
+     * Takes time linear in the free blocks.
+     * @return the number of slabs freed
+     */
+    size_t trim() {
+        Slab *carving = cursor != nullptr ? slabs : nullptr;
+        size_t count = 0;
+        for (Slab *slab = slabs; slab != nullptr; slab = slab->next) {
+            if (slab != carving) ++count;
+        }
+        if (count == 0) return 0;
+        auto **sorted = (Slab **) malloc(count * sizeof(Slab *));
+        if (sorted == nullptr) return 0;
+        size_t i = 0;
+        for (Slab *slab = slabs; slab != nullptr; slab = slab->next) {
+            if (slab == carving) continue;
+            slab->freeBytes = 0;
+            sorted[i++] = slab;
+        }
+        qsort(sorted, count, sizeof(Slab *), compareSlabs);
+        //a block can sit in the list of a smaller class than its own,so a slab is never overcounted
+        for (int index = 0; index < HEAP_CLASSES; ++index) {
+            for (FreeBlock *block = freeLists[index]; block != nullptr; block = block->next) {
+                if (Slab *slab = findSlab(sorted, count, block))
+                    slab->freeBytes += size_t(index + 1) * HEAP_GRAIN;
+            }
+        }
+        const size_t capacity = HEAP_SLAB_SIZE - sizeof(Slab);
+        size_t freed = 0;
+        for (i = 0; i < count; ++i) {
+            if (sorted[i]->freeBytes == capacity) ++freed;
+        }
+        if (freed != 0) {
+            for (int index = 0; index < HEAP_CLASSES; ++index) {
+                FreeBlock **link = &freeLists[index];
+                while (*link != nullptr) {
+                    Slab *slab = findSlab(sorted, count, *link);
+                    if (slab != nullptr && slab->freeBytes == capacity) *link = (*link)->next;
+                    else link = &(*link)->next;
+                }
+            }
+            Slab **link = &slabs;
+            while (*link != nullptr) {
+                Slab *slab = *link;
+                if (slab != carving && slab->freeBytes == capacity) {
+                    *link = slab->next;
+                    free(slab);
+                    unreserve(HEAP_SLAB_SIZE);
+                } else link = &slab->next;
+            }
+        }
+        free(sorted);
+        return freed;
+    }
+
+    static void *alloc(void *ud, void *ptr, size_t osize, size_t nsize) {
+        auto *heap = (LuaHeap *) ud;
+        if (ptr == nullptr)
+            return nsize == 0 ? nullptr : heap->allocate(nsize, false);
+        if (nsize == 0) {
+            heap->release(ptr, osize);
+            return nullptr;
+        }
+        return heap->reallocate(ptr, osize, nsize);
+    }
+
+    //states that cannot use the heap fall back to the default allocator,
+    //they are not accounted and of() gives nullptr for them
+    static lua_State *newState(HeapAccount *account) {
+#ifdef LUAJIT_VERSION_NUM
+        //64 bit LuaJIT refuses custom allocators
+        (void) account;
+        return luaL_newstate();
+#else
+        auto *heap = new LuaHeap(account);
+        lua_State *L = lua_newstate(alloc, heap);
+        if (L == nullptr) {
+            delete heap;
+            L = luaL_newstate();
+        }
+        return L;
+#endif
+    }
+
+    static LuaHeap *of(lua_State *L) {
+        void *ud;
+        return lua_getallocf(L, &ud) == alloc ? (LuaHeap *) ud : nullptr;
+    }
+
+    static void closeState(lua_State *L) {
+        LuaHeap *heap = of(L);
+        lua_close(L);
+        delete heap;
+    }
+};
+
+#endif //LUADROID_LUAHEAP_H
@@ -0,0 +1,217 @@
+
+
+#ifndef LUADROID_SCRIPTEXECUTOR_H
+#define LUADROID_SCRIPTEXECUTOR_H
+
+#include <pthread.h>
+#include <unistd.h>
+#include <climits>
+#include "common.h"
+#include "myarray.h"
+#include "SpinLock.h"
+#include "atomic.h"
+#include "TJNIEnv.h"
+
+class ScriptContext;
+
+/**
+ * Fixed pool of attached worker threads running scripts of one context.
+ * Each worker configures its lua state once and keeps it for its whole life.
+ * Tasks are dealt round robin,a worker takes the oldest task of its own deque
+ * and steals the newest one of the others before sleeping.
+ */
+class ScriptExecutor {
+public:
+    struct Task {
+        jobject script;
+        jobjectArray args;
+        jobject future;
+    };
+    typedef void (*Runner)(TJNIEnv *env, ScriptContext *context, Task &task);
+private:
+    class TaskDeque {
+        Task *tasks = nullptr;
+        uint32_t capacity = 0;
+        uint32_t head = 0;
+        uint32_t count = 0;
+
+        void grow() {
+            uint32_t newCapacity = capacity ? capacity << 1 : 16;
+            Task *newTasks = new Task[newCapacity];
+            for (uint32_t i = 0; i < count; ++i) {
+                newTasks[i] = tasks[(head + i) & (capacity - 1)];
+            }
+            delete[] tasks;
+            tasks = newTasks;
+            capacity = newCapacity;
+            head = 0;
+        }
+
+    public:
+        AdaptiveLock lock;
+
+        void push(const Task &task) {
+            if (count == capacity) grow();
+            tasks[(head + count++) & (capacity - 1)] = task;
+        }
+
+        bool popFront(Task &out) {
+            if (count == 0) return false;
+            out = tasks[head];
+            head = (head + 1) & (capacity - 1);
+            --count;
+            return true;
+        }
+
+        bool popBack(Task &out) {
+            if (count == 0) return false;
+            out = tasks[(head + --count) & (capacity - 1)];
+            return true;
+        }
+
+        ~TaskDeque() {
+            delete[] tasks;
+        }
+    };
+
+    struct Worker {
+        ScriptExecutor *executor = nullptr;
+        uint32_t index = 0;
+        bool started = false;
+        pthread_t thread;
+        TaskDeque deque;
+    };
+
+    ScriptContext *const context;
+    const Runner runner;
+    jobject const contextRef;
+    Array<Worker> workers;
+    volatile at_int signal = 0;
+    volatile at_int sleepers = 0;
+    volatile at_int stopping = 0;
+    volatile at_int next = 0;
+
+    static uint32_t threadCount(int threads) {
+        if (threads > 0) return uint32_t(threads);
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        return cpus > 0 ? uint32_t(cpus) : 1;
+    }
+
+    bool take(uint32_t index, Task &out) {
+        {
+            TaskDeque &own = workers[index].deque;
+            ScopeLock sentry(own.lock);
+            if (own.popFront(out)) return true;
+        }
+        for (uint32_t i = 1, n = workers.size(); i < n; ++i) {
+            TaskDeque &victim = workers[(index + i) % n].deque;
+            ScopeLock sentry(victim.lock);
+            if (victim.popBack(out)) return true;
+        }
+        return false;
+    }
+
+    static void releaseTask(TJNIEnv *env, Task &task) {
+        env->DeleteGlobalRef(task.script);
+        if (task.args) env->DeleteGlobalRef(task.args);
+        env->DeleteGlobalRef(task.future);
+    }
+
+    void wakeUp(int count) {
+        at_int_add(&signal, 1);
+        if (at_int_add(&sleepers, 0) > 0)
+            at_futex_wake(&signal, count);
+    }
+
+    static void *run(void *arg) {
+        auto *worker = (Worker *) arg;
+        ScriptExecutor *executor = worker->executor;
+        JNIEnv *jniEnv;
+        if (vm->AttachCurrentThreadAsDaemon(&jniEnv, nullptr) != JNI_OK) {
+            LOGE("Failed to attach executor worker");
+            return nullptr;
+        }
+        auto *env = (TJNIEnv *) jniEnv;
+        //a worker without a state reports the failure with each task
+        if (executor->context->getLua() == nullptr)
+            env->DeleteLocalRef(executor->context->getThreadContext()->transferJavaError());
+        Task task;
+        for (;;) {
+            int seen = at_int_load_acquire(&executor->signal);
+            //read before the take,so the tasks submitted before the stop are all found by it
+            bool stop = at_int_load_acquire(&executor->stopping) != 0;
+            if (executor->take(worker->index, task)) {
+                executor->runner(env, executor->context, task);
+                releaseTask(env, task);
+                continue;
+            }
+            if (stop) break;
+            at_int_add(&executor->sleepers, 1);
+            at_futex_wait(&executor->signal, seen);
+            at_int_add(&executor->sleepers, -1);
+        }
+        //the lua state is closed by the thread context when the thread exits
+        vm->DetachCurrentThread();
+        return nullptr;
+    }
+
+public:
+    ScriptExecutor(TJNIEnv *env, ScriptContext *context, jobject javaContext, int threads, Runner runner)
+            : context(context), runner(runner), contextRef(env->NewGlobalRef(javaContext)),
+              workers(threadCount(threads)) {
+        for (uint32_t i = 0; i < workers.size(); ++i) {
+            Worker &worker = workers[i];
+            worker.executor = this;
+            worker.index = i;
+            int err = pthread_create(&worker.thread, nullptr, run, &worker);
+            if (err) LOGE("Failed to create executor worker=%d", err);
+            else worker.started = true;
+        }
+    }
+
+    ScriptExecutor(const ScriptExecutor &) = delete;
+
+    uint32_t size() const {
+        return workers.size();
+    }
+
+    //the task takes the global refs,returns false if the executor is stopping
+    bool submit(const Task &task) {
+        if (at_int_load(&stopping)) return false;
+        uint32_t index = uint32_t(at_int_add(&next, 1)) % workers.size();
+        {
+            TaskDeque &deque = workers[index].deque;
+            ScopeLock sentry(deque.lock);
+            deque.push(task);
+        }
+        wakeUp(1);
+        return true;
+    }
+
+    bool isWorkerThread() {
+        pthread_t self = pthread_self();
+        for (auto &&worker:workers) {
+            if (worker.started && pthread_equal(worker.thread, self)) return true;
+        }
+        return false;
+    }
+
+    //queued tasks are still run,must not be called from a worker
+    void shutdown(TJNIEnv *env) {
+        at_int_store(&stopping, 1);
+        wakeUp(INT_MAX);
+        for (auto &&worker:workers) {
+            if (worker.started) pthread_join(worker.thread, nullptr);
+        }
+        //only a submit racing with the stop,or a pool without workers,leaves tasks behind
+        Task task;
+        while (take(0, task)) {
+            static jmethodID cancel = env->GetMethodID(env->GetObjectClass(task.future), "cancel", "(Z)Z");
+            env->CallBooleanMethod(task.future, cancel, JNI_FALSE);
+            releaseTask(env, task);
+        }
+        env->DeleteGlobalRef(contextRef);
+    }
+};
+
+#endif //LUADROID_SCRIPTEXECUTOR_H
@@ -0,0 +1,166 @@
+
+
+#ifndef LUADROID_SHAREDTABLE_H
+#define LUADROID_SHAREDTABLE_H
+
+#include <cstring>
+#include "lua_object.h"
+#include "myarray.h"
+#include "atomic.h"
+#include "farmhash.h"
+
+/**
+ * Immutable table read in place by all lua states of a context.
+ * Keys 1..length() live in the array part,the others in an open addressed hash part.
+ * Every lua proxy and every cross slot holds a reference.
+ */
+class SharedTable {
+public:
+    struct Key {
+        int type = T_NIL;
+        uint32_t length = 0;
+        union {
+            uint8_t isTrue;
+            lua_Integer integer = 0;
+            lua_Number number;
+            const char *string;
+        };
+
+        bool operator==(const Key &other) const {
+            if (type != other.type) return false;
+            switch (type) {
+                case T_BOOLEAN:
+                    return isTrue == other.isTrue;
+                case T_INTEGER:
+                    return integer == other.integer;
+                case T_FLOAT:
+                    return number == other.number;
+                case T_STRING:
+                    return length == other.length && memcmp(string, other.string, length) == 0;
+                default:
+                    return false;
+            }
+        }
+    };
+
+    struct Entry {
+        uint32_t hash = 0;
+        Key key;
+        CrossThreadLuaObject value;
+
+        ~Entry() {
+            if (key.type == T_STRING) delete[] key.string;
+        }
+    };
+
+private:
+    volatile at_int refCount = 1;
+    Array<CrossThreadLuaObject> array;
+    Array<Entry> entries;
+    const uint32_t mask;
+
+    static uint32_t capacityFor(uint32_t count) {
+        uint32_t capacity = 2;
+        while (capacity * 3 < (count + 1) * 4) capacity <<= 1;
+        return capacity;
+    }
+
+    static uint32_t mix(uint64_t v) {
+        return uint32_t(v ^ (v >> 32)) * 0x9E3779B1u;
+    }
+
+public:
+    SharedTable(uint32_t arraySize, uint32_t hashCount) : array(arraySize), entries(capacityFor(hashCount)),
+                                                          mask(capacityFor(hashCount) - 1) {}
+
+    SharedTable(const SharedTable &) = delete;
+
+    static uint32_t hashOf(const Key &key) {
+        switch (key.type) {
+            case T_BOOLEAN:
+                return key.isTrue + 1u;
+            case T_INTEGER:
+                return mix((uint64_t) key.integer);
+            case T_FLOAT: {
+                uint64_t bits;
+                memcpy(&bits, &key.number, sizeof(bits));
+                return mix(bits);
+            }
+            case T_STRING:
+                return util::Hash32(key.string, key.length);
+            default:
+                return 0;
+        }
+    }
+
+    bool inArray(const Key &key) const {
+        return key.type == T_INTEGER && key.integer >= 1 && key.integer <= (lua_Integer) array.size();
+    }
+
+    CrossThreadLuaObject &arrayAt(uint32_t index) {
+        return array[index];
+    }
+
+    //Only for building,the key must be absent and owns its string
+    CrossThreadLuaObject &insert(Key &key) {
+        uint32_t hash = hashOf(key);
+        uint32_t i = hash & mask;
+        while (entries[i].key.type != T_NIL) i = (i + 1) & mask;
+        Entry &entry = entries[i];
+        entry.hash = hash;
+        entry.key = key;
+        key.type = T_NIL;
+        return entry.value;
+    }
+
+    //returns -1 if absent
+    int32_t slotOf(const Key &key) const {
+        if (inArray(key)) return int32_t(key.integer - 1);
+        uint32_t hash = hashOf(key);
+        for (uint32_t i = hash & mask;; i = (i + 1) & mask) {
+            const Entry &entry = entries[i];
+            if (entry.key.type == T_NIL) return -1;
+            if (entry.hash == hash && entry.key == key) return int32_t(array.size() + i);
+        }
+    }
+
+    const CrossThreadLuaObject *get(const Key &key) const {
+        int32_t slot = slotOf(key);
+        if (slot < 0) return nullptr;
+        return slot < (int32_t) array.size() ? &array[slot] : &entries[slot - array.size()].value;
+    }
+
+    //first slot after the given one holding a value,-1 if none
+    int32_t nextSlot(int32_t slot, const Key **key, const CrossThreadLuaObject **value) const {
+        uint32_t arraySize = array.size();
+        for (uint32_t i = uint32_t(slot + 1); i < arraySize + entries.size(); ++i) {
+            if (i < arraySize) {
+                if (array[i].type == T_NIL) continue;
+                *key = nullptr;
+                *value = &array[i];
+            } else {
+                const Entry &entry = entries[i - arraySize];
+                if (entry.key.type == T_NIL || entry.value.type == T_NIL) continue;
+                *key = &entry.key;
+                *value = &entry.value;
+            }
+            return int32_t(i);
+        }
+        return -1;
+    }
+
+    uint32_t length() const {
+        return array.size();
+    }
+
+    void addRef() {
+        at_int_add(&refCount, 1);
+    }
+
+    void release() {
+        if (at_int_add(&refCount, -1) == 0)
+            delete this;
+    }
+};
+
+#endif //LUADROID_SHAREDTABLE_H
@@ -3,56 +3,104 @@
 #define LUADROID_SPINLOCK_H
 
 #include <unistd.h>
+#include <sched.h>
+#include <time.h>
 #include "atomic.h"
+#include "macros.h"
 #include "pthread.h"
 
-class ReSpinLock {
-    volatile at_flag locked = 0;
+struct LockStats {
+    uint32_t acquireCount = 0;
+    uint32_t contendedCount = 0;
+    uint64_t waitNanos = 0;
+};
+
+/**
+ * Try to take the lock directly,then spin with exponential backoff for a while,
+ * and finally sleep on a futex until the owner wakes us.
+ * Stats are only updated by the owner so no atomic operation is needed.
+ */
+class AdaptiveLock {
+    //0:unlocked,1:locked,2:locked and someone may be waiting
+    volatile at_int state = 0;
+    LockStats stats;
+
+    static inline uint64_t nanoTime() {
+        struct ::timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return uint64_t(now.tv_sec) * 1000000000 + now.tv_nsec;
+    }
+
+    void lockSlow() {
+        uint64_t start = nanoTime();
+        for (int backoff = 1; backoff <= MAX_BACKOFF; backoff <<= 1) {
+            for (int i = backoff; i--;)
+                at_cpu_relax();
+            if (at_int_load(&state) == 0 && at_int_cas(&state, 0, 1) == 0)
+                goto ACQUIRED;
+        }
+        sched_yield();
+        while (at_int_exchange(&state, 2) != 0)
+            at_futex_wait(&state, 2);
+        ACQUIRED:
+        ++stats.acquireCount;
+        ++stats.contendedCount;
+        stats.waitNanos += nanoTime() - start;
+    }
+
+public:
+    static const int MAX_BACKOFF = 64;
+
+    AdaptiveLock() {}
+
+    AdaptiveLock(const AdaptiveLock &) = delete;
+
+    void lock() {
+        if (likely(at_int_cas(&state, 0, 1) == 0)) {
+            ++stats.acquireCount;
+            return;
+        }
+        lockSlow();
+    }
+
+    void unlock() {
+        if (at_int_exchange(&state, 0) == 2)
+            at_futex_wake(&state, 1);
+    }
+
+    const LockStats &getStats() const {
+        return stats;
+    }
+};
+
+class ReAdaptiveLock {
+    AdaptiveLock lock_;
     int count = 0;
-    pthread_t holder = 0;
+    volatile pthread_t holder = 0;
 public:
-    volatile void lock() {
-      pthread_t self=  pthread_self();
+    void lock() {
+        pthread_t self = pthread_self();
         if (self != holder) {
-            while (at_flag_test_and_set(&locked)) {
-                struct ::timespec req;
-                req.tv_sec = 0;
-                req.tv_nsec = 1000;
-                nanosleep(&req,NULL);
-            }
+            lock_.lock();
             holder = self;
         }
         ++count;
     }
 
-    volatile void unlock() {
+    void unlock() {
         if (pthread_self() != holder)
             return;
-        --count;
-        if (count == 0) {
+        if (--count == 0) {
             holder = 0;
-            at_flag_clear(&locked);
+            lock_.unlock();
         }
-
-    }
-};
-class SpinLock {
-    volatile at_flag locked = 0;
-public:
-    volatile void lock() {
-            while (at_flag_test_and_set(&locked)) {
-                struct ::timespec req;
-                req.tv_sec = 0;
-                req.tv_nsec = 1000;
-                nanosleep(&req,NULL);
-            }
-
     }
 
-    volatile void unlock() {
-        at_flag_clear(&locked);
+    const LockStats &getStats() const {
+        return lock_.getStats();
     }
 };
+
 template <class mutex>
 class lock_guard{
      mutex* m;
@@ -67,6 +115,6 @@ public:
     }
 };
 
-typedef lock_guard<SpinLock> ScopeLock;
-typedef  lock_guard<ReSpinLock> ReScopeLock;
+typedef lock_guard<AdaptiveLock> ScopeLock;
+typedef  lock_guard<ReAdaptiveLock> ReScopeLock;
 #endif //LUADROID_SPINLOCK_H
@@ -0,0 +1,79 @@
+
+
+#ifndef LUADROID_STRINGCACHE_H
+#define LUADROID_STRINGCACHE_H
+
+#include <cstring>
+#include <jni.h>
+#include "farmhash.h"
+
+#define STRING_CACHE_MAX_LENGTH 40
+#define STRING_CACHE_SETS 16
+#define STRING_CACHE_WAYS 4
+
+/**
+ * Per thread cache of the java strings made for short lua strings,
+ * so repeated keys and constants don't allocate a new string every time.
+ * Each set of entries replaces its least recently used one.
+ */
+class StringCache {
+    struct Entry {
+        jstring string = nullptr;
+        uint32_t hash = 0;
+        uint32_t stamp = 0;
+        uint32_t length = 0;
+        char bytes[STRING_CACHE_MAX_LENGTH];
+    };
+    Entry entries[STRING_CACHE_SETS * STRING_CACHE_WAYS];
+    uint32_t clock = 0;
+
+    Entry *setOf(uint32_t hash) {
+        return entries + (hash & (STRING_CACHE_SETS - 1)) * STRING_CACHE_WAYS;
+    }
+
+public:
+    static bool cacheable(size_t length) {
+        return length <= STRING_CACHE_MAX_LENGTH;
+    }
+
+    static uint32_t hashOf(const char *s, size_t length) {
+        return util::Hash32(s, length);
+    }
+
+    //a new local ref,null if absent
+    jstring get(JNIEnv *env, const char *s, size_t length, uint32_t hash) {
+        Entry *set = setOf(hash);
+        for (int i = 0; i < STRING_CACHE_WAYS; ++i) {
+            Entry &entry = set[i];
+            if (entry.string != nullptr && entry.hash == hash && entry.length == length &&
+                memcmp(entry.bytes, s, length) == 0) {
+                entry.stamp = ++clock;
+                return (jstring) env->NewLocalRef(entry.string);
+            }
+        }
+        return nullptr;
+    }
+
+    void put(JNIEnv *env, const char *s, size_t length, uint32_t hash, jstring string) {
+        Entry *set = setOf(hash);
+        Entry *victim = set;
+        for (int i = 1; i < STRING_CACHE_WAYS && victim->string != nullptr; ++i) {
+            if (set[i].string == nullptr || set[i].stamp < victim->stamp) victim = &set[i];
+        }
+        if (victim->string != nullptr) env->DeleteGlobalRef(victim->string);
+        victim->string = (jstring) env->NewGlobalRef(string);
+        victim->hash = hash;
+        victim->stamp = ++clock;
+        victim->length = uint32_t(length);
+        memcpy(victim->bytes, s, length);
+    }
+
+    void clear(JNIEnv *env) {
+        for (auto &&entry:entries) {
+            if (entry.string != nullptr) env->DeleteGlobalRef(entry.string);
+            entry.string = nullptr;
+        }
+    }
+};
+
+#endif //LUADROID_STRINGCACHE_H
@@ -1,6 +1,10 @@
 
 #include "stdatomic.h"
 #include "atomic.h"
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <time.h>
 
 void at_flag_clear(volatile at_flag* flag){
     atomic_flag_clear((atomic_flag *) flag);
@@ -8,5 +12,69 @@ void at_flag_clear(volatile at_flag* flag){
 bool at_flag_test_and_set(volatile at_flag* flag){
     return atomic_flag_test_and_set((atomic_flag *) flag);
 }
-
-
+void* at_ptr_load(volatile at_ptr* ptr){
+    return atomic_load_explicit(ptr,memory_order_acquire);
+}
+void at_ptr_store(volatile at_ptr* ptr, void* value){
+    atomic_store_explicit(ptr,value,memory_order_release);
+}
+bool at_ptr_cas(volatile at_ptr* ptr, void* expected, void* desired){
+    return atomic_compare_exchange_strong_explicit(ptr,&expected,desired,
+                                                   memory_order_acq_rel,memory_order_acquire);
+}
+int at_int_load(volatile at_int* value){
+    return atomic_load_explicit(value,memory_order_relaxed);
+}
+int at_int_load_acquire(volatile at_int* value){
+    return atomic_load_explicit(value,memory_order_acquire);
+}
+void at_int_store(volatile at_int* value, int desired){
+    atomic_store_explicit(value,desired,memory_order_release);
+}
+int at_int_cas(volatile at_int* value, int expected, int desired){
+    atomic_compare_exchange_strong_explicit(value,&expected,desired,
+                                            memory_order_acquire,memory_order_relaxed);
+    return expected;
+}
+int at_int_exchange(volatile at_int* value, int desired){
+    return atomic_exchange_explicit(value,desired,memory_order_acq_rel);
+}
+int at_int_add(volatile at_int* value, int delta){
+    return atomic_fetch_add_explicit(value,delta,memory_order_seq_cst)+delta;
+}
+void at_futex_wait(volatile at_int* value, int expected){
+    syscall(__NR_futex,value,FUTEX_WAIT_PRIVATE,expected,NULL,NULL,0);
+}
+void at_futex_wait_timeout(volatile at_int* value, int expected, int64_t nanos){
+    if(nanos<0){
+        at_futex_wait(value,expected);
+        return;
+    }
+    struct timespec timeout={(time_t)(nanos/1000000000),(long)(nanos%1000000000)};
+    syscall(__NR_futex,value,FUTEX_WAIT_PRIVATE,expected,&timeout,NULL,0);
+}
+void at_futex_wake(volatile at_int* value, int count){
+    syscall(__NR_futex,value,FUTEX_WAKE_PRIVATE,count,NULL,NULL,0);
+}
+void at_cpu_relax(){
+#if defined(__i386__) || defined(__x86_64__)
+    __asm__ __volatile__("pause");
+#elif defined(__arm__) || defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+void at_counter_inc(volatile at_counter* counter){
+    atomic_fetch_add_explicit(counter,1,memory_order_relaxed);
+}
+void at_counter_dec(volatile at_counter* counter){
+    atomic_fetch_sub_explicit(counter,1,memory_order_relaxed);
+}
+uintptr_t at_counter_get(volatile at_counter* counter){
+    return atomic_load_explicit(counter,memory_order_relaxed);
+}
+void at_counter_set(volatile at_counter* counter, uintptr_t value){
+    atomic_store_explicit(counter,value,memory_order_relaxed);
+}
+uintptr_t at_counter_add(volatile at_counter* counter, intptr_t delta){
+    return atomic_fetch_add_explicit(counter,(uintptr_t)delta,memory_order_relaxed)+(uintptr_t)delta;
+}
@@ -14,6 +14,52 @@ void at_flag_clear(volatile at_flag* flag);
 
 bool at_flag_test_and_set(volatile at_flag* flag);
 
+typedef _Atomic(void*) at_ptr;
+
+void* at_ptr_load(volatile at_ptr* ptr);
+
+void at_ptr_store(volatile at_ptr* ptr, void* value);
+
+bool at_ptr_cas(volatile at_ptr* ptr, void* expected, void* desired);
+
+typedef _Atomic(int) at_int;
+
+int at_int_load(volatile at_int* value);
+
+int at_int_load_acquire(volatile at_int* value);
+
+void at_int_store(volatile at_int* value, int desired);
+
+//return the old value
+int at_int_cas(volatile at_int* value, int expected, int desired);
+
+int at_int_exchange(volatile at_int* value, int desired);
+
+//return the new value
+int at_int_add(volatile at_int* value, int delta);
+
+void at_futex_wait(volatile at_int* value, int expected);
+
+//a negative timeout waits forever
+void at_futex_wait_timeout(volatile at_int* value, int expected, int64_t nanos);
+
+void at_futex_wake(volatile at_int* value, int count);
+
+void at_cpu_relax();
+
+typedef _Atomic(uintptr_t) at_counter;
+
+void at_counter_inc(volatile at_counter* counter);
+
+void at_counter_dec(volatile at_counter* counter);
+
+uintptr_t at_counter_get(volatile at_counter* counter);
+
+void at_counter_set(volatile at_counter* counter, uintptr_t value);
+
+//return the new value
+uintptr_t at_counter_add(volatile at_counter* counter, intptr_t delta);
+
 #ifdef __cplusplus
 }
 #endif
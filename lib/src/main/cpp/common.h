@@ -16,6 +16,7 @@ extern jclass classType;
 extern jclass throwableType;
 extern jclass contextClass;
 extern jclass loaderClass;
+extern jclass byteBufferType;
 extern jmethodID objectHash;
 extern jmethodID classGetName;
 extern jmethodID objectToString;
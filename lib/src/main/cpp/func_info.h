@@ -123,6 +123,7 @@ struct Import {
 
 
 class CrossThreadLuaObject;
+class ScriptContext;
 class FuncInfo : public BaseFunction {
     Import *imported = nullptr;
     Array<CrossThreadLuaObject> upvalues;
@@ -133,6 +134,9 @@ public:
 #if LUA_VERSION_NUM >502
     int globalIndex=0;
 #endif
+    ScriptContext *owner = nullptr;
+    //threads whose state cached it,guarded by the gcLock of the owner
+    mutable Vector<intptr_t> residentIn;
 
     explicit FuncInfo(const lua_CFunction func) : cFunc(func), isCFunc(true) {}
 
@@ -4,6 +4,7 @@
 
 jmethodID JavaType::sGetComponentType;
 jmethodID JavaType::sFindMembers;
+jmethodID JavaType::sFindAllMembers;
 jmethodID JavaType::sFindMockName;
 jmethodID JavaType::sGetSingleInterface;
 jmethodID JavaType::sIsTableType;
@@ -96,10 +97,15 @@ return nullptr;//unreachable statement;
 
 Member* JavaType::ensureMember(TJNIEnv *env, const String &name, bool isStatic) {
     auto &&map = isStatic ? staticMembers : objectMembers;
-    auto &&iter = map.find(name);
-    if (iter != map.end()){
-        return &iter->second;
+    {
+        ScopeLock sentry(memberLock);
+        auto &&iter = map.find(name);
+        if (iter != map.end()){
+            return &iter->second;
+        }
     }
+    //preload only packs the members it collects,others(like synthetic or bridge methods)
+    //are still looked up by name
     JString str = env->NewStringUTF(&name[0]);
     Member member;
     if(name!="<init>"){
@@ -159,11 +165,168 @@ Member* JavaType::ensureMember(TJNIEnv *env, const String &name, bool isStatic)
         member.methods=std::move(methodArray);
     }
     END:
-    if(member.fields.size()||member.methods.size())
-    return &map.emplace(name, std::move(member)).first->second;
+    if(member.fields.size()||member.methods.size()){
+        ScopeLock sentry(memberLock);
+        return &map.emplace(name, std::move(member)).first->second;
+    }
     else return nullptr;
 }
 
+class MemberRefs {
+    TJNIEnv *env;
+    jobjectArray refs;
+    ScriptContext *context;
+    Array<JavaType *> types;
+public:
+    MemberRefs(TJNIEnv *env, jobjectArray refs, ScriptContext *context) : env(env), refs(refs), context(context),
+                                                                          types((uint32_t) env->GetArrayLength(refs)) {
+        memset(types.begin(), 0, types.size() * sizeof(JavaType *));
+    }
+
+    JObject get(int32_t index) {
+        return index < 0 ? JObject(env, nullptr) : env->GetObjectArrayElement(refs, index);
+    }
+
+    //classes are shared by many members,so each of them is resolved once only
+    JavaType *type(int32_t index) {
+        if (index < 0) return nullptr;
+        JavaType *&ret = types[index];
+        if (ret == nullptr)
+            ret = context->ensureType(env, (JClass) get(index));
+        return ret;
+    }
+
+    jobject globalRef(int32_t index) {
+        if (index < 0) return nullptr;
+        return env->NewGlobalRef(get(index));
+    }
+};
+
+void JavaType::preloadMembers(TJNIEnv *env) {
+    loadAllMembers(env, false);
+    loadAllMembers(env, true);
+}
+
+/*
+ * Layout of the descriptor,all values are native order int32 and indices point into refs:
+ * nameCount,{name,fieldCount,methodCount,
+ *            {field,type,genericType}[fieldCount],
+ *            {method,returnType,genericReturnType,paramCount,{param,genericParam}[paramCount],varArgType}[methodCount]
+ *           }[nameCount]
+ * a negative index stands for null
+ */
+void JavaType::loadAllMembers(TJNIEnv *env, bool isStatic) {
+    if (membersLoaded[isStatic]) return;
+    JObjectArray refs = (JObjectArray) env->CallStaticObjectMethod(contextClass, sFindAllMembers, type, isStatic);
+    if (refs == nullptr) {
+        env->ExceptionClear();
+        return;
+    }
+    JObject buffer = env->GetObjectArrayElement(refs, 0);
+    auto *desc = (const int32_t *) env->GetDirectBufferAddress(buffer);
+    if (unlikely(desc == nullptr)) return;
+    MemberRefs reader(env, refs, context);
+    auto &&map = isStatic ? staticMembers : objectMembers;
+    int32_t nameCount = *desc++;
+    while (nameCount--) {
+        JString name = (JString) reader.get(*desc++);
+        uint32_t fieldCount = (uint32_t) *desc++;
+        uint32_t methodCount = (uint32_t) *desc++;
+        Member member;
+        if (fieldCount != 0) {
+            FieldArray fieldArray(fieldCount);
+            for (FieldInfo &info:fieldArray) {
+                info.id = env->FromReflectedField(reader.get(*desc++));
+                info.type.rawType = reader.type(*desc++);
+                info.type.realType = reader.globalRef(*desc++);
+            }
+            member.fields = std::move(fieldArray);
+        }
+        if (methodCount != 0) {
+            MethodArray methodArray(methodCount);
+            for (MethodInfo &info:methodArray) {
+                info.id = env->FromReflectedMethod(reader.get(*desc++));
+                info.returnType.rawType = reader.type(*desc++);
+                info.returnType.realType = reader.globalRef(*desc++);
+                uint32_t paramLen = (uint32_t) *desc++;
+                Array<ParameterizedType> paramArray(paramLen);
+                for (ParameterizedType &param:paramArray) {
+                    param.rawType = reader.type(*desc++);
+                    param.realType = reader.globalRef(*desc++);
+                }
+                info.params = std::move(paramArray);
+                int32_t varArgIndex = *desc++;
+                if (varArgIndex >= 0) {
+                    info.varArgType.rawType = info.params[paramLen - 1].rawType->getComponentType(env);
+                    info.varArgType.realType = reader.globalRef(varArgIndex);
+                } else info.varArgType.rawType = nullptr;
+            }
+            member.methods = std::move(methodArray);
+        }
+        FakeString key(name.str());
+        ScopeLock sentry(memberLock);
+        //members resolved on another thread meanwhile are kept since they may be in use
+        map.emplace((const String &) key, std::move(member));
+    }
+    membersLoaded[isStatic] = true;
+}
+
+
+static bool makeDeductKeys(Vector<JavaType *> &types, Vector<ValidLuaObject> &arguments, uintptr_t *keys) {
+    uint32_t len = types.size();
+    if (len > DEDUCT_CACHE_MAX_ARGS) return false;
+    for (uint32_t i = 0; i < len; ++i) {
+        const ValidLuaObject &luaObject = arguments[i];
+        JavaType *provided = types[i];
+        uintptr_t shape = uintptr_t(luaObject.type) << 4;
+        if (provided == nullptr) {
+            switch (luaObject.type) {
+                case T_TABLE:
+                    //depends on the content of the table
+                    return false;
+                case T_INTEGER: {
+                    long long v = luaObject.integer;
+                    shape |= v >= INT8_MIN && v <= INT8_MAX ? 0 : v >= INT16_MIN && v <= INT16_MAX ? 1 :
+                                                                  v >= INT32_MIN && v <= INT32_MAX ? 2 : 3;
+                    break;
+                }
+                case T_STRING: {
+                    size_t strLen = strnlen(luaObject.string, 5);
+                    shape |= strLen != 0 && strLen < 5 && strlen8to16(luaObject.string) == 1;
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+        if (luaObject.type == T_OBJECT)
+            shape = uintptr_t(luaObject.objectRef->type);
+        keys[i * 2] = uintptr_t(provided);
+        keys[i * 2 + 1] = shape;
+    }
+    return true;
+}
+
+const MethodInfo *JavaType::deductMethod(TJNIEnv *env, const Member *member, Vector<JavaType *> &types,
+                                         Vector<ValidLuaObject> *arguments, bool *gotVarArg) {
+    uintptr_t keys[DEDUCT_CACHE_MAX_ARGS * 2];
+    uint32_t argCount = types.size();
+    if (arguments == nullptr || !makeDeductKeys(types, *arguments, keys))
+        return deductMethod(env, &member->methods, types, arguments, gotVarArg);
+    auto entry = member->deductCache.find(argCount, keys);
+    if (entry != nullptr) {
+        at_counter_inc(&context->deductCacheHits);
+        if (gotVarArg) *gotVarArg = entry->isVarArg;
+        return entry->info;
+    }
+    at_counter_inc(&context->deductCacheMisses);
+    bool isVarArg;
+    auto info = deductMethod(env, &member->methods, types, arguments, &isVarArg);
+    if (info != nullptr)
+        member->deductCache.add(argCount, keys, info, isVarArg);
+    if (gotVarArg) *gotVarArg = isVarArg;
+    return info;
+}
 
 const MethodInfo *JavaType::deductMethod(TJNIEnv* env,const MethodArray* array, Vector<JavaType *> &types,
                                                    Vector<ValidLuaObject> *arguments, bool* gotVarArg) {
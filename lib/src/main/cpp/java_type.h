@@ -68,16 +68,75 @@ struct MethodInfo {
 
 typedef Array<MethodInfo> MethodArray;
 typedef Array<FieldInfo> FieldArray;
+#define DEDUCT_CACHE_SIZE 4
+#define DEDUCT_CACHE_MAX_ARGS 8
+struct DeductCacheEntry{
+    const MethodInfo* info;
+    uint32_t argCount;
+    bool isVarArg;
+    //(provided type,argument shape) for every argument
+    uintptr_t keys[DEDUCT_CACHE_MAX_ARGS*2];
+};
+//entries[0] is the monomorphic slot,the rest is filled on demand and never replaced
+struct DeductCache{
+    volatile at_ptr entries[DEDUCT_CACHE_SIZE]={};
+    DeductCache(){}
+    DeductCache(const DeductCache&)= delete;
+    DeductCache(DeductCache&& other){
+        steal(other);
+    }
+    DeductCache& operator=(DeductCache&& other){
+        this->~DeductCache();
+        steal(other);
+        return *this;
+    }
+    void steal(DeductCache& other){
+        for (int i = 0; i < DEDUCT_CACHE_SIZE; ++i) {
+            entries[i]=at_ptr_load(&other.entries[i]);
+            other.entries[i]= nullptr;
+        }
+    }
+    const DeductCacheEntry* find(uint32_t argCount,const uintptr_t* keys) const{
+        for (int i = 0; i < DEDUCT_CACHE_SIZE; ++i) {
+            auto entry=(const DeductCacheEntry*)at_ptr_load((volatile at_ptr*)&entries[i]);
+            if(entry== nullptr) return nullptr;
+            if(entry->argCount==argCount&&memcmp(entry->keys,keys,argCount*2* sizeof(uintptr_t))==0)
+                return entry;
+        }
+        return nullptr;
+    }
+    void add(uint32_t argCount,const uintptr_t* keys,const MethodInfo* info,bool isVarArg){
+        auto entry=new DeductCacheEntry;
+        entry->info=info;
+        entry->argCount=argCount;
+        entry->isVarArg=isVarArg;
+        memcpy(entry->keys,keys,argCount*2* sizeof(uintptr_t));
+        for (int i = 0; i < DEDUCT_CACHE_SIZE; ++i) {
+            if(at_ptr_cas(&entries[i], nullptr,entry))
+                return;
+        }
+        delete entry;
+    }
+    ~DeductCache(){
+        for (int i = 0; i < DEDUCT_CACHE_SIZE; ++i) {
+            delete (DeductCacheEntry*)at_ptr_load(&entries[i]);
+            entries[i]= nullptr;
+        }
+    }
+};
 //Should I optimize for field of length 1, it seems failed
 struct Member{
     MethodArray methods;
     FieldArray fields;
+    mutable DeductCache deductCache;
     Member(){}
-    Member(Member&& other):methods(std::move(other.methods)),fields(std::move(other.fields)){};
+    Member(Member&& other):methods(std::move(other.methods)),fields(std::move(other.fields)),
+                           deductCache(std::move(other.deductCache)){};
     Member& operator=(Member&& other){
         this->~Member();
         methods=std::move(other.methods);
         fields=std::move(other.fields);
+        deductCache=std::move(other.deductCache);
         return *this;
     };
 };
@@ -125,6 +184,7 @@ private:
 
     static jmethodID sGetComponentType;
     static jmethodID sFindMembers;
+    static jmethodID sFindAllMembers;
     static jmethodID sFindMockName;
     static jmethodID sGetSingleInterface;
     static jmethodID sIsInterface;
@@ -142,6 +202,8 @@ private:
     int8_t _isThrowableType=-1;
     TYPE_ID typeID=OBJECT;
 
+    AdaptiveLock memberLock;
+    volatile bool membersLoaded[2] = {false, false};
     MemberMap staticMembers;
     MemberMap objectMembers;
     Map<String,JavaType*> innerClasses;
@@ -158,6 +220,8 @@ private:
         return (JClass) env->CallObjectMethod(type, sGetComponentType);
     }
 
+    void loadAllMembers(TJNIEnv *env, bool isStatic);
+
 
 public:
     jobject newObject(ThreadContext *context, Vector<JavaType *> &types, Vector<ValidLuaObject> &params);
@@ -165,11 +229,17 @@ public:
     jarray newArray(ThreadContext *context,jint size, Vector<ValidLuaObject> &params);
     Member* ensureMember(TJNIEnv *env, const String &name, bool isStatic);
 
+    void preloadMembers(TJNIEnv *env);
+
     const MethodInfo *deductMethod(TJNIEnv* env,const MethodArray* array, Vector<JavaType *> &types,
                                    Vector<ValidLuaObject> *arguments, bool* gotVarArg= nullptr);
+    const MethodInfo *deductMethod(TJNIEnv* env,const Member* member, Vector<JavaType *> &types,
+                                   Vector<ValidLuaObject> *arguments, bool* gotVarArg= nullptr);
     const MethodInfo *findMethod(TJNIEnv* env,const String &name, bool isStatic, Vector<JavaType *> &types,
                                  Vector<ValidLuaObject> *arguments){
-        return deductMethod(env,ensureMethod(env,name,isStatic),types,arguments);
+        auto member=ensureMember(env,name,isStatic);
+        if(member== nullptr||member->methods.size()==0) return nullptr;
+        return deductMethod(env,member,types,arguments);
     }
     const Member* findMockMember(TJNIEnv *env, const String &name, bool getter);
 
@@ -16,7 +16,7 @@ struct Info{
     Destroyer destroyer;
 };
 
-static SpinLock mutex;
+static AdaptiveLock mutex;
 static volatile bool loggerRunning = false;//avoid bug in loop
 static struct pollfd fds[2]{
         {0, POLLIN, 0},
@@ -120,4 +120,8 @@ void dropLogger(intptr_t id) {
             info.destroyer(info.arg);
     }
 
-}
\ No newline at end of file
+}
+
+LockStats loggerLockStats() {
+    return mutex.getStats();
+}
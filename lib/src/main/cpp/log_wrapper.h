@@ -7,6 +7,7 @@
 
 #include <jni.h>
 #include <stdlib.h>
+#include "SpinLock.h"
 
 typedef void(*LoggerCallback)(JNIEnv* env,const char *, bool,void* arg);
 typedef void(*Destroyer)(void*);
@@ -14,4 +15,6 @@ intptr_t requireLogger(LoggerCallback callback, void *arg, Destroyer destroyer);
 
 void dropLogger(intptr_t id);
 
+LockStats loggerLockStats();
+
 #endif //LUADROID_LOGGERWRAPPER_H
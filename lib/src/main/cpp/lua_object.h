@@ -26,7 +26,9 @@ enum LUA_TYPE {
 enum EXTRA_LUA_TYPE{
     T_LIGHT_USER_DATA=T_TABLE+1,
     T_USER_DATA,
-    T_JAVA_TYPE
+    T_JAVA_TYPE,
+    T_SHARED_TABLE,
+    T_CHANNEL
 };
 
 class FuncInfo;
@@ -101,6 +103,7 @@ class LuaTable {
     bool isDeleting= false;
 public:
     LuaTable *metaTable = nullptr;
+    bool inArena = false;
 
     Table &get() {
         return table;
@@ -110,7 +113,8 @@ public:
         if(isDeleting)
             return;
         isDeleting = true;
-        delete this;
+        if (inArena) this->~LuaTable();
+        else delete this;
     }
 
     ~LuaTable(){
@@ -130,12 +134,22 @@ class LazyTable {
     const int index;
     lua_State *const L;
     LuaTable<ValidLuaObject> *table = nullptr;
+    const bool inArena;
 public:
-    LazyTable(int index, lua_State *L) : index(index > 0 ? index : lua_gettop(L) + index + 1),
-                                         L(L) {}
+    LazyTable(int index, lua_State *L, bool inArena = false) : index(index > 0 ? index : lua_gettop(L) + index + 1),
+                                                               L(L), inArena(inArena) {}
+
+    void release() {
+        if (inArena) this->~LazyTable();
+        else delete this;
+    }
 
     LuaTable<ValidLuaObject> *getTable(ThreadContext *context);
 
+    //flat tables straight to arrays,lists and maps,INVALID_OBJECT if the generic conversion is needed.
+    //nullptr with the java exception set pending on the context if a java call failed
+    jobject toJavaDirect(ThreadContext *context, JavaType *type, jobject realType);
+
     jobject asInterface(ThreadContext *context, JavaType *type);
 
     bool isInterface() {
@@ -161,10 +175,14 @@ ValidLuaObject::~ValidLuaObject() {
     if (type == T_FUNCTION){
         delete func;
     } else if (type == T_TABLE){
-        delete lazyTable;
+        lazyTable->release();
     }
 }
 class UserData;
+class SharedTable;
+class Channel;
+void releaseSharedTable(SharedTable *table);
+void releaseChannel(Channel *channel);
 struct CrossThreadLuaObject {
     int type = T_NIL;
     union {
@@ -178,6 +196,8 @@ struct CrossThreadLuaObject {
         void *lightData;
         UserData *userData;
         JavaType* javaType;
+        SharedTable* sharedTable;
+        Channel* channel;
     };
 
     CrossThreadLuaObject()= default;
@@ -236,6 +256,10 @@ inline CrossThreadLuaObject::~CrossThreadLuaObject() {
         table->free();
     } else if (type == T_USER_DATA) {
         userData->free();
+    } else if (type == T_SHARED_TABLE) {
+        releaseSharedTable(sharedTable);
+    } else if (type == T_CHANNEL) {
+        releaseChannel(channel);
     }
 }
 #endif //LUADROID_LUAOBJECT_H
@@ -9,6 +9,15 @@
 #include "log_wrapper.h"
 #include "lfs.h"
 #include "FakeVector.h"
+#include "SharedTable.h"
+#include "Channel.h"
+#include "ScriptExecutor.h"
+#if LUA_VERSION_NUM >= 503
+#include "CodeCache.h"
+#endif
+#ifdef LOCAL_FRAME_STATS
+#include "LocalRefStats.h"
+#endif
 #include <unistd.h>
 #include <cstdlib>
 #include <cstring>
@@ -17,6 +26,7 @@
 #include <cassert>
 #include <dlfcn.h>
 #include <cctype>
+#include <cerrno>
 
 #if LUA_VERSION_NUM < 503
 #include "int64_support.h"
@@ -79,6 +89,22 @@ static int javaPut(lua_State *L);
 
 static int javaGet(lua_State *L);
 
+static int javaStats(lua_State *L);
+
+static int javaPreload(lua_State *L);
+
+static int javaToTable(lua_State *L);
+
+static int javaFill(lua_State *L);
+
+static int javaView(lua_State *L);
+
+static int javaFreeze(lua_State *L);
+
+static int javaChannel(lua_State *L);
+
+static int javaSelect(lua_State *L);
+
 static int concatString(lua_State *L);
 
 static int objectEquals(lua_State *L);
@@ -111,6 +137,10 @@ static bool parseLuaObject(lua_State *L, ThreadContext *context, int idx,
 static bool parseCrossThreadLuaObject(lua_State *L, ThreadContext *infcontext, int idx,
                                       CrossThreadLuaObject &luaObject);
 
+static void pushSharedTable(lua_State *L, ThreadContext *context, SharedTable *table);
+
+static void pushChannel(lua_State *L, ThreadContext *context, Channel *channel);
+
 static bool pushLuaObject(TJNIEnv *env, lua_State *L, ThreadContext *context,
                           const CrossThreadLuaObject &luaObject);
 
@@ -152,6 +182,20 @@ void nativeFlushLog(TJNIEnv *, jclass);
 void nativeClose(JNIEnv *env, jclass thisClass, jlong ptr);
 void referFunc(JNIEnv *env, jclass thisClass, jlong ptr, jboolean deRefer);
 jint getClassType(TJNIEnv * env, jclass, jlong ptr,jclass clz);
+void setObjectLimit(JNIEnv *, jclass, jlong ptr, jint limit);
+void setIdentityCache(JNIEnv *, jclass, jlong ptr, jboolean enabled);
+void setGenerationalGC(JNIEnv *, jclass, jlong ptr, jboolean enabled);
+void setMemoryLimit(JNIEnv *, jclass, jlong ptr, jlong limit);
+void setTemporaryArena(JNIEnv *, jclass, jlong ptr, jboolean enabled);
+void setDirectTables(JNIEnv *, jclass, jlong ptr, jboolean enabled);
+jlongArray getLockStats(TJNIEnv *env, jclass, jlong ptr);
+void preloadClasses(TJNIEnv *env, jclass, jlong ptr, jobjectArray classes);
+jlong startExecutor(TJNIEnv *env, jclass, jlong ptr, jint threads);
+jboolean submitTask(TJNIEnv *env, jclass, jlong ptr, jobject script, jobjectArray args, jobject future);
+jboolean shutdownExecutor(TJNIEnv *env, jclass, jlong ptr);
+jboolean setCodeCache(TJNIEnv *env, jclass, jlong ptr, jstring dir, jboolean strip);
+jlong compileBuffer(TJNIEnv *env, jclass, jlong ptr, jobject buffer);
+jlong compileFd(TJNIEnv *env, jclass, jlong ptr, jint fd, jlong offset, jlong length);
 jboolean sameSigMethod(JNIEnv* env,jclass,jobject f,jobject s,jobject caller);
 void addJavaObject(TJNIEnv *env, jclass thisClass, jlong ptr, jstring _name, jobject obj,
                    jboolean local);
@@ -165,6 +209,12 @@ jobject constructChild(TJNIEnv *env, jclass thisClass, jlong ptr, jclass target,
 jobject invokeSuper(TJNIEnv* env,jclass c,jobject thiz,jobject method,jint id,jobjectArray args);
 jobject invokeLuaFunction(TJNIEnv *env, jclass thisClass, jlong ptr, jlong funcRef, jboolean multiRet, jobject proxy,
                           jstring methodName, jintArray argTypes, jobjectArray args);
+
+jlong invokeLuaDirect(TJNIEnv *env, jclass, jlong ptr, jlong funcRef, jobject proxy, jstring methodName,
+                      jintArray argTypes, jlongArray args, jobjectArray objectArgs, jint returnType);
+
+jobject invokeLuaDirectObject(TJNIEnv *env, jclass, jlong ptr, jlong funcRef, jobject proxy, jstring methodName,
+                              jintArray argTypes, jlongArray args, jobjectArray objectArgs);
 }
 
 static const luaL_Reg javaInterfaces[] =
@@ -185,6 +235,14 @@ static const luaL_Reg javaInterfaces[] =
          {"unbox",      javaUnBox},
          {"super",javaSuper},
          {"typeof",javaTypeOf},
+         {"stats",javaStats},
+         {"toTable",javaToTable},
+         {"fill",javaFill},
+         {"view",javaView},
+         {"preload",javaPreload},
+         {"freeze",javaFreeze},
+         {"channel",javaChannel},
+         {"select",javaSelect},
          {nullptr,      nullptr}};
 
 static const JNINativeMethod nativeMethods[] =
@@ -195,6 +253,8 @@ static const JNINativeMethod nativeMethods[] =
                                        "Lcom/oslorde/luadroid/Logger;)V", (void *) registerLogger},
          {"nativeFlushLog","()V",(void*) nativeFlushLog},
          {"compile",           "(JLjava/lang/String;Z)J",          (void *) compile},
+         {"compileBuffer",     "(JLjava/nio/ByteBuffer;)J",        (void *) compileBuffer},
+         {"compileFd",         "(JIJJ)J",                          (void *) compileFd},
          {"runScript",         "(JLjava/lang/Object;Z"
                                        "[Ljava/lang/Object;"
                                        ")[Ljava/lang/Object;",     (void *) runScript},
@@ -208,11 +268,29 @@ static const JNINativeMethod nativeMethods[] =
                                        "Ljava/lang/Object;",       (void *) constructChild},
          {"referFunc",       "(JZ)V",                             (void *) referFunc},
          {"getClassType",      "(JLjava/lang/Class;)I",            (void *) getClassType},
+         {"setObjectLimit",    "(JI)V",                            (void *) setObjectLimit},
+         {"setIdentityCache",  "(JZ)V",                            (void *) setIdentityCache},
+         {"setGenerationalGC", "(JZ)V",                            (void *) setGenerationalGC},
+         {"setMemoryLimit",    "(JJ)V",                            (void *) setMemoryLimit},
+         {"setTemporaryArena", "(JZ)V",                            (void *) setTemporaryArena},
+         {"setDirectTables",   "(JZ)V",                            (void *) setDirectTables},
+         {"getLockStats",      "(J)[J",                            (void *) getLockStats},
+         {"preloadClasses",    "(J[Ljava/lang/Class;)V",           (void *) preloadClasses},
+         {"startExecutor",     "(JI)J",                            (void *) startExecutor},
+         {"submitTask",        "(JLjava/lang/Object;[Ljava/lang/Object;"
+                                       "Ljava/lang/Object;)Z",     (void *) submitTask},
+         {"shutdownExecutor",  "(J)Z",                             (void *) shutdownExecutor},
+         {"setCodeCache",      "(JLjava/lang/String;Z)Z",           (void *) setCodeCache},
          {"sameSigMethod","(Ljava/lang/reflect/Method;Ljava/lang/reflect/Method;Ljava/lang/reflect/Method;)Z",(void *)sameSigMethod},
          {"invokeSuper","(Ljava/lang/Object;Ljava/lang/reflect/Method;I[Ljava/lang/Object;)Ljava/lang/Object;",(void*)invokeSuper},
          {"invokeLuaFunction", "(JJZLjava/lang/Object;Ljava/lang/String;"
                                        "[I[Ljava/lang/Object;)"
-                                       "Ljava/lang/Object;", (void *) invokeLuaFunction}};
+                                       "Ljava/lang/Object;", (void *) invokeLuaFunction},
+         {"invokeLuaDirect",   "(JJLjava/lang/Object;Ljava/lang/String;"
+                                       "[I[J[Ljava/lang/Object;I)J", (void *) invokeLuaDirect},
+         {"invokeLuaDirectObject", "(JJLjava/lang/Object;Ljava/lang/String;"
+                                       "[I[J[Ljava/lang/Object;)"
+                                       "Ljava/lang/Object;", (void *) invokeLuaDirectObject}};
 
 JavaVM *vm;
 jclass stringType;
@@ -220,6 +298,7 @@ jclass classType;
 jclass throwableType;
 jclass contextClass;
 jclass loaderClass;
+jclass byteBufferType;
 jmethodID objectHash;
 jmethodID classGetName;
 jmethodID objectToString;
@@ -233,6 +312,13 @@ class RegisterKey{};
 static const RegisterKey* OBJECT_KEY= reinterpret_cast<const RegisterKey *>(javaInterfaces);
 static const RegisterKey* TYPE_KEY=OBJECT_KEY+1;
 static const RegisterKey* MEMBER_KEY=OBJECT_KEY+2;
+static const RegisterKey* FUNC_CACHE_KEY=OBJECT_KEY+3;
+static const RegisterKey* VIEW_KEY=OBJECT_KEY+4;
+static const RegisterKey* SHARED_KEY=OBJECT_KEY+5;
+static const RegisterKey* SHARED_CACHE_KEY=OBJECT_KEY+6;
+static const RegisterKey* CHANNEL_KEY=OBJECT_KEY+7;
+static const RegisterKey* IDENTITY_KEY=OBJECT_KEY+8;
+static const RegisterKey* RECENT_KEY=OBJECT_KEY+9;//RECENT_COUNT keys from it in the identity table
 
 
 #if  LUA_VERSION_NUM == 502
@@ -345,6 +431,7 @@ static inline size_t lua_rawlen(lua_State*L,int index){
 }
 #define lua_setuservalue lua_setfenv
 #define lua_getuservalue lua_getfenv
+#define lua_pushglobaltable(L) lua_pushvalue(L,LUA_GLOBALSINDEX)
 
 #if LUAJIT_VERSION_NUM<20100 //beta3 only
 
@@ -454,6 +541,8 @@ static bool newMetaTable(lua_State*L,const RegisterKey* key,const char* tname){
 }
 static int safeGC(lua_State*L){
     lua_gc(L, LUA_GCCOLLECT, 0);
+    if (LuaHeap *heap = LuaHeap::of(L))
+        heap->trim();
     return 1;
 }
 
@@ -463,31 +552,186 @@ static inline void luaFullGC(lua_State *L) {
     } while(lua_pcall(L,0,0,0)!=LUA_OK);
 }
 
-static void pushJavaObject(lua_State *L, TJNIEnv *env, ScriptContext *context, jobject obj, JavaType *given) {
+static int safeGCStep(lua_State*L){
+    lua_gc(L, LUA_GCSTEP, (int) lua_tointeger(L, 1));
+    return 0;
+}
+
+static inline void luaGCStep(lua_State *L, int debtKB) {
+    lua_pushcfunction(L,safeGCStep);
+    lua_pushinteger(L,debtKB);
+    if(lua_pcall(L,1,0,0)!=LUA_OK)
+        lua_pop(L,1);
+}
+
+//weak valued table of identity hash to userdata,a colliding object just takes the slot
+static void pushIdentityTable(lua_State *L) {
+    lua_rawgetp(L, LUA_REGISTRYINDEX, IDENTITY_KEY);
+    if (!lua_isnil(L, -1)) return;
+    lua_pop(L, 1);
+    lua_newtable(L);
+    lua_createtable(L, 0, 1);
+    lua_pushstring(L, "v");
+    lua_setfield(L, -2, "__mode");
+    lua_setmetatable(L, -2);
+    lua_pushvalue(L, -1);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, IDENTITY_KEY);
+}
+
+static jint identityHashOf(TJNIEnv *env, jobject obj) {
+    static jclass systemType = (jclass) env->NewGlobalRef(env->FindClass("java/lang/System"));
+    static jmethodID identityHashCode = env->GetStaticMethodID(systemType, "identityHashCode",
+                                                               "(Ljava/lang/Object;)I");
+    return env->CallStaticIntMethod(systemType, identityHashCode, obj);
+}
+
+#define RECENT_COUNT 4
+
+static inline bool isCachedObject(TJNIEnv *env, JavaObject *cached, jobject obj, JavaType *given) {
+    return cached != nullptr && (given == nullptr || cached->type == given) && env->IsSameObject(cached->object, obj);
+}
+
+//the userdata on the top takes the next recent slot of the identity table below it
+static void setRecentObject(lua_State *L) {
+    static __thread int next = 0;
+    lua_pushvalue(L, -1);
+    lua_rawsetp(L, -3, RECENT_KEY + (next++ & (RECENT_COUNT - 1)));
+}
+
+//returns false if the userdata already made for the object is pushed
+static bool pushJavaObject(lua_State *L, TJNIEnv *env, ScriptContext *context, jobject obj, JavaType *given) {
 #ifndef NDEBUG
     if(obj== nullptr){
         LOGE("Error put object");
-        return ;
+        return false;
     }
 #endif
+    //only objects pushed with their own class are cached,so a hit needs no type lookup
+    bool identityCache = context->identityCache;
+    jint hash = 0;
+    if (identityCache) {
+        pushIdentityTable(L);
+        //the recently pushed ones are compared first to save the identityHashCode upcall
+        for (int i = 0; i < RECENT_COUNT; ++i) {
+            lua_rawgetp(L, -1, RECENT_KEY + i);
+            if (isCachedObject(env, (JavaObject *) lua_touserdata(L, -1), obj, given)) {
+                lua_remove(L, -2);
+                at_counter_inc(&context->identityHits);
+                return false;
+            }
+            lua_pop(L, 1);
+        }
+        hash = identityHashOf(env, obj);
+        lua_rawgeti(L, -1, hash);
+        if (isCachedObject(env, (JavaObject *) lua_touserdata(L, -1), obj, given)) {
+            setRecentObject(L);
+            lua_remove(L, -2);
+            at_counter_inc(&context->identityHits);
+            return false;
+        }
+        lua_pop(L, 1);
+        at_counter_inc(&context->identityMisses);
+    }
+    JavaType *type = given?given:context->ensureType(env, (JClass) env->GetObjectClass(obj));
     auto *objectRef = (JavaObject *) lua_newuserdata(L, sizeof(JavaObject));
     objectRef->object = env->NewGlobalRef(obj);
-    objectRef->type = given?given:context->ensureType(env, (JClass) env->GetObjectClass(obj));
+    objectRef->type = type;
     setMetaTable(L, OBJECT_KEY);
+    at_counter_inc(&context->liveObjects);
+    if (identityCache) {
+        if (given == nullptr) {
+            lua_pushvalue(L, -1);
+            lua_rawseti(L, -3, hash);
+            setRecentObject(L);
+        }
+        lua_remove(L, -2);
+    }
+    return true;
 }
 
-static inline  void pushJavaObject(lua_State *L, ThreadContext *context, jobject obj,JavaType* given= nullptr){
+#define GC_STEP_INTERVAL 64
+//Every userdata holds a global ref which is much more expensive than its lua memory,
+//so add a debt proportional to the refs alive to make the collector keep up with them.
+static inline bool hasObjectRoom(ScriptContext *scriptContext, uintptr_t count) {
+    uintptr_t live = at_counter_get(&scriptContext->liveObjects);
+    return live <= scriptContext->objectLimit && scriptContext->objectLimit - live >= count;
+}
 
-    if(((++context->pushedCount)&0x1FF)==0){// multi of 512
+//collects until count more java objects fit in the limit,false if they still don't
+static bool reserveJavaObjects(lua_State *L, ScriptContext *scriptContext, uintptr_t count) {
+    if (likely(hasObjectRoom(scriptContext, count))) return true;
+    //most of the userdata are young,so a minor collection is tried first
+    if (scriptContext->generationalGC)
+        luaGCStep(L, 0);
+    if (!hasObjectRoom(scriptContext, count))
         luaFullGC(L);
+    return hasObjectRoom(scriptContext, count);
+}
+
+//pushes from outside a protected call pass checkLimit=false after reserveJavaObjects,
+//the limit error can only be raised inside one
+static inline  void pushJavaObject(lua_State *L, ThreadContext *context, jobject obj,JavaType* given= nullptr,
+                                   bool checkLimit = true){
+    ScriptContext *scriptContext = context->scriptContext;
+    if (checkLimit && unlikely(!reserveJavaObjects(L, scriptContext, 1)))
+        ERROR("Too many java objects alive:%d, limit=%d", (int) at_counter_get(&scriptContext->liveObjects),
+              (int) scriptContext->objectLimit);
+    ++context->pushedCount;
+    if (++context->pushedSinceStep == GC_STEP_INTERVAL) {
+        context->pushedSinceStep = 0;
+        if (context->pushedCount > GC_STEP_INTERVAL)
+            luaGCStep(L, context->pushedCount / GC_STEP_INTERVAL);
+        //a thread that seldom calls lua from java still drops what was evicted
+        if (unlikely(context->evictVersion != at_counter_get(&scriptContext->evictVersion)))
+            scriptContext->dropEvictedFunctions(L, context);
+    }
+    //a cached userdata holds no new global ref
+    if (!pushJavaObject(L, context->env, scriptContext, obj,given))
+        --context->pushedCount;
+}
+
+//Local refs made by a bridge call are dropped when it returns,
+//so a long loop in one script doesn't fill the local ref table
+class LocalFrame {
+    ThreadContext *const context;
+#ifdef LOCAL_FRAME_STATS
+    LocalFrameSite &site;
+    const int capacity;
+    int start = 0;
+    int outerPeak = 0;
+#endif
+public:
+#ifdef LOCAL_FRAME_STATS
+    LocalFrame(ThreadContext *context, int capacity, LocalFrameSite &site) : context(context), site(site),
+                                                                            capacity(capacity) {
+        if (!context->pushLocalFrame(this, capacity)) return;
+        start = LocalRefStats::counts.live;
+        outerPeak = LocalRefStats::counts.peak;
+        LocalRefStats::counts.peak = start;
+    }
+#else
+    LocalFrame(ThreadContext *context, int capacity) : context(context) {
+        context->pushLocalFrame(this, capacity);
     }
+#endif
 
-    if(context->pushedCount>>13){//>=8192
-        lua_pushnil(L);
-        return;
+    LocalFrame(const LocalFrame &) = delete;
+
+    ~LocalFrame() {
+#ifdef LOCAL_FRAME_STATS
+        site.record(capacity, LocalRefStats::counts.peak - start);
+        LocalRefStats::counts.peak = max(outerPeak, LocalRefStats::counts.peak);
+#endif
+        context->popLocalFrames(this);
     }
-    pushJavaObject(L, context->env, context->scriptContext, obj,given);
-}
+};
+
+#ifdef LOCAL_FRAME_STATS
+#define LOCAL_FRAME(context, capacity) static LocalFrameSite localFrameSite(__func__);\
+    LocalFrame localFrame(context, capacity, localFrameSite)
+#else
+#define LOCAL_FRAME(context, capacity) LocalFrame localFrame(context, capacity)
+#endif
 
 static void appendInt(String& str,int i){
     char tmp[8];
@@ -643,11 +887,261 @@ static int luaPanic(lua_State *L) {
     return 0;
 }
 
+#if LUA_VERSION_NUM >= 503
+//opened on first access from the global table,or by require through package.preload
+static const luaL_Reg lazyLibs[] =
+        {{LUA_COLIBNAME,   luaopen_coroutine},
+         {LUA_TABLIBNAME,  luaopen_table},
+         {LUA_IOLIBNAME,   luaopen_io},
+         {LUA_OSLIBNAME,   luaopen_os},
+         {LUA_MATHLIBNAME, luaopen_math},
+         {LUA_UTF8LIBNAME, luaopen_utf8},
+         {LUA_DBLIBNAME,   luaopen_debug},
+#if defined(LUA_COMPAT_BITLIB)
+         {LUA_BITLIBNAME,  luaopen_bit32},
+#endif
+         {LFS_LIBNAME,     luaopen_lfs},
+         {nullptr,         nullptr}};
+#endif
+
+#define LAZY_ADDED 0 //other kinds are the lazyLibs index+1 and -(javaInterfaces index+1)
+//a name resolved or assigned by the script is set to false,so os=nil stays nil
+
+static inline void dropLazyName(lua_State *L, int nameIndex, int keyIndex) {
+    lua_pushvalue(L, keyIndex);
+    lua_pushboolean(L, 0);
+    lua_rawset(L, nameIndex);
+}
+
+//upvalues: context,the name table,the addedVersion the added names were loaded at
+static int getLazyGlobal(lua_State *L) {
+    if (lua_type(L, 2) != LUA_TSTRING) return 0;
+    ScriptContext *scriptContext = getContext(L)->scriptContext;
+    //most misses are plain nil globals,rejected here without a lock or an allocation
+    lua_pushvalue(L, 2);
+    lua_rawget(L, lua_upvalueindex(2));
+    if (lua_isnil(L, -1)) {
+        uintptr_t version = at_counter_get(&scriptContext->addedVersion);
+        if (lua_Integer(version) == lua_tointeger(L, lua_upvalueindex(3)))
+            return 0;
+        lua_pop(L, 1);
+        scriptContext->loadAddedNames(L, lua_upvalueindex(2));
+        lua_pushinteger(L, lua_Integer(version));
+        lua_replace(L, lua_upvalueindex(3));
+        lua_pushvalue(L, 2);
+        lua_rawget(L, lua_upvalueindex(2));
+    }
+    if (lua_type(L, -1) != LUA_TNUMBER) return 0;
+    int kind = (int) lua_tointeger(L, -1);
+    lua_pop(L, 1);
+    if (scriptContext->pushLazyGlobal(L, lua_tostring(L, 2), kind)) {
+        dropLazyName(L, lua_upvalueindex(2), 2);
+        return 1;
+    }
+    //removed since,added again only with a new version
+    lua_pushvalue(L, 2);
+    lua_pushnil(L);
+    lua_rawset(L, lua_upvalueindex(2));
+    return 0;
+}
+
+//upvalues: the name table
+static int setLazyGlobal(lua_State *L) {
+    lua_settop(L, 3);
+    if (lua_type(L, 2) == LUA_TSTRING) {
+        lua_pushvalue(L, 2);
+        lua_rawget(L, lua_upvalueindex(1));
+        if (!lua_isnil(L, -1))
+            dropLazyName(L, lua_upvalueindex(1), 2);
+        lua_pop(L, 1);
+    }
+    lua_rawset(L, 1);
+    return 0;
+}
+
+static void pushLazyNames(lua_State *L, bool importAll) {
+    lua_newtable(L);
+#if LUA_VERSION_NUM >= 503
+    for (int i = 0; lazyLibs[i].name != nullptr; ++i) {
+        lua_pushinteger(L, i + 1);
+        lua_setfield(L, -2, lazyLibs[i].name);
+    }
+#endif
+    if (!importAll) return;
+    for (int i = 0; javaInterfaces[i].name != nullptr; ++i) {
+        lua_pushinteger(L, -(i + 1));
+        lua_setfield(L, -2, javaInterfaces[i].name);
+        if (javaInterfaces[i].func == javaType) {
+            lua_pushinteger(L, -(i + 1));
+            lua_setfield(L, -2, "class");
+            lua_pushinteger(L, -(i + 1));
+            lua_setfield(L, -2, "Type");
+        }
+    }
+}
+
+//the hook metatable stays invisible to scripts:getmetatable(_G) gives nil and
+//setmetatable(_G,mt) opens every lazy global before mt replaces it.
+//debug.getmetatable and debug.setmetatable bypass both
+static int getGlobalMetatable(lua_State *L) {
+    lua_pushvalue(L, lua_upvalueindex(2));
+    lua_insert(L, 1);
+    lua_call(L, lua_gettop(L) - 1, 1);
+    if (lua_rawequal(L, -1, lua_upvalueindex(3)))
+        lua_pushnil(L);
+    return 1;
+}
+
+//upvalues: context,the original setmetatable,the hook,the name table
+static int setGlobalMetatable(lua_State *L) {
+    if (lua_getmetatable(L, 1)) {
+        if (lua_rawequal(L, -1, lua_upvalueindex(3)))
+            getContext(L)->scriptContext->openLazyGlobals(L, lua_upvalueindex(4));
+        lua_pop(L, 1);
+    }
+    lua_pushvalue(L, lua_upvalueindex(2));
+    lua_insert(L, 1);
+    lua_call(L, lua_gettop(L) - 1, LUA_MULTRET);
+    return lua_gettop(L);
+}
+
+//pairs(_G) sees the lazy globals too
+//upvalues: context,next,the name table
+static int pairLazyGlobals(lua_State *L) {
+    getContext(L)->scriptContext->openLazyGlobals(L, lua_upvalueindex(3));
+    lua_pushvalue(L, lua_upvalueindex(2));
+    lua_pushvalue(L, 1);
+    lua_pushnil(L);
+    return 3;
+}
+
+//so does next(_G) from the start of a traversal
+//upvalues: context,the original next,the name table
+static int nextGlobal(lua_State *L) {
+    if (lua_isnoneornil(L, 2)) {
+        lua_pushglobaltable(L);
+        if (lua_rawequal(L, 1, -1))
+            getContext(L)->scriptContext->openLazyGlobals(L, lua_upvalueindex(3));
+        lua_pop(L, 1);
+    }
+    lua_pushvalue(L, lua_upvalueindex(2));
+    lua_insert(L, 1);
+    lua_call(L, lua_gettop(L) - 1, LUA_MULTRET);
+    return lua_gettop(L);
+}
+
+//and rawget(_G,name) resolves a lazy global like a plain access
+//upvalues: the original rawget,the __index hook
+static int rawGetGlobal(lua_State *L) {
+    lua_settop(L, 2);
+    lua_pushvalue(L, lua_upvalueindex(1));
+    lua_pushvalue(L, 1);
+    lua_pushvalue(L, 2);
+    lua_call(L, 2, 1);
+    if (!lua_isnil(L, -1)) return 1;
+    lua_pushglobaltable(L);
+    if (!lua_rawequal(L, 1, -1)) {
+        lua_pop(L, 1);
+        return 1;
+    }
+    lua_settop(L, 2);
+    lua_pushvalue(L, lua_upvalueindex(2));
+    lua_insert(L, 1);
+    lua_call(L, 2, 1);
+    return 1;
+}
+
+//resolved in the priority the globals used to be set by config
+bool ScriptContext::pushLazyGlobal(lua_State *L, const char *name, int kind) {
+#if LUA_VERSION_NUM >= 503
+    if (kind > 0) {
+        luaL_requiref(L, name, lazyLibs[kind - 1].func, true);
+        return true;
+    }
+#endif
+    ThreadContext *context = getThreadContext();
+    if (kind == LAZY_ADDED) {
+        bool added;
+        AddInfo info;
+        {
+            ScopeLock sentry(addLock);
+            auto &&iter = addedMap.find(String(name));
+            added = iter != addedMap.end();
+            if (added) info = iter->second;
+        }
+        if (added) {
+            pushAddedObject(context->env, L, name, info);
+            lua_pushglobaltable(L);
+            lua_pushstring(L, name);
+            lua_rawget(L, -2);
+            lua_remove(L, -2);
+            return true;
+        }
+        //an added object may have hidden a java function
+        if (!importAll) return false;
+        kind = 0;
+        for (int i = 0; javaInterfaces[i].name != nullptr; ++i) {
+            if (strcmp(name, javaInterfaces[i].name) == 0) {
+                kind = -(i + 1);
+                break;
+            }
+        }
+        if (kind == 0) return false;
+    }
+    lua_pushlightuserdata(L, context);
+    lua_pushcclosure(L, javaInterfaces[-kind - 1].func, 1);
+    lua_pushvalue(L, -1);
+    lua_setglobal(L, name);
+    return true;
+}
+
+//added names outrank the java functions but not the libraries
+void ScriptContext::loadAddedNames(lua_State *L, int nameIndex) {
+    nameIndex = lua_absindex(L, nameIndex);
+    ScopeLock sentry(addLock);
+    for (auto &&pair:addedMap) {
+        lua_pushstring(L, pair.first.data());
+        lua_pushvalue(L, -1);
+        lua_rawget(L, nameIndex);
+        if (lua_isnil(L, -1) || (lua_type(L, -1) == LUA_TNUMBER && lua_tointeger(L, -1) < 0)) {
+            lua_pop(L, 1);
+            lua_pushinteger(L, LAZY_ADDED);
+            lua_rawset(L, nameIndex);
+        } else lua_pop(L, 2);
+    }
+}
+
+//sets every global the hook would still resolve,for the code that needs the complete table
+void ScriptContext::openLazyGlobals(lua_State *L, int nameIndex) {
+    int top = lua_gettop(L);
+    nameIndex = lua_absindex(L, nameIndex);
+    loadAddedNames(L, nameIndex);
+    lua_pushnil(L);
+    while (lua_next(L, nameIndex)) {
+        if (lua_type(L, -1) == LUA_TNUMBER) {
+            int kind = (int) lua_tointeger(L, -1);
+            if (pushLazyGlobal(L, lua_tostring(L, -2), kind)) {
+                lua_pop(L, 1);
+                //only an existing field is changed,so the traversal goes on
+                dropLazyName(L, nameIndex, -2);
+            }
+        }
+        lua_pop(L, 1);
+    }
+    lua_settop(L, top);
+}
 
 void ScriptContext::config(lua_State *L) {
     lua_atpanic(L, luaPanic);
+#ifdef LUA_GCGEN
+    if (generationalGC)
+        lua_gc(L, LUA_GCGEN, 0);
+#endif
     ThreadContext* context=getThreadContext();
     if(!context->env) context->env=AutoJNIEnv();
+#ifdef LOCAL_FRAME_STATS
+    LocalRefStats::install(context->env);
+#endif
     lua_pushlightuserdata(L, context);//for panic and clean
     lua_setfield(L, LUA_REGISTRYINDEX, JAVA_CONTEXT);
     int top = lua_gettop(L);
@@ -655,19 +1149,6 @@ void ScriptContext::config(lua_State *L) {
 #if LUA_VERSION_NUM < 503
     luaL_requiref(L, Integer64::LIB_NAME, Integer64::RegisterTo,/*glb*/true);
 #endif
-    if (importAll) {
-        const luaL_Reg *l = javaInterfaces;
-        for (; l->name != nullptr; l++) {
-            lua_pushlightuserdata(L,context);
-            lua_pushcclosure(L, l->func,1);
-            lua_setglobal(L, l->name);
-        }
-        lua_pushlightuserdata(L,context);
-        lua_pushcclosure(L, javaType,1);
-        lua_pushvalue(L,-1);
-        lua_setglobal(L, "class");
-        lua_setglobal(L, "Type");
-    }
     {
         *(ThreadContext**)lua_newuserdata(L, sizeof(void*))=context;
         lua_createtable(L,0,3);
@@ -732,12 +1213,63 @@ void ScriptContext::config(lua_State *L) {
         lua_pushcclosure(L, JavaObject::objectGc,1);
         lua_setfield(L, index, "__gc");
     }
-    for (auto &pair:addedMap) {
-        pushAddedObject(context->env, L, pair.first.data(), pair.second);
+#if LUA_VERSION_NUM >= 503
+    luaL_requiref(L, "_G", luaopen_base, true);
+    luaL_requiref(L, LUA_LOADLIBNAME, luaopen_package, true);
+    luaL_requiref(L, LUA_STRLIBNAME, luaopen_string, true);
+    luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_PRELOAD_TABLE);
+    for (const luaL_Reg *l = lazyLibs; l->name != nullptr; l++) {
+        lua_pushcfunction(L, l->func);
+        lua_setfield(L, -2, l->name);
     }
-
+#else
     luaL_openlibs(L);
     luaL_requiref(L,LFS_LIBNAME,luaopen_lfs, true);
+#endif
+    //the other libraries,the short names of java functions and the added objects are set on first access
+    lua_pushglobaltable(L);
+    lua_createtable(L, 0, 3);
+    int hook = lua_gettop(L);
+    //the added names are known up front,so assigning one before its first read drops it too
+    pushLazyNames(L, importAll);
+    int names = hook + 1;
+    uintptr_t version = at_counter_get(&addedVersion);
+    loadAddedNames(L, names);
+    lua_pushlightuserdata(L, context);
+    lua_pushvalue(L, names);
+    lua_pushinteger(L, lua_Integer(version));
+    lua_pushcclosure(L, getLazyGlobal, 3);
+    lua_setfield(L, hook, "__index");
+    lua_pushvalue(L, names);
+    lua_pushcclosure(L, setLazyGlobal, 1);
+    lua_setfield(L, hook, "__newindex");
+    lua_pushlightuserdata(L, context);
+    lua_getfield(L, hook - 1, "next");
+    lua_pushvalue(L, names);
+    lua_pushcclosure(L, pairLazyGlobals, 3);
+    lua_setfield(L, hook, "__pairs");
+    lua_pushlightuserdata(L, context);
+    lua_getfield(L, hook - 1, "next");
+    lua_pushvalue(L, names);
+    lua_pushcclosure(L, nextGlobal, 3);
+    lua_setfield(L, hook - 1, "next");
+    lua_getfield(L, hook - 1, "rawget");
+    lua_getfield(L, hook, "__index");
+    lua_pushcclosure(L, rawGetGlobal, 2);
+    lua_setfield(L, hook - 1, "rawget");
+    lua_pushlightuserdata(L, context);
+    lua_getfield(L, hook - 1, "getmetatable");
+    lua_pushvalue(L, hook);
+    lua_pushcclosure(L, getGlobalMetatable, 3);
+    lua_setfield(L, hook - 1, "getmetatable");
+    lua_pushlightuserdata(L, context);
+    lua_getfield(L, hook - 1, "setmetatable");
+    lua_pushvalue(L, hook);
+    lua_pushvalue(L, names);
+    lua_pushcclosure(L, setGlobalMetatable, 4);
+    lua_setfield(L, hook - 1, "setmetatable");
+    lua_pop(L, 1);
+    lua_setmetatable(L, hook - 1);
 
     const char* loaderName;
 #if LUA_VERSION_NUM>=502
@@ -759,9 +1291,31 @@ int JavaObject::objectGc(lua_State *L) {
     auto ref = (JavaObject *) lua_touserdata(L, -1);
     context->env->DeleteGlobalRef(ref->object);
     context->pushedCount--;
+    if (context->scriptContext != nullptr)
+        at_counter_dec(&context->scriptContext->liveObjects);
     return 0;
 }
 
+bool ThreadContext::pushLocalFrame(const void *owner, int capacity) {
+    popLocalFrames(owner);
+    if (localFrameCount == MAX_LOCAL_FRAMES) return false;
+    if (env->PushLocalFrame(capacity) != JNI_OK) {
+        env->ExceptionClear();
+        return false;
+    }
+    localFrames[localFrameCount++] = owner;
+    return true;
+}
+
+//native stacks grow down,so deeper calls own lower addresses
+void ThreadContext::popLocalFrames(const void *owner) {
+    while (localFrameCount > 0 && localFrames[localFrameCount - 1] <= owner) {
+        --localFrameCount;
+        jobject error = env->PopLocalFrame(pendingJavaError);
+        if (pendingJavaError != nullptr) pendingJavaError = (jthrowable) error;
+    }
+}
+
 ThreadContext::~ThreadContext() {
     if (scriptContext != nullptr) {
         JNIEnv* v;
@@ -770,6 +1324,7 @@ ThreadContext::~ThreadContext() {
             err=vm->AttachCurrentThread(&v, nullptr);
             if(likely(!err)){
                 env=(TJNIEnv*)v;
+                clearStringCache();
                 scriptContext->removeCurrent();
                 scriptContext = nullptr;
                 vm->DetachCurrentThread();
@@ -777,6 +1332,7 @@ ThreadContext::~ThreadContext() {
                 LOGE("Failed to attach at exit=%d",err);
             }
         } else{
+            clearStringCache();
             scriptContext->removeCurrent();
             scriptContext = nullptr;
         }
@@ -784,24 +1340,37 @@ ThreadContext::~ThreadContext() {
     }
 }
 
+static void deleteType(JavaType *type) {
+    delete type;
+}
+
 ScriptContext::~ScriptContext() {
+    {
+        ScopeLock sentry(sContextLock);
+        ScriptContext *self = this;//erase takes an lvalue
+        sContexts.erase(self);
+    }
     AutoJNIEnv env;
     _GCEnv=env;
-    for (auto &&pair :typeMap) {
-        delete pair.second;
-    }
+    typeTable.forEach(deleteType);
     ScopeLock sentry(gcLock);
     for (auto &&pair :stateMap){
         lua_State *L = pair.second;
         lua_getfield(L,LUA_REGISTRYINDEX,JAVA_CONTEXT);
         auto * context=(ThreadContext *)lua_touserdata(L, -1);
         context->scriptContext= nullptr;//to mark it as freed
-        lua_close(L);
+        LuaHeap::closeState(L);
     }
 
     for (auto &&object:addedMap) {
         env->DeleteGlobalRef(object.second.obj);
     }
+    for (auto &&pair:crossThreadMap) {
+        pair.second->release();
+    }
+#if LUA_VERSION_NUM >= 503
+    delete getCodeCache();
+#endif
     env->DeleteWeakGlobalRef(javaRef);
     _GCEnv= nullptr;
 }
@@ -896,7 +1465,8 @@ static bool parseLuaObject(lua_State *L, ThreadContext *context, int idx,
             break;
         case LUA_TTABLE: {
             luaObject.type = T_TABLE;
-            luaObject.lazyTable = new LazyTable(idx, L);
+            void *mem = context->arena.alloc(sizeof(LazyTable));
+            luaObject.lazyTable = mem ? new(mem) LazyTable(idx, L, true) : new LazyTable(idx, L);
             break;
         }
         default:
@@ -1177,8 +1747,8 @@ bool parseCrossThreadLuaObject(lua_State *L, ThreadContext *context, int idx,
             luaObject.type = T_STRING;
             size_t len;
             auto src = lua_tolstring(L, idx, &len);
-            char *dest = new char[len];
-            strcpy(dest, src);
+            char *dest = new char[len + 1];
+            memcpy(dest, src, len + 1);
             luaObject.string = dest;
             break;
         }
@@ -1226,6 +1796,14 @@ bool parseCrossThreadLuaObject(lua_State *L, ThreadContext *context, int idx,
             }else if(testUData(L,idx,TYPE_KEY)){
                 luaObject.type = T_JAVA_TYPE;
                 luaObject.javaType=*(JavaType**) lua_touserdata(L,idx);
+            }else if(testUData(L,idx,SHARED_KEY)){
+                luaObject.type = T_SHARED_TABLE;
+                luaObject.sharedTable=*(SharedTable**) lua_touserdata(L,idx);
+                luaObject.sharedTable->addRef();
+            }else if(testUData(L,idx,CHANNEL_KEY)){
+                luaObject.type = T_CHANNEL;
+                luaObject.channel=*(Channel**) lua_touserdata(L,idx);
+                luaObject.channel->addRef();
             }
 #if LUA_VERSION_NUM < 503
                 else if(luaL_testudata(L,idx,Integer64::LIB_NAME)){
@@ -1431,6 +2009,12 @@ bool pushLuaObject(TJNIEnv *env, lua_State *L, ThreadContext *context,
         case T_JAVA_TYPE:
             pushJavaType(L,luaObject.javaType);
             break;
+        case T_SHARED_TABLE:
+            pushSharedTable(L, context, luaObject.sharedTable);
+            break;
+        case T_CHANNEL:
+            pushChannel(L, context, luaObject.channel);
+            break;
         default:
             return false;
     }
@@ -1497,6 +2081,7 @@ int javaType(lua_State *L) {
 static int proxyByTable(lua_State *L) {
     if (!lua_istable(L, 1)) return 0;
     ThreadContext *context = getContext(L);
+    Arena::Scope scope(context->arena);
     SetErrorJMP();
     Vector<JavaType *> interfaces;
     lua_getfield(L, 1, "super");
@@ -1688,6 +2273,7 @@ int javaProxy(lua_State *L) {
     if (lua_gettop(L) == 1)
         return proxyByTable(L);
     ThreadContext *context = getContext(L);
+    Arena::Scope scope(context->arena);
     JavaType **typeRef;
     JavaType *main;
     JavaObject* superObject;
@@ -1980,6 +2566,7 @@ int javaCharString(lua_State *L) {
 }
 
 static int newArray(lua_State *L, int index, ThreadContext *context, JavaType *type,JavaType* arrayType= nullptr) {
+    Arena::Scope scope(context->arena);
     if (type->isVoid()) {
         ERROR( "Type Error:array for void.class can't be created");
     }
@@ -2078,6 +2665,7 @@ static void unbox(lua_State* L,ThreadContext* context,int index,ValidLuaObject&
 int javaNew(lua_State *L) {
     ThreadContext *context = getContext(L);
     auto env=context->env;
+    Arena::Scope scope(context->arena);
     JavaType* type= nullptr,*component= nullptr;
     if(luaL_isstring(L,1)){
         SetErrorJMP();
@@ -2320,65 +2908,1000 @@ static int javaSuper(lua_State *L){
     return 1;
 }
 
-static int javaNext(lua_State* L){
+static int javaStats(lua_State *L){
     ThreadContext *context = getContext(L);
-    auto * object= static_cast<JavaObject *>(lua_touserdata(L, 1));
-    TJNIEnv *env = context->env;
-    static jmethodID hasNext;
-    static jmethodID nextEntry;
-    if(hasNext== nullptr){
-        JClass type(env->FindClass("com/oslorde/luadroid/MapIterator"));
-        hasNext = env->GetMethodID(type, "hasNext", "()Z");
-        nextEntry = env->GetMethodID(type, "nextEntry", "()[Ljava/lang/Object;");
-    }
-    jboolean hasMore=env->CallBooleanMethod(object->object,hasNext);
-    HOLD_JAVA_EXCEPTION(context,{ throwJavaError(L,context);});
-    if(!hasMore){
-        lua_pushnil(L);
-        return 1;
-    }
-    JObjectArray next(env->CallObjectMethod(object->object,nextEntry));
-    HOLD_JAVA_EXCEPTION(context,{throwJavaError(L, context);});
-    int len=env->GetArrayLength(next);
-    if(len==1){
-        int64_t key=lua_tointeger(L,2);
-        JObject value=env->GetObjectArrayElement(next,0);
-        lua_pushinteger(L,key+1);
-        if(value== nullptr)lua_pushnil(L);
-        else pushJavaObject(L,context,value);
-    } else{
-        JObject key=env->GetObjectArrayElement(next,0);
-        JObject value=env->GetObjectArrayElement(next,1);
-        if(key== nullptr)
-            lua_pushboolean(L,0);
-        else pushJavaObject(L,context,key);
-        if(value== nullptr)lua_pushnil(L);
-        else pushJavaObject(L,context,value);
-    }
-    return 2;
+    ScriptContext *scriptContext = context->scriptContext;
+    lua_createtable(L,0,8);
+    lua_pushinteger(L,at_counter_get(&scriptContext->liveObjects));
+    lua_setfield(L,-2,"liveObjects");
+    lua_pushinteger(L,at_counter_get(&scriptContext->deductCacheHits));
+    lua_setfield(L,-2,"deductCacheHits");
+    lua_pushinteger(L,at_counter_get(&scriptContext->deductCacheMisses));
+    lua_setfield(L,-2,"deductCacheMisses");
+    lua_pushinteger(L,at_counter_get(&scriptContext->identityHits));
+    lua_setfield(L,-2,"identityHits");
+    lua_pushinteger(L,at_counter_get(&scriptContext->identityMisses));
+    lua_setfield(L,-2,"identityMisses");
+    lua_pushinteger(L,context->arena.allocCount);
+    lua_setfield(L,-2,"arenaAllocs");
+    lua_pushinteger(L,context->arena.mallocCount);
+    lua_setfield(L,-2,"arenaMallocs");
+    lua_pushinteger(L,context->arena.fallbackCount);
+    lua_setfield(L,-2,"arenaFallbacks");
+    if (LuaHeap *heap = LuaHeap::of(L)) {
+        lua_createtable(L,0,6);
+        lua_pushinteger(L,heap->bytes);
+        lua_setfield(L,-2,"bytes");
+        lua_pushinteger(L,heap->reserved);
+        lua_setfield(L,-2,"reserved");
+        lua_pushinteger(L,heap->allocs);
+        lua_setfield(L,-2,"allocs");
+        lua_pushinteger(L,heap->frees);
+        lua_setfield(L,-2,"frees");
+        //shared by all the states of the context
+        lua_pushinteger(L,at_counter_get(&scriptContext->heapAccount.reserved));
+        lua_setfield(L,-2,"contextReserved");
+        lua_pushinteger(L,at_counter_get(&scriptContext->heapAccount.limit));
+        lua_setfield(L,-2,"limit");
+        lua_setfield(L,-2,"memory");
+    }
+    LockStats stats[LOCK_COUNT];
+    scriptContext->getLockStats(stats);
+    lua_createtable(L,0,LOCK_COUNT);
+    for (int i = 0; i < LOCK_COUNT; ++i) {
+        lua_createtable(L,0,3);
+        lua_pushinteger(L,stats[i].acquireCount);
+        lua_setfield(L,-2,"acquireCount");
+        lua_pushinteger(L,stats[i].contendedCount);
+        lua_setfield(L,-2,"contendedCount");
+        lua_pushinteger(L,stats[i].waitNanos);
+        lua_setfield(L,-2,"waitNanos");
+        lua_setfield(L,-2,ScriptContext::lockNames[i]);
+    }
+    lua_setfield(L,-2,"locks");
+#ifdef LOCAL_FRAME_STATS
+    lua_newtable(L);
+    for (LocalFrameSite *site = LocalFrameSite::first(); site; site = site->next) {
+        lua_createtable(L,0,3);
+        lua_pushinteger(L,at_int_load(&site->calls));
+        lua_setfield(L,-2,"calls");
+        lua_pushinteger(L,at_int_load(&site->capacity));
+        lua_setfield(L,-2,"capacity");
+        lua_pushinteger(L,at_int_load(&site->peak));
+        lua_setfield(L,-2,"peak");
+        lua_setfield(L,-2,site->name);
+    }
+    lua_setfield(L,-2,"localFrames");
+#endif
+#ifdef LUA_STRTABSTATS
+    lua_StrTabStats strtab;
+    lua_strtabstats(L, &strtab);
+    lua_createtable(L,0,5);
+    lua_pushinteger(L,strtab.size);
+    lua_setfield(L,-2,"size");
+    lua_pushinteger(L,strtab.nuse);
+    lua_setfield(L,-2,"nuse");
+    lua_pushinteger(L,strtab.moving);
+    lua_setfield(L,-2,"moving");
+    lua_pushinteger(L,strtab.maxchain);
+    lua_setfield(L,-2,"maxChain");
+    lua_createtable(L,LUA_STRTABHIST,0);
+    for (int i = 0; i < LUA_STRTABHIST; ++i) {
+        lua_pushinteger(L,strtab.chains[i]);
+        lua_rawseti(L,-2,i+1);
+    }
+    lua_setfield(L,-2,"chains");
+    lua_setfield(L,-2,"stringTable");
+#endif
+#ifdef LUA_GCPAUSESTATS
+    //java.stats(true) also resets the pause counters
+    lua_GCPauseStats gc;
+    lua_gcpausestats(L, &gc, lua_toboolean(L, 1));
+    lua_createtable(L,0,7);
+    lua_pushstring(L,gc.generational?"generational":"incremental");
+    lua_setfield(L,-2,"mode");
+    lua_pushinteger(L,gc.steps);
+    lua_setfield(L,-2,"steps");
+    lua_pushinteger(L,gc.minors);
+    lua_setfield(L,-2,"minors");
+    lua_pushinteger(L,gc.majors);
+    lua_setfield(L,-2,"majors");
+    lua_pushinteger(L,gc.maxpause);
+    lua_setfield(L,-2,"maxPauseUs");
+    lua_pushinteger(L,gc.totalpause);
+    lua_setfield(L,-2,"totalPauseUs");
+    //pauses[i] counts the ones under 16<<(2*(i-1)) us
+    lua_createtable(L,LUA_GCPAUSEHIST,0);
+    for (int i = 0; i < LUA_GCPAUSEHIST; ++i) {
+        lua_pushinteger(L,gc.pauses[i]);
+        lua_rawseti(L,-2,i+1);
+    }
+    lua_setfield(L,-2,"pauses");
+    lua_setfield(L,-2,"gc");
+#endif
+    return 1;
 }
 
-int javaIterate(lua_State* L){
+int javaPreload(lua_State *L){
     ThreadContext *context = getContext(L);
     auto env=context->env;
-    static jmethodID  iterate=env->GetMethodID(contextClass,"iterate","(Ljava/lang/Object;)Lcom/oslorde/luadroid/MapIterator;");
-    JavaObject* object= checkJavaObject(L,1);
-    JObject iterator=env->CallObjectMethod(context->scriptContext->javaRef,iterate,object->object);
-    HOLD_JAVA_EXCEPTION(context,{});
-    if(iterator==nullptr){
-        ERROR("Bad argument for iterator:%s",luaL_tolstring(L,1, nullptr));
+    luaL_checktype(L,1,LUA_TTABLE);
+    bool async=lua_toboolean(L,2)!=0;
+    int len=(int)lua_rawlen(L,1);
+    JObjectArray classes(async?env->NewObjectArray(len,classType, nullptr):JObjectArray(env, nullptr));
+    for (int i = 0; i < len; ++i) {
+        lua_rawgeti(L,1,i+1);
+        JavaType* type;
+        if(luaL_isstring(L,-1)){
+            type=context->ensureType(FakeString(L,-1));
+            if(type== nullptr) ERROR("Type:%s not found",lua_tostring(L,-1));
+        } else type=checkJavaType(L,-1);
+        lua_pop(L,1);
+        if(async) env->SetObjectArrayElement(classes,i,type->getType());
+        else type->preloadMembers(env);
     }
-    lua_pushlightuserdata(L,context);
-    lua_pushcclosure(L,javaNext,1);
-    pushJavaObject(L,context,iterator);
-    lua_pushinteger(L,-1);
-    return 3;
+    if(!async) return 0;
+    static jmethodID preloadAsync=env->GetMethodID(contextClass,"preloadAsync",
+                                                    "([Ljava/lang/Class;)Ljava/lang/Thread;");
+    JObject thread=env->CallObjectMethod(context->scriptContext->javaRef,preloadAsync,classes.get());
+    HOLD_JAVA_EXCEPTION(context,{throwJavaError(L,context);});
+    pushJavaObject(L,context,thread);
+    return 1;
 }
 
-int javaToJavaObject(lua_State *L) {
+#define ARRAY_CHUNK 1024
+#define ForEachPrimitiveArray(Handle)\
+        Handle(BYTE,byte, Byte, Integer)\
+        Handle(SHORT,short, Short, Integer)\
+        Handle(INT,int, Int, Integer)\
+        Handle(LONG,long, Long, Integer)\
+        Handle(FLOAT,float, Float, Number)\
+        Handle(DOUBLE,double, Double, Number)\
+        Handle(BOOLEAN,boolean, Boolean, Boolean)\
+        Handle(CHAR,char, Char, Char)
+
+static inline void pushIntegerElement(lua_State *L, lua_Integer v) {
+    lua_pushinteger(L, v);
+}
+
+static inline void pushNumberElement(lua_State *L, lua_Number v) {
+    lua_pushnumber(L, v);
+}
+
+static inline void pushBooleanElement(lua_State *L, jboolean v) {
+    lua_pushboolean(L, v);
+}
+
+static inline void pushCharElement(lua_State *L, jchar v) {
+    char s[4];
+    strncpy16to8(s, (const char16_t *) &v, 1);
+    lua_pushstring(L, s);
+}
+
+static lua_Integer checkIntegerElement(lua_State *L, int idx, jsize index) {
+    int isNum;
+    lua_Integer v = lua_tointegerx(L, idx, &isNum);
+    if (unlikely(!isNum)) ERROR("Expected integer at %d,but got %s", index, luaL_typename(L, idx));
+    return v;
+}
+
+static lua_Number checkNumberElement(lua_State *L, int idx, jsize index) {
+    int isNum;
+    lua_Number v = lua_tonumberx(L, idx, &isNum);
+    if (unlikely(!isNum)) ERROR("Expected number at %d,but got %s", index, luaL_typename(L, idx));
+    return v;
+}
+
+static jboolean checkBooleanElement(lua_State *L, int idx, jsize index) {
+    if (unlikely(!lua_isboolean(L, idx)))
+        ERROR("Expected boolean at %d,but got %s", index, luaL_typename(L, idx));
+    return (jboolean) lua_toboolean(L, idx);
+}
+
+static jchar checkCharElement(lua_State *L, int idx, jsize index) {
+    if (lua_type(L, idx) == LUA_TSTRING) {
+        const char *s = lua_tostring(L, idx);
+        if (strlen8to16(s) == 1) {
+            char16_t c;
+            strcpy8to16(&c, s, nullptr);
+            return c;
+        }
+    } else {
+        int isNum;
+        lua_Integer v = lua_tointegerx(L, idx, &isNum);
+        if (isNum && v >= 0 && v <= 65535) return (jchar) v;
+    }
+    ERROR("Expected char at %d,but got %s", index, luaL_tolstring(L, idx, nullptr));
+    return 0;
+}
+
+static JavaType *checkArrayComponent(lua_State *L, ThreadContext *context, JavaObject *objRef) {
+    JavaType *component = objRef->type->getComponentType(context->env);
+    if (unlikely(component == nullptr))
+        ERROR("Expected a java array,but got %s", luaL_tolstring(L, 1, nullptr));
+    return component;
+}
+
+int javaToTable(lua_State *L) {
     ThreadContext *context = getContext(L);
-    auto env=context->env;
-    uint expectedSize=(uint)lua_gettop(L);
+    auto env = context->env;
+    JavaObject *objRef = checkJavaObject(L, 1);
+    JavaType *component = checkArrayComponent(L, context, objRef);
+    jsize len = env->GetArrayLength((jarray) objRef->object);
+    jsize from = (jsize) luaL_optinteger(L, 2, 0);
+    jsize to = (jsize) luaL_optinteger(L, 3, len);
+    if (unlikely(from < 0 || to > len || from > to))
+        ERROR("Invalid range [%d,%d) for an array of length %d", from, to, len);
+    lua_createtable(L, to - from, 0);
+    jlong buf[ARRAY_CHUNK];
+    switch (component->getTypeID()) {
+#define ToTableHandle(typeID, jtype, jname, TYPE)\
+        case JavaType::typeID:\
+            for (jsize i = from; i < to; i += ARRAY_CHUNK) {\
+                jsize n = to - i < ARRAY_CHUNK ? to - i : ARRAY_CHUNK;\
+                auto *values = (j##jtype *) buf;\
+                env->Get##jname##ArrayRegion((j##jtype##Array) objRef->object, i, n, values);\
+                for (jsize j = 0; j < n; ++j) {\
+                    push##TYPE##Element(L, values[j]);\
+                    lua_rawseti(L, -2, i - from + j + 1);\
+                }\
+            }\
+            break;
+        ForEachPrimitiveArray(ToTableHandle)
+#undef ToTableHandle
+        default:
+            for (jsize i = from; i < to; ++i) {
+                JObject element = env->GetObjectArrayElement((jobjectArray) objRef->object, i);
+                if (element == nullptr) continue;
+                pushJavaObject(L, context, element);
+                lua_rawseti(L, -2, i - from + 1);
+            }
+            break;
+    }
+    return 1;
+}
+
+int javaFill(lua_State *L) {
+    ThreadContext *context = getContext(L);
+    auto env = context->env;
+    JavaObject *objRef = checkJavaObject(L, 1);
+    JavaType *component = checkArrayComponent(L, context, objRef);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    jsize len = env->GetArrayLength((jarray) objRef->object);
+    jsize offset = (jsize) luaL_optinteger(L, 3, 0);
+    jsize count = (jsize) lua_rawlen(L, 2);
+    if (unlikely(offset < 0 || offset > len - count))
+        ERROR("%d elements from %d is out of range for an array of length %d", count, offset, len);
+    jlong buf[ARRAY_CHUNK];
+    switch (component->getTypeID()) {
+#define FillHandle(typeID, jtype, jname, TYPE)\
+        case JavaType::typeID:\
+            for (jsize i = 0; i < count; i += ARRAY_CHUNK) {\
+                jsize n = count - i < ARRAY_CHUNK ? count - i : ARRAY_CHUNK;\
+                auto *values = (j##jtype *) buf;\
+                for (jsize j = 0; j < n; ++j) {\
+                    lua_rawgeti(L, 2, i + j + 1);\
+                    values[j] = (j##jtype) check##TYPE##Element(L, -1, i + j + 1);\
+                    lua_pop(L, 1);\
+                }\
+                env->Set##jname##ArrayRegion((j##jtype##Array) objRef->object, offset + i, n, values);\
+            }\
+            break;
+        ForEachPrimitiveArray(FillHandle)
+#undef FillHandle
+        default:
+            ERROR("Only primitive arrays can be filled");
+    }
+    lua_settop(L, 1);
+    return 1;
+}
+
+/**
+ * A copy of a primitive array,reads and writes never call into java.
+ * Changes are written back by commit in one region call.
+ */
+struct ArrayView {
+    jarray array;
+    JavaType::TYPE_ID typeID;
+    jsize length;
+    jsize dirtyFrom;
+    jsize dirtyTo;
+    jlong data[0];
+};
+
+static size_t elementSize(JavaType::TYPE_ID typeID) {
+    switch (typeID) {
+#define SizeHandle(typeID, jtype, jname, TYPE) case JavaType::typeID: return sizeof(j##jtype);
+        ForEachPrimitiveArray(SizeHandle)
+#undef SizeHandle
+        default:
+            return 0;
+    }
+}
+
+static void readView(TJNIEnv *env, ArrayView *view) {
+    switch (view->typeID) {
+#define ReadHandle(typeID, jtype, jname, TYPE)\
+        case JavaType::typeID:\
+            env->Get##jname##ArrayRegion((j##jtype##Array) view->array, 0, view->length, (j##jtype *) view->data);\
+            break;
+        ForEachPrimitiveArray(ReadHandle)
+#undef ReadHandle
+        default:
+            break;
+    }
+    view->dirtyFrom = view->length;
+    view->dirtyTo = 0;
+}
+
+static ArrayView *checkView(lua_State *L, int idx) {
+    auto *view = static_cast<ArrayView *>(testUData(L, idx, VIEW_KEY));
+    if (unlikely(view == nullptr))
+        ERROR("Expected an array view,but got %s", luaL_tolstring(L, idx, nullptr));
+    return view;
+}
+
+static jsize checkViewIndex(lua_State *L, ArrayView *view) {
+    int isNum;
+    lua_Integer index = lua_tointegerx(L, 2, &isNum);
+    if (unlikely(!isNum)) ERROR("Invalid index for an array view");
+    if (unlikely(index < 0 || index >= view->length))
+        ERROR("Index %d out of range for an array view of length %d", (int) index, view->length);
+    return (jsize) index;
+}
+
+//commit and refresh are bound to their view,so both view.commit() and view:commit() work
+static int viewCommit(lua_State *L) {
+    ArrayView *view = checkView(L, lua_upvalueindex(1));
+    if (view->dirtyFrom < view->dirtyTo) {
+        auto env = getContext(L)->env;
+        jsize from = view->dirtyFrom;
+        jsize n = view->dirtyTo - from;
+        switch (view->typeID) {
+#define CommitHandle(typeID, jtype, jname, TYPE)\
+            case JavaType::typeID:\
+                env->Set##jname##ArrayRegion((j##jtype##Array) view->array, from, n, ((j##jtype *) view->data) + from);\
+                break;
+            ForEachPrimitiveArray(CommitHandle)
+#undef CommitHandle
+            default:
+                break;
+        }
+        view->dirtyFrom = view->length;
+        view->dirtyTo = 0;
+    }
+    return 0;
+}
+
+static int viewRefresh(lua_State *L) {
+    readView(getContext(L)->env, checkView(L, lua_upvalueindex(1)));
+    return 0;
+}
+
+static int viewIndex(lua_State *L) {
+    auto *view = (ArrayView *) lua_touserdata(L, 1);
+    if (lua_type(L, 2) == LUA_TSTRING) {
+        const char *name = lua_tostring(L, 2);
+        lua_pushvalue(L, 1);
+        if (strcmp(name, "commit") == 0)
+            lua_pushcclosure(L, viewCommit, 1);
+        else if (strcmp(name, "refresh") == 0)
+            lua_pushcclosure(L, viewRefresh, 1);
+        else lua_pushnil(L);
+        return 1;
+    }
+    jsize index = checkViewIndex(L, view);
+    switch (view->typeID) {
+#define IndexHandle(typeID, jtype, jname, TYPE)\
+        case JavaType::typeID:\
+            push##TYPE##Element(L, ((j##jtype *) view->data)[index]);\
+            break;
+        ForEachPrimitiveArray(IndexHandle)
+#undef IndexHandle
+        default:
+            break;
+    }
+    return 1;
+}
+
+static int viewNewIndex(lua_State *L) {
+    auto *view = (ArrayView *) lua_touserdata(L, 1);
+    jsize index = checkViewIndex(L, view);
+    switch (view->typeID) {
+#define NewIndexHandle(typeID, jtype, jname, TYPE)\
+        case JavaType::typeID:\
+            ((j##jtype *) view->data)[index] = (j##jtype) check##TYPE##Element(L, 3, index);\
+            break;
+        ForEachPrimitiveArray(NewIndexHandle)
+#undef NewIndexHandle
+        default:
+            break;
+    }
+    if (index < view->dirtyFrom) view->dirtyFrom = index;
+    if (index >= view->dirtyTo) view->dirtyTo = index + 1;
+    return 0;
+}
+
+static int viewLength(lua_State *L) {
+    lua_pushinteger(L, ((ArrayView *) lua_touserdata(L, 1))->length);
+    return 1;
+}
+
+static int viewGc(lua_State *L) {
+    auto *view = (ArrayView *) lua_touserdata(L, 1);
+    getContext(L)->env->DeleteGlobalRef(view->array);
+    return 0;
+}
+
+int javaView(lua_State *L) {
+    ThreadContext *context = getContext(L);
+    auto env = context->env;
+    JavaObject *objRef = checkJavaObject(L, 1);
+    JavaType *component = checkArrayComponent(L, context, objRef);
+    size_t size = elementSize(component->getTypeID());
+    if (unlikely(size == 0)) ERROR("Only primitive arrays can be viewed");
+    jsize len = env->GetArrayLength((jarray) objRef->object);
+    auto *view = (ArrayView *) lua_newuserdata(L, sizeof(ArrayView) + size * len);
+    view->array = (jarray) env->NewGlobalRef(objRef->object);
+    view->typeID = component->getTypeID();
+    view->length = len;
+    readView(env, view);
+    if (newMetaTable(L, VIEW_KEY, "ArrayView")) {
+        int index = lua_gettop(L);
+        lua_pushstring(L, "Can't change java metatable");
+        lua_setfield(L, index, "__metatable");
+        lua_pushlightuserdata(L, context);
+        lua_pushcclosure(L, viewIndex, 1);
+        lua_setfield(L, index, "__index");
+        lua_pushlightuserdata(L, context);
+        lua_pushcclosure(L, viewNewIndex, 1);
+        lua_setfield(L, index, "__newindex");
+        lua_pushcfunction(L, viewLength);
+        lua_setfield(L, index, "__len");
+        lua_pushlightuserdata(L, context);
+        lua_pushcclosure(L, viewGc, 1);
+        lua_setfield(L, index, "__gc");
+    }
+    lua_setmetatable(L, -2);
+    return 1;
+}
+
+void releaseSharedTable(SharedTable *table) {
+    table->release();
+}
+
+static bool toSharedKey(lua_State *L, int idx, SharedTable::Key &key) {
+    switch (lua_type(L, idx)) {
+        case LUA_TBOOLEAN:
+            key.type = T_BOOLEAN;
+            key.isTrue = (uint8_t) lua_toboolean(L, idx);
+            return true;
+        case LUA_TNUMBER: {
+            int isInt;
+            lua_Integer v = lua_tointegerx(L, idx, &isInt);
+            if (isInt) {
+                key.type = T_INTEGER;
+                key.integer = v;
+            } else {
+                key.type = T_FLOAT;
+                key.number = lua_tonumber(L, idx);
+            }
+            return true;
+        }
+        case LUA_TSTRING: {
+            size_t len;
+            key.type = T_STRING;
+            key.string = lua_tolstring(L, idx, &len);
+            key.length = (uint32_t) len;
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+static void pushSharedKey(lua_State *L, const SharedTable::Key &key) {
+    switch (key.type) {
+        case T_BOOLEAN:
+            lua_pushboolean(L, key.isTrue);
+            break;
+        case T_INTEGER:
+            lua_pushinteger(L, key.integer);
+            break;
+        case T_FLOAT:
+            lua_pushnumber(L, key.number);
+            break;
+        case T_STRING:
+            lua_pushlstring(L, key.string, key.length);
+            break;
+        default:
+            lua_pushnil(L);
+    }
+}
+
+static SharedTable *checkSharedTable(lua_State *L, int idx) {
+    auto **ret = static_cast<SharedTable **>(testUData(L, idx, SHARED_KEY));
+    if (unlikely(ret == nullptr))
+        ERROR("Expected a frozen table,but got %s", luaL_tolstring(L, idx, nullptr));
+    return *ret;
+}
+
+static int sharedIndex(lua_State *L) {
+    ThreadContext *context = getContext(L);
+    SharedTable *table = *(SharedTable **) lua_touserdata(L, 1);
+    SharedTable::Key key;
+    const CrossThreadLuaObject *value;
+    if (!toSharedKey(L, 2, key) || (value = table->get(key)) == nullptr ||
+        !pushLuaObject(context->env, L, context, *value))
+        lua_pushnil(L);
+    return 1;
+}
+
+static int sharedNewIndex(lua_State *L) {
+    ERROR("Can't modify a frozen table");
+    return 0;
+}
+
+static int sharedLength(lua_State *L) {
+    lua_pushinteger(L, (*(SharedTable **) lua_touserdata(L, 1))->length());
+    return 1;
+}
+
+static int sharedNext(lua_State *L) {
+    ThreadContext *context = getContext(L);
+    SharedTable *table = checkSharedTable(L, 1);
+    int32_t slot = -1;
+    if (!lua_isnoneornil(L, 2)) {
+        SharedTable::Key key;
+        if (!toSharedKey(L, 2, key) || (slot = table->slotOf(key)) < 0)
+            ERROR("Invalid key to 'next'");
+    }
+    const SharedTable::Key *key;
+    const CrossThreadLuaObject *value;
+    slot = table->nextSlot(slot, &key, &value);
+    if (slot < 0) {
+        lua_pushnil(L);
+        return 1;
+    }
+    if (key == nullptr) lua_pushinteger(L, slot + 1);
+    else pushSharedKey(L, *key);
+    pushLuaObject(context->env, L, context, *value);
+    return 2;
+}
+
+static int sharedPairs(lua_State *L) {
+    lua_pushvalue(L, lua_upvalueindex(1));
+    lua_pushcclosure(L, sharedNext, 1);
+    lua_pushvalue(L, 1);
+    lua_pushnil(L);
+    return 3;
+}
+
+static int sharedGc(lua_State *L) {
+    (*(SharedTable **) lua_touserdata(L, 1))->release();
+    return 0;
+}
+
+//Proxies of native objects shared by states are cached weakly,so an object read twice stays the same lua value.
+//Leaves the cache below the cached proxy or nil
+static void getSharedProxy(lua_State *L, void *ptr) {
+    lua_rawgetp(L, LUA_REGISTRYINDEX, SHARED_CACHE_KEY);
+    if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        lua_newtable(L);
+        lua_createtable(L, 0, 1);
+        lua_pushstring(L, "v");
+        lua_setfield(L, -2, "__mode");
+        lua_setmetatable(L, -2);
+        lua_pushvalue(L, -1);
+        lua_rawsetp(L, LUA_REGISTRYINDEX, SHARED_CACHE_KEY);
+    }
+    lua_pushlightuserdata(L, ptr);
+    lua_rawget(L, -2);
+}
+
+void pushSharedTable(lua_State *L, ThreadContext *context, SharedTable *table) {
+    getSharedProxy(L, table);
+    if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        *(SharedTable **) lua_newuserdata(L, sizeof(SharedTable *)) = table;
+        table->addRef();
+        if (newMetaTable(L, SHARED_KEY, "SharedTable")) {
+            int index = lua_gettop(L);
+            lua_pushstring(L, "Can't change java metatable");
+            lua_setfield(L, index, "__metatable");
+            lua_pushlightuserdata(L, context);
+            lua_pushcclosure(L, sharedIndex, 1);
+            lua_setfield(L, index, "__index");
+            lua_pushcfunction(L, sharedNewIndex);
+            lua_setfield(L, index, "__newindex");
+            lua_pushcfunction(L, sharedLength);
+            lua_setfield(L, index, "__len");
+            lua_pushlightuserdata(L, context);
+            lua_pushcclosure(L, sharedPairs, 1);
+            lua_setfield(L, index, "__pairs");
+            lua_pushcfunction(L, sharedGc);
+            lua_setfield(L, index, "__gc");
+        }
+        lua_setmetatable(L, -2);
+        lua_pushlightuserdata(L, table);
+        lua_pushvalue(L, -2);
+        lua_rawset(L, -4);
+    }
+    lua_remove(L, -2);
+}
+
+static SharedTable *freezeTable(lua_State *L, ThreadContext *context, int idx, int seen);
+
+static bool freezeValue(lua_State *L, ThreadContext *context, int idx, int seen, CrossThreadLuaObject &out) {
+    switch (lua_type(L, idx)) {
+        case LUA_TTABLE: {
+            SharedTable *table = freezeTable(L, context, idx, seen);
+            if (table == nullptr) return false;
+            out.type = T_SHARED_TABLE;
+            out.sharedTable = table;
+            return true;
+        }
+        case LUA_TFUNCTION:
+        case LUA_TTHREAD:
+            break;
+        case LUA_TUSERDATA:
+            if (!testUData(L, idx, OBJECT_KEY) && !testUData(L, idx, TYPE_KEY) && !testUData(L, idx, SHARED_KEY))
+                break;
+        default:
+            return parseCrossThreadLuaObject(L, context, idx, out);
+    }
+    lua_pushfstring(L, "Can't freeze a value of type %s", luaL_typename(L, idx));
+    return false;
+}
+
+//frozen tables are recorded in the table at seen,false marks the ones being frozen
+SharedTable *freezeTable(lua_State *L, ThreadContext *context, int idx, int seen) {
+    lua_pushvalue(L, idx);
+    lua_rawget(L, seen);
+    if (lua_type(L, -1) == LUA_TLIGHTUSERDATA) {
+        auto *table = (SharedTable *) lua_touserdata(L, -1);
+        lua_pop(L, 1);
+        table->addRef();
+        return table;
+    }
+    if (lua_isboolean(L, -1)) {
+        lua_pop(L, 1);
+        lua_pushstring(L, "Can't freeze a table containing itself");
+        return nullptr;
+    }
+    lua_pop(L, 1);
+    lua_pushvalue(L, idx);
+    lua_pushboolean(L, 0);
+    lua_rawset(L, seen);
+    auto arraySize = (uint32_t) lua_rawlen(L, idx);
+    uint32_t hashCount = 0;
+    SharedTable::Key key;
+    lua_pushnil(L);
+    while (lua_next(L, idx)) {
+        lua_pop(L, 1);
+        if (!toSharedKey(L, -1, key) || key.type != T_INTEGER || key.integer < 1 || key.integer > arraySize)
+            ++hashCount;
+    }
+    auto *table = new SharedTable(arraySize, hashCount);
+    lua_pushnil(L);
+    while (lua_next(L, idx)) {
+        bool ok;
+        if (!toSharedKey(L, -2, key)) {
+            lua_pushfstring(L, "Can't freeze a key of type %s", luaL_typename(L, -2));
+            ok = false;
+        } else if (table->inArray(key)) {
+            ok = freezeValue(L, context, lua_gettop(L), seen, table->arrayAt(uint32_t(key.integer - 1)));
+        } else {
+            if (key.type == T_STRING) {
+                char *s = new char[key.length + 1];
+                memcpy(s, key.string, key.length);
+                s[key.length] = 0;
+                key.string = s;
+            }
+            ok = freezeValue(L, context, lua_gettop(L), seen, table->insert(key));
+        }
+        if (!ok) {
+            //leave only the message
+            lua_insert(L, -3);
+            lua_pop(L, 2);
+            table->release();
+            return nullptr;
+        }
+        lua_pop(L, 1);
+    }
+    lua_pushvalue(L, idx);
+    lua_pushlightuserdata(L, table);
+    lua_rawset(L, seen);
+    return table;
+}
+
+int javaFreeze(lua_State *L) {
+    ThreadContext *context = getContext(L);
+    luaL_checktype(L, 1, LUA_TTABLE);
+    lua_settop(L, 1);
+    lua_newtable(L);
+    SharedTable *table = freezeTable(L, context, 1, 2);
+    if (table == nullptr) lua_error(L);
+    pushSharedTable(L, context, table);
+    table->release();
+    return 1;
+}
+
+void releaseChannel(Channel *channel) {
+    channel->release();
+}
+
+static Channel *checkChannel(lua_State *L, int idx) {
+    auto **ret = static_cast<Channel **>(testUData(L, idx, CHANNEL_KEY));
+    if (unlikely(ret == nullptr))
+        ERROR("Expected a channel,but got %s", luaL_tolstring(L, idx, nullptr));
+    return *ret;
+}
+
+//timeouts are in milliseconds,nil or a negative one waits forever
+static int64_t checkDeadline(lua_State *L, int idx) {
+    lua_Number timeout = luaL_optnumber(L, idx, -1);
+    if (timeout < 0) return -1;
+    return Channel::deadlineAfter(int64_t(timeout * 1000000));
+}
+
+static inline const char *statusName(Channel::Status status) {
+    return status == Channel::CLOSED ? "closed" : "timeout";
+}
+
+static int channelSend(lua_State *L) {
+    ThreadContext *context = getContext(L);
+    Channel *channel = checkChannel(L, 1);
+    if (lua_isnoneornil(L, 2)) ERROR("Can't send nil through a channel");
+    int64_t deadline = checkDeadline(L, 3);
+    Channel::Status status;
+    {
+        CrossThreadLuaObject object;
+        if (!parseCrossThreadLuaObject(L, context, 2, object))
+            goto INVALID;
+        status = channel->send(object, deadline);
+    }
+    lua_pushboolean(L, status == Channel::OK);
+    if (status == Channel::OK) return 1;
+    lua_pushstring(L, statusName(status));
+    return 2;
+    INVALID:
+    ERROR("Invalid object %s to be sent through a channel", luaL_tolstring(L, 2, nullptr));
+    return 0;
+}
+
+static int channelSendAll(lua_State *L) {
+    ThreadContext *context = getContext(L);
+    Channel *channel = checkChannel(L, 1);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    int64_t deadline = checkDeadline(L, 3);
+    int len = (int) lua_rawlen(L, 2);
+    int sent = 0;
+    Channel::Status status = Channel::OK;
+    for (; sent < len; ++sent) {
+        lua_rawgeti(L, 2, sent + 1);
+        {
+            CrossThreadLuaObject object;
+            if (lua_isnil(L, -1) || !parseCrossThreadLuaObject(L, context, lua_gettop(L), object))
+                goto INVALID;
+            status = channel->send(object, deadline);
+        }
+        lua_pop(L, 1);
+        if (status != Channel::OK) break;
+    }
+    lua_pushinteger(L, sent);
+    if (status == Channel::OK) return 1;
+    lua_pushstring(L, statusName(status));
+    return 2;
+    INVALID:
+    ERROR("Invalid object %s at %d to be sent through a channel", luaL_tolstring(L, -1, nullptr), sent + 1);
+    return 0;
+}
+
+static int channelRecv(lua_State *L) {
+    ThreadContext *context = getContext(L);
+    Channel *channel = checkChannel(L, 1);
+    int64_t deadline = checkDeadline(L, 2);
+    CrossThreadLuaObject object;
+    Channel::Status status = channel->recv(object, deadline);
+    if (status != Channel::OK) {
+        lua_pushnil(L);
+        lua_pushstring(L, statusName(status));
+        return 2;
+    }
+    if (!pushLuaObject(context->env, L, context, object))
+        lua_pushnil(L);
+    return 1;
+}
+
+//waits for the first value only,then takes what is available up to max
+static int channelRecvAll(lua_State *L) {
+    ThreadContext *context = getContext(L);
+    Channel *channel = checkChannel(L, 1);
+    auto max = (uint32_t) luaL_optinteger(L, 2, channel->capacity());
+    int64_t deadline = checkDeadline(L, 3);
+    lua_createtable(L, max < 64 ? max : 64, 0);
+    Channel::Status status = Channel::OK;
+    for (uint32_t i = 0; i < max; ++i) {
+        CrossThreadLuaObject object;
+        if (i == 0) status = channel->recv(object, deadline);
+        else if (!channel->tryRecv(object)) break;
+        if (status != Channel::OK) break;
+        if (!pushLuaObject(context->env, L, context, object))
+            lua_pushnil(L);
+        lua_rawseti(L, -2, i + 1);
+    }
+    if (status == Channel::OK) return 1;
+    lua_pushstring(L, statusName(status));
+    return 2;
+}
+
+static int channelClose(lua_State *L) {
+    checkChannel(L, 1)->close();
+    return 0;
+}
+
+static int channelIsClosed(lua_State *L) {
+    lua_pushboolean(L, checkChannel(L, 1)->isClosed());
+    return 1;
+}
+
+static int channelLength(lua_State *L) {
+    lua_pushinteger(L, checkChannel(L, 1)->size());
+    return 1;
+}
+
+static int channelGc(lua_State *L) {
+    (*(Channel **) lua_touserdata(L, 1))->release();
+    return 0;
+}
+
+void pushChannel(lua_State *L, ThreadContext *context, Channel *channel) {
+    getSharedProxy(L, channel);
+    if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        *(Channel **) lua_newuserdata(L, sizeof(Channel *)) = channel;
+        channel->addRef();
+        if (newMetaTable(L, CHANNEL_KEY, "Channel")) {
+            static const luaL_Reg methods[] = {
+                    {"send",     channelSend},
+                    {"sendAll",  channelSendAll},
+                    {"recv",     channelRecv},
+                    {"recvAll",  channelRecvAll},
+                    {"close",    channelClose},
+                    {"isClosed", channelIsClosed},
+                    {nullptr,    nullptr}};
+            int index = lua_gettop(L);
+            lua_pushstring(L, "Can't change java metatable");
+            lua_setfield(L, index, "__metatable");
+            lua_createtable(L, 0, 6);
+            for (const luaL_Reg *l = methods; l->name != nullptr; ++l) {
+                lua_pushlightuserdata(L, context);
+                lua_pushcclosure(L, l->func, 1);
+                lua_setfield(L, -2, l->name);
+            }
+            lua_setfield(L, index, "__index");
+            lua_pushcfunction(L, channelLength);
+            lua_setfield(L, index, "__len");
+            lua_pushcfunction(L, channelGc);
+            lua_setfield(L, index, "__gc");
+        }
+        lua_setmetatable(L, -2);
+        lua_pushlightuserdata(L, channel);
+        lua_pushvalue(L, -2);
+        lua_rawset(L, -4);
+    }
+    lua_remove(L, -2);
+}
+
+int javaChannel(lua_State *L) {
+    ThreadContext *context = getContext(L);
+    lua_Integer capacity = luaL_optinteger(L, 1, 64);
+    if (capacity <= 0 || capacity > (1 << 24)) ERROR("Invalid channel capacity %d", (int) capacity);
+    auto *channel = new Channel((uint32_t) capacity);
+    pushChannel(L, context, channel);
+    channel->release();
+    return 1;
+}
+
+//returns the index of the first channel got a value and the value
+int javaSelect(lua_State *L) {
+    ThreadContext *context = getContext(L);
+    luaL_checktype(L, 1, LUA_TTABLE);
+    int64_t deadline = checkDeadline(L, 2);
+    int len = (int) lua_rawlen(L, 1);
+    for (;;) {
+        int seen = Channel::selectVersion();
+        bool anyOpen = false;
+        for (int i = 1; i <= len; ++i) {
+            lua_rawgeti(L, 1, i);
+            Channel *channel = checkChannel(L, -1);
+            lua_pop(L, 1);
+            CrossThreadLuaObject object;
+            if (channel->tryRecv(object)) {
+                lua_pushinteger(L, i);
+                if (!pushLuaObject(context->env, L, context, object))
+                    lua_pushnil(L);
+                return 2;
+            }
+            anyOpen = anyOpen || !channel->isClosed();
+        }
+        if (!anyOpen) {
+            lua_pushnil(L);
+            lua_pushstring(L, "closed");
+            return 2;
+        }
+        if (!Channel::waitSelect(seen, deadline)) {
+            lua_pushnil(L);
+            lua_pushstring(L, "timeout");
+            return 2;
+        }
+    }
+}
+
+static int javaNext(lua_State* L){
+    ThreadContext *context = getContext(L);
+    auto * object= static_cast<JavaObject *>(lua_touserdata(L, 1));
+    TJNIEnv *env = context->env;
+    LOCAL_FRAME(context, 4);
+    static jmethodID hasNext;
+    static jmethodID nextEntry;
+    if(hasNext== nullptr){
+        JClass type(env->FindClass("com/oslorde/luadroid/MapIterator"));
+        hasNext = env->GetMethodID(type, "hasNext", "()Z");
+        nextEntry = env->GetMethodID(type, "nextEntry", "()[Ljava/lang/Object;");
+    }
+    jboolean hasMore=env->CallBooleanMethod(object->object,hasNext);
+    HOLD_JAVA_EXCEPTION(context,{ throwJavaError(L,context);});
+    if(!hasMore){
+        lua_pushnil(L);
+        return 1;
+    }
+    JObjectArray next(env->CallObjectMethod(object->object,nextEntry));
+    HOLD_JAVA_EXCEPTION(context,{throwJavaError(L, context);});
+    int len=env->GetArrayLength(next);
+    if(len==1){
+        int64_t key=lua_tointeger(L,2);
+        JObject value=env->GetObjectArrayElement(next,0);
+        lua_pushinteger(L,key+1);
+        if(value== nullptr)lua_pushnil(L);
+        else pushJavaObject(L,context,value);
+    } else{
+        JObject key=env->GetObjectArrayElement(next,0);
+        JObject value=env->GetObjectArrayElement(next,1);
+        if(key== nullptr)
+            lua_pushboolean(L,0);
+        else pushJavaObject(L,context,key);
+        if(value== nullptr)lua_pushnil(L);
+        else pushJavaObject(L,context,value);
+    }
+    return 2;
+}
+
+int javaIterate(lua_State* L){
+    ThreadContext *context = getContext(L);
+    auto env=context->env;
+    static jmethodID  iterate=env->GetMethodID(contextClass,"iterate","(Ljava/lang/Object;)Lcom/oslorde/luadroid/MapIterator;");
+    JavaObject* object= checkJavaObject(L,1);
+    LOCAL_FRAME(context, 2);
+    JObject iterator=env->CallObjectMethod(context->scriptContext->javaRef,iterate,object->object);
+    HOLD_JAVA_EXCEPTION(context,{});
+    if(iterator==nullptr){
+        ERROR("Bad argument for iterator:%s",luaL_tolstring(L,1, nullptr));
+    }
+    lua_pushlightuserdata(L,context);
+    lua_pushcclosure(L,javaNext,1);
+    pushJavaObject(L,context,iterator);
+    lua_pushinteger(L,-1);
+    return 3;
+}
+
+int javaToJavaObject(lua_State *L) {
+    ThreadContext *context = getContext(L);
+    auto env=context->env;
+    Arena::Scope scope(context->arena);
+    uint expectedSize=(uint)lua_gettop(L);
     JavaType* _types[expectedSize];
     ValidLuaObject _objects[expectedSize];
     FakeVector<JavaType *> types(_types,expectedSize);
@@ -2704,10 +4227,14 @@ int javaPut(lua_State *L) {
 int javaGet(lua_State *L) {
     ThreadContext *context =* (ThreadContext**)lua_touserdata(L,1);
     const char *name = luaL_tolstring(L, 2, nullptr);
-    CrossThreadLuaObject *object = context->scriptContext->getLuaObject(name);
-    if (object == nullptr||!pushLuaObject(context->env, L, context, *object)) {
+    CrossThreadEntry *entry = context->scriptContext->getLuaObject(name);
+    if (entry == nullptr) {
         lua_pushnil(L);
+        return 1;
     }
+    bool pushed = pushLuaObject(context->env, L, context, entry->object);
+    entry->release();
+    if (!pushed) lua_pushnil(L);
     return 1;
 }
 
@@ -2730,6 +4257,7 @@ int callMethod(lua_State *L) {
     JavaType *type = isStatic ? memberInfo->type : objRef->type;
     int start=1 + memberInfo->isNotOnlyMethod;
     int top=lua_gettop(L);
+    Arena::Scope scope(context->arena);
     uint expectedSize = uint(top - (memberInfo->isNotOnlyMethod));
     JavaType* _types[expectedSize];
     ValidLuaObject _objects[expectedSize];
@@ -2739,12 +4267,14 @@ int callMethod(lua_State *L) {
     auto env=context->env;
     auto&& array=memberInfo->member->methods;
     bool gotVarMethod;
-    auto info = type->deductMethod(env,&array, types, &objects.asVector(),&gotVarMethod);
+    auto info = type->deductMethod(env,memberInfo->member, types, &objects.asVector(),&gotVarMethod);
     if (unlikely(info == nullptr)) {
         TopErrorHandle("No matched found for the method %s;->%s",type->name(env).str(),
                        getMethodName(env,type->getType(),array[0].id,isStatic).str());
     }
     int argCount = info->params.size();
+    //the args,the result and a pending exception
+    LOCAL_FRAME(context, argCount + 2);
     jvalue args[argCount];
     for (int i = argCount-gotVarMethod ; i-- !=0; ) {
         ValidLuaObject &object = _objects[i];
@@ -2832,6 +4362,7 @@ int callMethod(lua_State *L) {
 }
 static int pushMapValue(lua_State *L,ThreadContext* context,TJNIEnv* env,jobject obj){
     static jmethodID sGet = env->GetMethodID(contextClass, "at", "(Ljava/lang/Object;Ljava/lang/Object;)Ljava/lang/Object;");
+    Arena::Scope scope(context->arena);
     ValidLuaObject object;
     parseLuaObject(L,context,2,object);
     JObject  v(env,context->luaObjectToJObject(object));
@@ -2844,6 +4375,7 @@ static int pushMapValue(lua_State *L,ThreadContext* context,TJNIEnv* env,jobject
 }
 static int setMapValue(lua_State *L,ThreadContext* context,TJNIEnv* env,jobject obj){
     static jmethodID sSet = env->GetMethodID(contextClass, "set", "(Ljava/lang/Object;Ljava/lang/Object;Ljava/lang/Object;)V");
+    Arena::Scope scope(context->arena);
     ValidLuaObject key;
     parseLuaObject(L,context,2,key);
     ValidLuaObject value;
@@ -2964,6 +4496,39 @@ static inline uintptr_t tryExistedMember(lua_State* L,JavaType* type,bool isStat
     saveExistedMember(L, true);
     return 1;
 }
+//Resolved members of a type in this state,keyed by the interned lua name so no String is built
+static inline const void* memberCacheKey(JavaType* type,bool isStatic){
+    return reinterpret_cast<char *>(type)+2+isStatic;
+}
+
+static inline Member* findCachedMember(lua_State* L,JavaType* type,bool isStatic){
+    lua_rawgetp(L,LUA_REGISTRYINDEX,memberCacheKey(type,isStatic));
+    if(unlikely(lua_isnil(L,-1))){
+        lua_pop(L,1);
+        return nullptr;
+    }
+    lua_pushvalue(L,2);
+    lua_rawget(L,-2);
+    auto* member=(Member*)lua_touserdata(L,-1);
+    lua_pop(L,2);
+    return member;
+}
+
+static void cacheMember(lua_State* L,JavaType* type,bool isStatic,Member* member){
+    const void* key=memberCacheKey(type,isStatic);
+    lua_rawgetp(L,LUA_REGISTRYINDEX,key);
+    if(lua_isnil(L,-1)){
+        lua_pop(L,1);
+        lua_newtable(L);
+        lua_pushvalue(L,-1);
+        lua_rawsetp(L,LUA_REGISTRYINDEX,key);
+    }
+    lua_pushvalue(L,2);
+    lua_pushlightuserdata(L,member);
+    lua_rawset(L,-3);
+    lua_pop(L,1);
+}
+
 static inline int pushMockMember(lua_State *L,ThreadContext* context, const Member* getter){
     pushMember(context,L,getter,1,false,0,true);
     lua_call(L,0,1);
@@ -3009,7 +4574,11 @@ int getClassMember(lua_State *L) {
     };
 
     FakeString name(L, 2);
-    auto member=type->ensureMember(env,(const String&)name,isStatic);
+    auto member=findCachedMember(L,type,isStatic);
+    if(member== nullptr){
+        member=type->ensureMember(env,(const String&)name,isStatic);
+        if(member) cacheMember(L,type,isStatic,member);
+    }
     FieldArray* fieldArr=nullptr;
     bool isMethod= false;
     int fieldCount=0;
@@ -3167,6 +4736,7 @@ int getField(lua_State *L) {
     }
     JavaType *fieldType = info->type.rawType;
     auto context=memberInfo->context;
+    LOCAL_FRAME(context, 2);
     PushField();
     return 1;
 }
@@ -3198,6 +4768,8 @@ int setField(lua_State *L) {
                 ToReflectedField(type->getType(),memberInfo->member->fields[0].id,isStatic)).str(),(*fieldTypeRef)->name(env).str());
     }
     JavaType *fieldType = info->type.rawType;
+    Arena::Scope scope(context->arena);
+    LOCAL_FRAME(context, 2);
     ValidLuaObject luaObject;
     if (unlikely(!parseLuaObject(L, context, 3, luaObject))) {
         ERROR( "Invalid value passed to java as a field with type:%s", luaL_typename(L, 3));
@@ -3255,6 +4827,7 @@ int setFieldOrArray(lua_State *L) {
             if (unlikely(!isnum))
                 ERROR( "Invalid Value to set a array:%s", luaL_tolstring(L, 2, nullptr));
             if (index < 0 || index > INT32_MAX) ERROR( "Index out of range:%lld", index);
+            Arena::Scope scope(context->arena);
             ValidLuaObject luaObject;
             parseLuaObject(L, context, 3, luaObject);
             checkLuaType(env, L, type, luaObject);
@@ -3327,6 +4900,8 @@ int setFieldOrArray(lua_State *L) {
     if (arr->size() > 1) ERROR("The name %s represents not only one field", name.data());
     auto &&info = arr->begin();
     JavaType *fieldType = info->type.rawType;
+    Arena::Scope scope(context->arena);
+    LOCAL_FRAME(context, 2);
     ValidLuaObject luaObject;
     if (unlikely(!parseLuaObject(L, context, 3, luaObject))) {
         ERROR("Invalid value passed to java as a field with type:%s",
@@ -3365,13 +4940,40 @@ int javaTypeToString(lua_State *L) {
     return 1;
 }
 
+//straight from the utf-16 chars,long strings are converted in chunks
+static void pushJavaString(lua_State *L, TJNIEnv *env, jstring str) {
+    char16_t units[STRING_SCRATCH_SIZE];
+    char bytes[STRING_SCRATCH_SIZE * 3];
+    jsize length = env->GetStringLength(str);
+    if (length <= STRING_SCRATCH_SIZE) {
+        env->GetStringRegion(str, 0, length, (jchar *) units);
+        lua_pushlstring(L, bytes, utf16to8(bytes, units, size_t(length)));
+        return;
+    }
+    luaL_Buffer buffer;
+    luaL_buffinit(L, &buffer);
+    jsize start = 0;
+    while (start < length) {
+        jsize count = length - start;
+        if (count > STRING_SCRATCH_SIZE) count = STRING_SCRATCH_SIZE;
+        env->GetStringRegion(str, start, count, (jchar *) units);
+        //a high surrogate waits for its pair in the next chunk
+        if (start + count < length && units[count - 1] >= 0xD800 && units[count - 1] <= 0xDBFF)
+            --count;
+        luaL_addlstring(&buffer, bytes, utf16to8(bytes, units, size_t(count)));
+        start += count;
+    }
+    luaL_pushresult(&buffer);
+}
+
 int javaObjectToString(lua_State *L) {
     auto *ob = (JavaObject*)lua_touserdata(L,1);
     ThreadContext *context = getContext(L);
     auto env= context->env;
     JString str = env->CallObjectMethod(ob->object, objectToString);
     HOLD_JAVA_EXCEPTION(context,{throwJavaError(L,context);});
-    lua_pushlstring(L, str,strlen(str.str()));
+    if (str.get() == nullptr) lua_pushstring(L, "null");
+    else pushJavaString(L, env, str.get());
     return 1;
 }
 
@@ -3455,6 +5057,7 @@ FuncInfo *saveLuaFunction(lua_State *L, ThreadContext *context, int funcIndex) {
     ret->setUpValues(Array<CrossThreadLuaObject>(std::move(upvalues)));
 
     ret->setImport(context->getImport());
+    ret->owner = context->scriptContext;
     if (isOwner) {
         delete current;
         context->setValue(ContextStorage::PARSED_FUNC, nullptr);
@@ -3506,6 +5109,60 @@ void loadLuaFunction(TJNIEnv *env, lua_State *L, const FuncInfo *info, ThreadCon
     }
 }
 
+static void pushResidentFunction(TJNIEnv *env, lua_State *L, const FuncInfo *info, ThreadContext *context) {
+    lua_rawgetp(L, LUA_REGISTRYINDEX, FUNC_CACHE_KEY);
+    if (unlikely(lua_isnil(L, -1))) {
+        lua_pop(L, 1);
+        lua_newtable(L);
+        lua_pushvalue(L, -1);
+        lua_rawsetp(L, LUA_REGISTRYINDEX, FUNC_CACHE_KEY);
+    }
+    lua_rawgetp(L, -1, info);
+    if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        loadLuaFunction(env, L, info, context);
+        lua_pushvalue(L, -1);
+        lua_rawsetp(L, -3, info);
+        ScriptContext *scriptContext = context->scriptContext;
+        ScopeLock sentry(scriptContext->gcLock);
+        info->residentIn.push_back(intptr_t(pthread_self()));
+    }
+    lua_remove(L, -2);
+}
+
+//only the states of the owner that cached the function have something to drop
+void ScriptContext::evictLuaFunction(const FuncInfo *func) {
+    ScopeLock sentry(sContextLock);
+    for (auto context:sContexts) {
+        if (context != func->owner) continue;
+        ScopeLock stateSentry(context->gcLock);
+        if (func->residentIn.size() == 0) return;
+        for (auto tid:func->residentIn) {
+            if (context->stateMap.find(tid) != nullptr)
+                context->evictedFunctions[tid].push_back(func);
+        }
+        at_counter_inc(&context->evictVersion);
+        return;
+    }
+}
+
+void ScriptContext::dropEvictedFunctions(lua_State *L, ThreadContext *context) {
+    ScopeLock sentry(gcLock);
+    context->evictVersion = at_counter_get(&evictVersion);
+    intptr_t tid = pthread_self();
+    auto iter = evictedFunctions.find(tid);
+    if (iter == nullptr) return;
+    lua_rawgetp(L, LUA_REGISTRYINDEX, FUNC_CACHE_KEY);
+    if (!lua_isnil(L, -1)) {
+        for (auto func:iter->second) {
+            lua_pushnil(L);
+            lua_rawsetp(L, -2, func);
+        }
+    }
+    lua_pop(L, 1);
+    evictedFunctions.erase(tid);
+}
+
 jobject LazyTable::asInterface(ThreadContext *context, JavaType *main) {
     Vector<JavaType *> interfaces;
     Vector<std::unique_ptr<BaseFunction>> luaFuncs;
@@ -3523,7 +5180,9 @@ LuaTable<ValidLuaObject> *LazyTable::getTable(ThreadContext *context) {
     LuaTable<ValidLuaObject> *luaTable;
     if (lua_isnil(L, -1)) {
         lua_pop(L, 1);
-        luaTable = new LuaTable<ValidLuaObject>();
+        luaTable = context->arena.make<LuaTable<ValidLuaObject>>();
+        if (luaTable) luaTable->inArena = true;
+        else luaTable = new LuaTable<ValidLuaObject>();
         lua_pushvalue(L, index);
         lua_pushlightuserdata(L, luaTable);
         lua_rawset(L, LUA_REGISTRYINDEX);
@@ -3540,7 +5199,7 @@ LuaTable<ValidLuaObject> *LazyTable::getTable(ThreadContext *context) {
                 lua_pushvalue(L, index);
                 lua_pushnil(L);
                 lua_rawset(L, LUA_REGISTRYINDEX);
-                delete luaTable;
+                luaTable->free();
                 return nullptr;
             }
         }
@@ -3555,13 +5214,182 @@ LuaTable<ValidLuaObject> *LazyTable::getTable(ThreadContext *context) {
     return luaTable;
 }
 
+static jarray toPrimitiveArray(TJNIEnv *env, lua_State *L, int index, JavaType *component, jsize length) {
+    auto typeId = component->getTypeID();
+    jarray array;
+    switch (typeId) {
+        case JavaType::BYTE:
+            array = env->NewByteArray(length).invalidate();
+            break;
+        case JavaType::SHORT:
+            array = env->NewShortArray(length).invalidate();
+            break;
+        case JavaType::INT:
+            array = env->NewIntArray(length).invalidate();
+            break;
+        case JavaType::LONG:
+            array = env->NewLongArray(length).invalidate();
+            break;
+        case JavaType::FLOAT:
+            array = env->NewFloatArray(length).invalidate();
+            break;
+        case JavaType::DOUBLE:
+            array = env->NewDoubleArray(length).invalidate();
+            break;
+        case JavaType::BOOLEAN:
+            array = env->NewBooleanArray(length).invalidate();
+            break;
+        default:
+            return (jarray) INVALID_OBJECT;
+    }
+    if (array == nullptr) return nullptr;//the OutOfMemoryError is pending
+    //only raw lua reads inside the critical region
+    void *data = env->GetPrimitiveArrayCritical(array, nullptr);
+    bool ok = true;
+    for (jsize i = 0; ok && i < length; ++i) {
+        lua_rawgeti(L, index, i + 1);
+        if (typeId == JavaType::BOOLEAN) {
+            ok = lua_isboolean(L, -1);
+            ((jboolean *) data)[i] = (jboolean) lua_toboolean(L, -1);
+        } else if (lua_type(L, -1) != LUA_TNUMBER) {
+            ok = false;
+        } else if (typeId == JavaType::FLOAT) {
+            ((jfloat *) data)[i] = (jfloat) lua_tonumber(L, -1);
+        } else if (typeId == JavaType::DOUBLE) {
+            ((jdouble *) data)[i] = lua_tonumber(L, -1);
+        } else {
+            int isNum;
+            lua_Integer v = lua_tointegerx(L, -1, &isNum);
+            ok = isNum != 0;
+            switch (typeId) {
+                case JavaType::BYTE:
+                    ((jbyte *) data)[i] = (jbyte) v;
+                    break;
+                case JavaType::SHORT:
+                    ((jshort *) data)[i] = (jshort) v;
+                    break;
+                case JavaType::INT:
+                    ((jint *) data)[i] = (jint) v;
+                    break;
+                default:
+                    ((jlong *) data)[i] = (jlong) v;
+                    break;
+            }
+        }
+        lua_pop(L, 1);
+    }
+    env->ReleasePrimitiveArrayCritical(array, data, ok ? 0 : JNI_ABORT);
+    if (ok) return array;
+    env->DeleteLocalRef(array);
+    return (jarray) INVALID_OBJECT;
+}
+
+//tables and functions inside need the generic conversion
+static jobject toFlatJObject(lua_State *L, ThreadContext *context, int idx) {
+    int type = lua_type(L, idx);
+    if (type == LUA_TTABLE || type == LUA_TFUNCTION) return INVALID_OBJECT;
+    Arena::Scope scope(context->arena);
+    ValidLuaObject object;
+    if (!parseLuaObject(L, context, idx, object)) return INVALID_OBJECT;
+    return context->luaObjectToJObject(object);
+}
+
+//gives the same types as the builtin converters of ScriptContext.lazyConverts:HashMap for Map
+//and HashMap,ArrayList for List,Collection and ArrayList.Disabled once a converter for them is replaced
+jobject LazyTable::toJavaDirect(ThreadContext *context, JavaType *type, jobject realType) {
+    if (!context->scriptContext->directTables) return INVALID_OBJECT;
+    TJNIEnv *env = context->env;
+    size_t length = lua_rawlen(L, index);
+    size_t count = 0;
+    //a sequence only when every key is an integer in 1..length
+    bool isArray = true;
+    lua_pushnil(L);
+    while (lua_next(L, index)) {
+        ++count;
+        if (isArray) {
+            int isNum = 0;
+            lua_Integer key = lua_type(L, -2) == LUA_TNUMBER ? lua_tointegerx(L, -2, &isNum) : 0;
+            isArray = isNum && key >= 1 && lua_Unsigned(key) <= length;
+        }
+        lua_pop(L, 1);
+    }
+    isArray = isArray && count == length;
+    JavaType *component = type->getComponentType(env);
+    if (component != nullptr) {
+        if (!isArray || !component->isPrimitive()) return INVALID_OBJECT;
+        jarray array = toPrimitiveArray(env, L, index, component, jsize(length));
+        HOLD_JAVA_EXCEPTION(context, {
+            return nullptr;
+        });
+        return array;
+    }
+    //element types of generic targets are fixed by the java converters
+    if (realType != nullptr && !env->IsInstanceOf(realType, classType)) return INVALID_OBJECT;
+    static jclass arrayListType = (jclass) env->NewGlobalRef(env->FindClass("java/util/ArrayList"));
+    static jclass listType = (jclass) env->NewGlobalRef(env->FindClass("java/util/List"));
+    static jclass collectionType = (jclass) env->NewGlobalRef(env->FindClass("java/util/Collection"));
+    static jclass hashMapType = (jclass) env->NewGlobalRef(env->FindClass("java/util/HashMap"));
+    static jclass mapType = (jclass) env->NewGlobalRef(env->FindClass("java/util/Map"));
+    static jmethodID initList = env->GetMethodID(arrayListType, "<init>", "(I)V");
+    static jmethodID listAdd = env->GetMethodID(arrayListType, "add", "(Ljava/lang/Object;)Z");
+    static jmethodID initMap = env->GetMethodID(hashMapType, "<init>", "(I)V");
+    static jmethodID mapPut = env->GetMethodID(hashMapType, "put",
+                                               "(Ljava/lang/Object;Ljava/lang/Object;)Ljava/lang/Object;");
+    jclass target = type->getType();
+    if (isArray && (env->IsSameObject(target, arrayListType) || env->IsSameObject(target, listType) ||
+                    env->IsSameObject(target, collectionType))) {
+        JObject list(env, env->NewObject(arrayListType, initList, jint(length)));
+        HOLD_JAVA_EXCEPTION(context, {
+            return nullptr;
+        });
+        for (size_t i = 1; i <= length; ++i) {
+            lua_rawgeti(L, index, lua_Integer(i));
+            jobject value = toFlatJObject(L, context, -1);
+            lua_pop(L, 1);
+            if (value == INVALID_OBJECT) return INVALID_OBJECT;
+            env->CallBooleanMethod(list, listAdd, value);
+            env->DeleteLocalRef(value);
+            HOLD_JAVA_EXCEPTION(context, {
+                return nullptr;
+            });
+        }
+        return list.invalidate();
+    }
+    if (env->IsSameObject(target, hashMapType) || env->IsSameObject(target, mapType)) {
+        JObject map(env, env->NewObject(hashMapType, initMap, jint(count * 4 / 3 + 1)));
+        HOLD_JAVA_EXCEPTION(context, {
+            return nullptr;
+        });
+        lua_pushnil(L);
+        while (lua_next(L, index)) {
+            jobject key = toFlatJObject(L, context, -2);
+            jobject value = key == INVALID_OBJECT ? INVALID_OBJECT : toFlatJObject(L, context, -1);
+            lua_pop(L, 1);
+            if (value == INVALID_OBJECT) {
+                if (key != INVALID_OBJECT) env->DeleteLocalRef(key);
+                lua_pop(L, 1);
+                return INVALID_OBJECT;
+            }
+            env->CallObjectMethod(map, mapPut, key, value);
+            env->DeleteLocalRef(key);
+            env->DeleteLocalRef(value);
+            HOLD_JAVA_EXCEPTION(context, {
+                lua_pop(L, 1);
+                return nullptr;
+            });
+        }
+        return map.invalidate();
+    }
+    return INVALID_OBJECT;
+}
 
 void ScriptContext::pushAddedObject(TJNIEnv *env, lua_State *L, const char *name,const AddInfo& info) {
     if (info.member== nullptr) {
         if (info.obj == nullptr) {
             lua_pushnil(L);
         } else {
-            pushJavaObject(L, env, this, info.obj, nullptr);
+            if (pushJavaObject(L, env, this, info.obj, nullptr))
+                ++getThreadContext()->pushedCount;
         }
         lua_setglobal(L, name);
     } else {
@@ -3570,7 +5398,8 @@ void ScriptContext::pushAddedObject(TJNIEnv *env, lua_State *L, const char *name
         if (isStatic) {
             pushJavaType(L,info.type);
         } else {
-            pushJavaObject(L, env, this, info.obj, info.type);
+            if (pushJavaObject(L, env, this, info.obj, info.type))
+                ++getThreadContext()->pushedCount;
         }
         pushMember(getThreadContext(), L,info.member,top+1, isStatic, info.member->fields.size(), info.member->methods.size()>0);
 
@@ -3662,6 +5491,8 @@ void referFunc(JNIEnv *, jclass, jlong ptr, jboolean deRefer) {
     if(!deRefer){
       info->javaRefCount++;
     } else if (--info->javaRefCount == 0) {
+        if (!info->isLocal())
+            ScriptContext::evictLuaFunction(static_cast<FuncInfo *>(info));
         delete info;
     }
 }
@@ -3675,6 +5506,107 @@ jint getClassType(TJNIEnv * env, jclass, jlong ptr,jclass clz) {
     return context->ensureType(env,clz)->getTypeID();
 }
 
+void setObjectLimit(JNIEnv *, jclass, jlong ptr, jint limit) {
+    auto *context = (ScriptContext *) ptr;
+    context->objectLimit = limit > 0 ? uintptr_t(limit) : UINTPTR_MAX;
+}
+
+void setIdentityCache(JNIEnv *, jclass, jlong ptr, jboolean enabled) {
+    auto *context = (ScriptContext *) ptr;
+    context->identityCache = enabled != 0;
+}
+
+void setGenerationalGC(JNIEnv *, jclass, jlong ptr, jboolean enabled) {
+    auto *context = (ScriptContext *) ptr;
+    context->generationalGC = enabled != 0;
+#ifdef LUA_GCGEN
+    //states of other threads may be running,they keep their mode
+    if (lua_State *L = context->getLua())
+        lua_gc(L, enabled ? LUA_GCGEN : LUA_GCINC, 0);
+    else context->getThreadContext()->throwToJava();
+#endif
+}
+
+void setMemoryLimit(JNIEnv *, jclass, jlong ptr, jlong limit) {
+    auto *context = (ScriptContext *) ptr;
+    at_counter_set(&context->heapAccount.limit, limit > 0 ? uintptr_t(limit) : 0);
+}
+
+void setTemporaryArena(JNIEnv *, jclass, jlong ptr, jboolean enabled) {
+    auto *context = (ScriptContext *) ptr;
+    context->temporaryArena = enabled != 0;
+    context->getThreadContext()->arena.enabled = enabled != 0;
+}
+
+void setDirectTables(JNIEnv *, jclass, jlong ptr, jboolean enabled) {
+    ((ScriptContext *) ptr)->directTables = enabled != 0;
+}
+
+jlongArray getLockStats(TJNIEnv *env, jclass, jlong ptr) {
+    auto *context = (ScriptContext *) ptr;
+    LockStats stats[LOCK_COUNT];
+    context->getLockStats(stats);
+    jlong values[LOCK_COUNT * 3];
+    for (int i = 0; i < LOCK_COUNT; ++i) {
+        values[i * 3] = stats[i].acquireCount;
+        values[i * 3 + 1] = stats[i].contendedCount;
+        values[i * 3 + 2] = stats[i].waitNanos;
+    }
+    jlongArray ret = env->NewLongArray(LOCK_COUNT * 3).invalidate();
+    env->SetLongArrayRegion(ret, 0, LOCK_COUNT * 3, values);
+    return ret;
+}
+
+void preloadClasses(TJNIEnv *env, jclass, jlong ptr, jobjectArray classes) {
+    auto *context = (ScriptContext *) ptr;
+    int len = env->GetArrayLength(classes);
+    for (int i = 0; i < len; ++i) {
+        JClass c(env->GetObjectArrayElement(classes, i));
+        if (c == nullptr) continue;
+        context->ensureType(env, c)->preloadMembers(env);
+    }
+}
+
+static void runExecutorTask(TJNIEnv *env, ScriptContext *context, ScriptExecutor::Task &task) {
+    static jmethodID begin = env->GetMethodID(env->GetObjectClass(task.future), "begin", "()Z");
+    static jmethodID done = env->GetMethodID(env->GetObjectClass(task.future), "done",
+                                             "([Ljava/lang/Object;Ljava/lang/Throwable;)V");
+    //workers never return to java,so the local refs of a task must be dropped here
+    env->PushLocalFrame(16);
+    if (env->CallBooleanMethod(task.future, begin)) {
+        jobjectArray result = runScript(env, nullptr, (jlong) context, task.script, false, task.args);
+        jthrowable error = env->ExceptionOccurred();
+        if (error) env->ExceptionClear();
+        env->CallVoidMethod(task.future, done, result, error);
+    }
+    if (env->ExceptionCheck()) env->ExceptionClear();
+    env->PopLocalFrame(nullptr);
+}
+
+jlong startExecutor(TJNIEnv *env, jclass, jlong ptr, jint threads) {
+    auto *context = (ScriptContext *) ptr;
+    return (jlong) new ScriptExecutor(env, context, context->javaRef, threads, runExecutorTask);
+}
+
+jboolean submitTask(TJNIEnv *env, jclass, jlong ptr, jobject script, jobjectArray args, jobject future) {
+    auto *executor = (ScriptExecutor *) ptr;
+    ScriptExecutor::Task task{env->NewGlobalRef(script), args ? (jobjectArray) env->NewGlobalRef(args) : nullptr,
+                              env->NewGlobalRef(future)};
+    if (executor->submit(task)) return JNI_TRUE;
+    env->DeleteGlobalRef(task.script);
+    if (task.args) env->DeleteGlobalRef(task.args);
+    env->DeleteGlobalRef(task.future);
+    return JNI_FALSE;
+}
+
+jboolean shutdownExecutor(TJNIEnv *env, jclass, jlong ptr) {
+    auto *executor = (ScriptExecutor *) ptr;
+    if (executor->isWorkerThread()) return JNI_FALSE;
+    executor->shutdown(env);
+    delete executor;
+    return JNI_TRUE;
+}
+
 void addJavaObject(TJNIEnv *env, jclass, jlong ptr, jstring _name, jobject obj, jboolean local) {
     auto *context = (ScriptContext *) ptr;
     if(_name== nullptr) return;
@@ -3694,14 +5626,119 @@ void addJavaMember(TJNIEnv *env, jclass, jlong ptr, jstring jname, jstring membe
     memberName.invalidate();
 }
 
-jlong compile(TJNIEnv *env, jclass, jlong ptr, jstring script, jboolean isFile) {
+static int loadScript(lua_State *L, ScriptContext *scriptContext, const char *script, bool isFile) {
+#if LUA_VERSION_NUM >= 503
+    CodeCache *cache = scriptContext->getCodeCache();
+    if (cache != nullptr)
+        return isFile ? cache->loadFile(L, script) : cache->load(L, script, strlen(script), script);
+#endif
+    return isFile ? luaL_loadfile(L, script) : luaL_loadstring(L, script);
+}
+
+jboolean setCodeCache(TJNIEnv *env, jclass, jlong ptr, jstring dir, jboolean strip) {
+#if LUA_VERSION_NUM >= 503
     auto *scriptContext = (ScriptContext *) ptr;
-    ThreadContext* context=scriptContext->getThreadContext();
-    auto L = scriptContext->getLua();
-    JString s(env, script);
-    int ret;
-    if (isFile)ret = luaL_loadfile(L, s);
-    else ret = luaL_loadstring(L, s);
+    JString path(env, dir);
+    auto *cache = new CodeCache(path, strip != JNI_FALSE);
+    path.invalidate();
+    if (scriptContext->setCodeCache(cache)) return JNI_TRUE;
+    delete cache;
+    return JNI_FALSE;
+#else
+    return JNI_FALSE;
+#endif
+}
+
+#define READER_CHUNK_SIZE 16384
+
+struct ArrayReader {
+    TJNIEnv *env;
+    jbyteArray array;
+    jint offset;
+    jint remaining;
+    char buffer[READER_CHUNK_SIZE];
+
+    static const char *read(lua_State *, void *ud, size_t *size) {
+        auto *reader = (ArrayReader *) ud;
+        jint len = reader->remaining < READER_CHUNK_SIZE ? reader->remaining : READER_CHUNK_SIZE;
+        *size = size_t(len);
+        if (len <= 0) return nullptr;
+        reader->env->GetByteArrayRegion(reader->array, reader->offset, len, (jbyte *) reader->buffer);
+        reader->offset += len;
+        reader->remaining -= len;
+        return reader->buffer;
+    }
+};
+
+struct FdReader {
+    int fd;
+    off64_t offset;
+    int64_t remaining;//negative to read until the end
+    char buffer[READER_CHUNK_SIZE];
+
+    static const char *read(lua_State *, void *ud, size_t *size) {
+        auto *reader = (FdReader *) ud;
+        size_t len = READER_CHUNK_SIZE;
+        if (reader->remaining >= 0 && reader->remaining < (int64_t) len) len = size_t(reader->remaining);
+        ssize_t got = 0;
+        if (len > 0) {
+            do got = pread64(reader->fd, reader->buffer, len, reader->offset);
+            while (got < 0 && errno == EINTR);
+        }
+        if (got <= 0) {
+            *size = 0;
+            return nullptr;
+        }
+        reader->offset += got;
+        if (reader->remaining > 0) reader->remaining -= got;
+        *size = size_t(got);
+        return reader->buffer;
+    }
+};
+
+static int loadChunk(lua_State *L, lua_Reader reader, void *data, const char *chunkName) {
+#if LUA_VERSION_NUM >= 502
+    return lua_load(L, reader, data, chunkName, nullptr);
+#else
+    return lua_load(L, reader, data, chunkName);
+#endif
+}
+
+//direct buffers are parsed in place,array backed ones are fed to the parser chunk by chunk
+static int loadByteBuffer(TJNIEnv *env, lua_State *L, ScriptContext *scriptContext, jobject buffer) {
+    static jmethodID position = env->GetMethodID(byteBufferType, "position", "()I");
+    static jmethodID limit = env->GetMethodID(byteBufferType, "limit", "()I");
+    static jmethodID hasArray = env->GetMethodID(byteBufferType, "hasArray", "()Z");
+    static jmethodID array = env->GetMethodID(byteBufferType, "array", "()[B");
+    static jmethodID arrayOffset = env->GetMethodID(byteBufferType, "arrayOffset", "()I");
+    jint start = env->CallIntMethod(buffer, position);
+    jint end = env->CallIntMethod(buffer, limit);
+    auto *address = (const char *) env->GetDirectBufferAddress(buffer);
+    if (address != nullptr) {
+#if LUA_VERSION_NUM >= 503
+        CodeCache *cache = scriptContext->getCodeCache();
+        if (cache != nullptr)
+            return cache->load(L, address + start, size_t(end - start), "=buffer");
+#endif
+        return luaL_loadbuffer(L, address + start, size_t(end - start), "=buffer");
+    }
+    if (!env->CallBooleanMethod(buffer, hasArray)) {
+        lua_pushstring(L, "Buffer is neither direct nor backed by an array");
+        return LUA_ERRFILE;
+    }
+    JObject bytes = env->CallObjectMethod(buffer, array);
+    auto *reader = new ArrayReader;
+    reader->env = env;
+    reader->array = (jbyteArray) bytes.get();
+    reader->offset = env->CallIntMethod(buffer, arrayOffset) + start;
+    reader->remaining = end - start;
+    int ret = loadChunk(L, ArrayReader::read, reader, "=buffer");
+    delete reader;
+    return ret;
+}
+
+static jlong saveCompiled(ScriptContext *scriptContext, lua_State *L, int ret) {
+    ThreadContext *context = scriptContext->getThreadContext();
     jlong retVal = 0;
     if (ret != LUA_OK) {
         context->setPendingException("Failed to load");
@@ -3712,11 +5749,48 @@ jlong compile(TJNIEnv *env, jclass, jlong ptr, jstring script, jboolean isFile)
         info->javaRefCount++;
         retVal = reinterpret_cast<jlong >(info);
     }
-    luaFullGC(L);
-    s.invalidate();
     return retVal;
 }
 
+jlong compileBuffer(TJNIEnv *env, jclass, jlong ptr, jobject buffer) {
+    auto *scriptContext = (ScriptContext *) ptr;
+    auto L = scriptContext->getLua();
+    if (unlikely(L == nullptr)) {
+        scriptContext->getThreadContext()->throwToJava();
+        return 0;
+    }
+    return saveCompiled(scriptContext, L, loadByteBuffer(env, L, scriptContext, buffer));
+}
+
+jlong compileFd(TJNIEnv *, jclass, jlong ptr, jint fd, jlong offset, jlong length) {
+    auto *scriptContext = (ScriptContext *) ptr;
+    auto L = scriptContext->getLua();
+    if (unlikely(L == nullptr)) {
+        scriptContext->getThreadContext()->throwToJava();
+        return 0;
+    }
+    auto *reader = new FdReader;
+    reader->fd = fd;
+    reader->offset = offset;
+    reader->remaining = length;
+    int ret = loadChunk(L, FdReader::read, reader, "=fd");
+    delete reader;
+    return saveCompiled(scriptContext, L, ret);
+}
+
+jlong compile(TJNIEnv *env, jclass, jlong ptr, jstring script, jboolean isFile) {
+    auto *scriptContext = (ScriptContext *) ptr;
+    auto L = scriptContext->getLua();
+    if (unlikely(L == nullptr)) {
+        scriptContext->getThreadContext()->throwToJava();
+        return 0;
+    }
+    JString s(env, script);
+    int ret = loadScript(L, scriptContext, s, isFile);
+    s.invalidate();
+    return saveCompiled(scriptContext, L, ret);
+}
+
 jobject invokeSuper(TJNIEnv* env,jclass ,jobject thiz,jobject method,jint id,jobjectArray args){
     jmethodID mid = env->FromReflectedMethod(method);
     JClass superclass(env->GetSuperclass(env->GetObjectClass(thiz)));
@@ -3754,6 +5828,11 @@ jobjectArray runScript(TJNIEnv *env, jclass, jlong ptr, jobject script, jboolean
     Import myIMport;
     oldImport = context->changeImport(&myIMport);
     auto L = scriptContext->getLua();
+    if (unlikely(L == nullptr)) {
+        context->restore(oldImport);
+        context->throwToJava();
+        return nullptr;
+    }
     auto top = lua_gettop(L);
     int ret;
     int argCount;
@@ -3762,11 +5841,10 @@ jobjectArray runScript(TJNIEnv *env, jclass, jlong ptr, jobject script, jboolean
     int handlerIndex = lua_gettop(L);
     if (env->IsInstanceOf(script, stringType)) {
         JString s(env, static_cast<jstring>(script));
-        if (isFile)ret = luaL_loadfile(L, s);
-        else {
-            ret = luaL_loadstring(L, s);
-        }
+        ret = loadScript(L, scriptContext, s, isFile);
         s.invalidate();
+    } else if (env->IsInstanceOf(script, byteBufferType)) {
+        ret = loadByteBuffer(env, L, scriptContext, script);
     } else {
         auto *info = reinterpret_cast<FuncInfo *>(env->CallLongMethod(script, longValue));
         ret = luaL_loadbuffer(L, &info->funcData[0], info->funcData.size(), "");
@@ -3777,15 +5855,21 @@ jobjectArray runScript(TJNIEnv *env, jclass, jlong ptr, jobject script, jboolean
         goto over;
     }
     argCount = args ?  env->GetArrayLength(args):0;
+    if (unlikely(!reserveJavaObjects(L, scriptContext, uintptr_t(argCount)))) {
+        context->setPendingException("Too many java objects alive");
+        goto over;
+    }
     for (int i = 0; i < argCount; ++i) {
-        pushJavaObject(L, context, env->GetObjectArrayElement(args, i));
+        pushJavaObject(L, context, env->GetObjectArrayElement(args, i), nullptr, false);
     }
     ret = lua_pcall(L, argCount, LUA_MULTRET, handlerIndex);
+    context->popLocalFrames(__builtin_frame_address(0));
     if (unlikely(ret != LUA_OK)) {
         recordLuaError(context, L, ret);
         goto over;
     }
     {
+        Arena::Scope scope(context->arena);
         int resultSize = lua_gettop(L) - handlerIndex;
         if (resultSize > 0) {
             result = env->asJNIEnv()->NewObjectArray(resultSize, scriptContext->ObjectClass->getType(),
@@ -3806,22 +5890,28 @@ jobjectArray runScript(TJNIEnv *env, jclass, jlong ptr, jobject script, jboolean
 }
 
 
-jobject invokeLuaFunction(TJNIEnv *env, jclass, jlong ptr, jlong funcRef, jboolean multiRet, jobject proxy, jstring methodName,
-                          jintArray argTypes, jobjectArray args) {
-    auto *scriptContext = (ScriptContext *) ptr;
-    ThreadContext* context=scriptContext->getThreadContext();
-    Import *oldImport= nullptr;
-    if (_setjmp(errorJmp)) {
-        context->restore(oldImport);
-        return nullptr;
+//objectCount is the most java args pushed after the callee
+static int pushLuaCallee(TJNIEnv *env, lua_State *L, ScriptContext *scriptContext, ThreadContext *context,
+                         jlong funcRef, jobject proxy, jstring methodName, Import *&oldImport, jsize objectCount) {
+    if (unlikely(L == nullptr)) {//getLua failed
+        oldImport = context->getImport();
+        context->throwToJava();
+        return 0;
+    }
+    if (unlikely(context->evictVersion != at_counter_get(&scriptContext->evictVersion)))
+        scriptContext->dropEvictedFunctions(L, context);
+    if (unlikely(!reserveJavaObjects(L, scriptContext, uintptr_t(objectCount) + 1))) {
+        oldImport = context->getImport();
+        context->setPendingException("Too many java objects alive");
+        context->throwToJava();
+        return 0;
     }
-    auto L=scriptContext->getLua();
     pushErrorHandler(L,context);
     int handlerIndex = lua_gettop(L);
     if (!reinterpret_cast<BaseFunction *>(funcRef)->isLocal()) {
         auto *funcInfo = (FuncInfo *) funcRef;
         oldImport = context->changeImport(funcInfo->getImport());
-        loadLuaFunction(env, L, funcInfo, context);
+        pushResidentFunction(env, L, funcInfo, context);
     } else {
         oldImport = context->getImport();
         auto *info = reinterpret_cast<LocalFunctionInfo *>(funcRef);
@@ -3830,13 +5920,120 @@ jobject invokeLuaFunction(TJNIEnv *env, jclass, jlong ptr, jlong funcRef, jboole
             context->setPendingException(
                     "Local Function must run in the given thread it's extracted from");
             context->throwToJava();
-            return nullptr;
+            return 0;
         }
     }
-    pushJavaObject(L, context, proxy);
+    pushJavaObject(L, context, proxy, nullptr, false);
     JString name(env,methodName);
     lua_pushstring(L,name.str());
     name.invalidate();
+    return handlerIndex;
+}
+
+/**
+ * Primitives come in raw bits and only object args are fetched one by one,
+ * so no unboxing upcall is needed.
+ */
+static int pushDirectArgs(TJNIEnv *env, lua_State *L, ThreadContext *context, jintArray argTypes,
+                          jlongArray args, jobjectArray objectArgs) {
+    int len = env->GetArrayLength(argTypes);
+    if (len == 0) return 0;
+    jint *types = (jint *) alloca(len * sizeof(jint));
+    jlong *values = (jlong *) alloca(len * sizeof(jlong));
+    env->GetIntArrayRegion(argTypes, 0, len, types);
+    env->GetLongArrayRegion(args, 0, len, values);
+    for (int i = 0; i < len; ++i) {
+        switch (types[i]) {
+            case 0: {//char
+                char16_t c = (char16_t) values[i];
+                char charStr[4];
+                strncpy16to8(charStr, &c, 1);
+                lua_pushstring(L, charStr);
+                break;
+            }
+            case 1://boolean
+                lua_pushboolean(L, values[i] != 0);
+                break;
+            case 2://integer
+                lua_pushinteger(L, values[i]);
+                break;
+            case 3: {//double
+                double number;
+                memcpy(&number, &values[i], sizeof(number));
+                lua_pushnumber(L, number);
+                break;
+            }
+            default: {//object
+                JObject obj = env->GetObjectArrayElement(objectArgs, i);
+                if (obj == nullptr) {
+                    lua_pushnil(L);
+                } else pushJavaObject(L, context, obj, nullptr, false);
+                break;
+            }
+        }
+    }
+    return len;
+}
+
+static jlong toDirectResult(lua_State *L, ThreadContext *context, int index, int returnType) {
+    int type = lua_type(L, index);
+    if (type == LUA_TNIL || type == LUA_TNONE) return 0;
+    switch (returnType) {
+        case 0: {//char
+            if (type == LUA_TSTRING) {
+                const char *s = lua_tostring(L, index);
+                if (strlen8to16(s) == 1) {
+                    char16_t c;
+                    strcpy8to16(&c, s, nullptr);
+                    return c;
+                }
+            } else {
+                int isNum;
+                lua_Integer v = lua_tointegerx(L, index, &isNum);
+                if (isNum && v >= 0 && v <= 65535) return v;
+            }
+            break;
+        }
+        case 1://boolean
+            if (type == LUA_TBOOLEAN) return lua_toboolean(L, index);
+            break;
+        case 2: {//integer
+            int isNum;
+            lua_Integer v = lua_tointegerx(L, index, &isNum);
+            if (isNum) return v;
+            break;
+        }
+        case 3: {//double
+            int isNum;
+            double v = lua_tonumberx(L, index, &isNum);
+            if (isNum) {
+                jlong bits;
+                memcpy(&bits, &v, sizeof(bits));
+                return bits;
+            }
+            break;
+        }
+        default://void
+            return 0;
+    }
+    context->setPendingException(lua_pushfstring(L, "Incompatible return value:%s", luaL_typename(L, index)));
+    return 0;
+}
+
+jobject invokeLuaFunction(TJNIEnv *env, jclass, jlong ptr, jlong funcRef, jboolean multiRet, jobject proxy, jstring methodName,
+                          jintArray argTypes, jobjectArray args) {
+    auto *scriptContext = (ScriptContext *) ptr;
+    ThreadContext* context=scriptContext->getThreadContext();
+    Import *oldImport= nullptr;
+    if (_setjmp(errorJmp)) {
+        context->restore(oldImport);
+        return nullptr;
+    }
+    auto L=scriptContext->getLua();
+    int handlerIndex = pushLuaCallee(env, L, scriptContext, context, funcRef, proxy, methodName, oldImport,
+                                     env->GetArrayLength(argTypes));
+    if (unlikely(handlerIndex == 0))
+        return nullptr;
     int len = env->GetArrayLength(argTypes);
     jint *arr = env->GetIntArrayElements(argTypes, nullptr);
     for (int i = 0; i < len; ++i) {
@@ -3871,7 +6068,7 @@ jobject invokeLuaFunction(TJNIEnv *env, jclass, jlong ptr, jlong funcRef, jboole
                 JObject obj = env->GetObjectArrayElement(args, i);
                 if (obj == nullptr) {
                     lua_pushnil(L);
-                } else pushJavaObject(L, context, obj);
+                } else pushJavaObject(L, context, obj, nullptr, false);
                 break;
             }
         }
@@ -3880,6 +6077,8 @@ jobject invokeLuaFunction(TJNIEnv *env, jclass, jlong ptr, jlong funcRef, jboole
 
     len += 2;
     int err = lua_pcall(L, len, LUA_MULTRET, handlerIndex);
+    context->popLocalFrames(__builtin_frame_address(0));
+    Arena::Scope scope(context->arena);
     jobject ret = nullptr;
     int retCount;
     if (err != LUA_OK)recordLuaError(context, L, err);
@@ -3907,4 +6106,60 @@ jobject invokeLuaFunction(TJNIEnv *env, jclass, jlong ptr, jlong funcRef, jboole
     return ret;
 }
 
+jlong invokeLuaDirect(TJNIEnv *env, jclass, jlong ptr, jlong funcRef, jobject proxy, jstring methodName,
+                      jintArray argTypes, jlongArray args, jobjectArray objectArgs, jint returnType) {
+    auto *scriptContext = (ScriptContext *) ptr;
+    ThreadContext* context=scriptContext->getThreadContext();
+    Import *oldImport= nullptr;
+    if (_setjmp(errorJmp)) {
+        context->restore(oldImport);
+        return 0;
+    }
+    auto L=scriptContext->getLua();
+    int handlerIndex = pushLuaCallee(env, L, scriptContext, context, funcRef, proxy, methodName, oldImport,
+                                     env->GetArrayLength(argTypes));
+    if (unlikely(handlerIndex == 0))
+        return 0;
+    int len = pushDirectArgs(env, L, context, argTypes, args, objectArgs) + 2;
+    int err = lua_pcall(L, len, 1, handlerIndex);
+    context->popLocalFrames(__builtin_frame_address(0));
+    jlong ret = 0;
+    if (err != LUA_OK)recordLuaError(context, L, err);
+    else ret = toDirectResult(L, context, handlerIndex + 1, returnType);
+    lua_settop(L, handlerIndex - 1);
+    context->restore(oldImport);
+    return ret;
+}
+
+jobject invokeLuaDirectObject(TJNIEnv *env, jclass, jlong ptr, jlong funcRef, jobject proxy, jstring methodName,
+                              jintArray argTypes, jlongArray args, jobjectArray objectArgs) {
+    auto *scriptContext = (ScriptContext *) ptr;
+    ThreadContext* context=scriptContext->getThreadContext();
+    Import *oldImport= nullptr;
+    if (_setjmp(errorJmp)) {
+        context->restore(oldImport);
+        return nullptr;
+    }
+    auto L=scriptContext->getLua();
+    int handlerIndex = pushLuaCallee(env, L, scriptContext, context, funcRef, proxy, methodName, oldImport,
+                                     env->GetArrayLength(argTypes));
+    if (unlikely(handlerIndex == 0))
+        return nullptr;
+    int len = pushDirectArgs(env, L, context, argTypes, args, objectArgs) + 2;
+    int err = lua_pcall(L, len, 1, handlerIndex);
+    context->popLocalFrames(__builtin_frame_address(0));
+    Arena::Scope scope(context->arena);
+    jobject ret = nullptr;
+    if (err != LUA_OK)recordLuaError(context, L, err);
+    else {
+        ValidLuaObject object;
+        parseLuaObject(L, context, handlerIndex + 1, object);
+        ret = context->luaObjectToJObject(object);
+        if (ret == INVALID_OBJECT) ret = nullptr;
+    }
+    lua_settop(L, handlerIndex - 1);
+    context->restore(oldImport);
+    return ret;
+}
+
 
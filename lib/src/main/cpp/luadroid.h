@@ -11,6 +11,9 @@
 #include "AutoJNIEnv.h"
 #include "TJNIEnv.h"
 #include "tls.h"
+#include "ConcurrentTable.h"
+#include "Arena.h"
+#include "LuaHeap.h"
 
 #ifndef LUADROID_LUADROID_H
 #define LUADROID_LUADROID_H
@@ -25,6 +28,10 @@ if(unlikely(env->ExceptionCheck())){\
 }})
 
 #define INVALID_OBJECT reinterpret_cast<jobject >(-1)
+#define DEFAULT_OBJECT_LIMIT 32768
+#define TYPE_CACHE_SIZE 32
+#define LOCK_COUNT 7
+#define MAX_LOCAL_FRAMES 64
 
 inline void cleanArgs(jvalue *args, int argSize, Vector<ValidLuaObject> &arr, JNIEnv *env) {
     for (int i =argSize; i--; ) {
@@ -63,15 +70,22 @@ enum class ContextStorage{
 };
 //class JavaType;
 class Member;
+class StringCache;
 class ScriptContext;
 struct ThreadContext{
     TJNIEnv* env;
     ScriptContext* scriptContext;
     int pushedCount;
+    int pushedSinceStep;
+    uintptr_t evictVersion=0;
+    Arena arena;
 private:
     Import* import;
     jthrowable pendingJavaError;
     void* storage[(int)ContextStorage::LEN];
+    const void *localFrames[MAX_LOCAL_FRAMES];
+    int localFrameCount;
+    StringCache *stringCache;
     inline JClass getTypeNoCheck(const String &className) const;
     inline JavaType* ensureArrayType(const char *typeName) ;
 public:
@@ -137,6 +151,12 @@ public:
         return pendingJavaError != nullptr;
     }
 
+    //Frames are owned by native stack addresses,the ones of calls unwound by a lua error
+    //are popped by the next frame or landing point at the same depth or above
+    bool pushLocalFrame(const void *owner, int capacity);
+
+    void popLocalFrames(const void *owner);
+
     JClass findClass(String&& str){
         return findClass(str);
     }
@@ -153,6 +173,11 @@ public:
 
     jobject luaObjectToJObject( ValidLuaObject &luaObject);
 
+    //short strings are taken from a cache
+    jstring newString(const char *s);
+
+    void clearStringCache();
+
     JavaType *MapType();
 
     JavaType *FunctionType();
@@ -164,6 +189,25 @@ public:
     ~ThreadContext();
 };
 
+//Readers of the cross table hold a reference,so replacing a value never frees it under them
+class CrossThreadEntry {
+    volatile at_int refCount = 1;
+public:
+    CrossThreadLuaObject object;
+
+    explicit CrossThreadEntry(CrossThreadLuaObject &&object) : object(std::move(object)) {}
+
+    void addRef() {
+        at_int_add(&refCount, 1);
+    }
+
+    void release() {
+        if (at_int_add(&refCount, -1) == 0)
+            delete this;
+    }
+};
+
+class CodeCache;
 struct AddInfo{
     JavaType* type;
     jobject obj;
@@ -171,38 +215,36 @@ struct AddInfo{
 };
 class ScriptContext {
 
-    struct hashJClass {
-        int operator()(const jclass c) const noexcept {
-            return ScriptContext::sTypeEnv->CallIntMethod(c, objectHash);
-        }
-    };
-
-    struct equalJClass{
-        bool operator()(const jclass &c1, const jclass &c2) const noexcept {//must not null both
-            if (c1 == nullptr) return false;
-            if (c2 == nullptr) return false;
-            return c1 == c2 || ScriptContext::sTypeEnv->IsSameObject(c1, c2);
-        }
+    struct TypeCacheEntry {
+        uint32_t contextId;
+        JavaType *type;
     };
     static jmethodID sWriteLog;
-    static TJNIEnv* sTypeEnv;
+    static __thread TypeCacheEntry sTypeCache[TYPE_CACHE_SIZE];
     friend class ThreadContext;
-    typedef Map<jclass, JavaType *,hashJClass,equalJClass> TypeMap;
+    typedef ConcurrentTable<JavaType> TypeTable;
     typedef Map<intptr_t , lua_State *> StateMap;
-    typedef Map<String, CrossThreadLuaObject> CrossThreadMap;
+    typedef Map<String, CrossThreadEntry *> CrossThreadMap;
     typedef Map<String, AddInfo> AddedMap;
+    typedef Map<intptr_t, Vector<const BaseFunction *>> EvictMap;
+    static AdaptiveLock sContextLock;
+    static Vector<ScriptContext*> sContexts;
+    static uint32_t sContextId;
     const bool importAll;
     const bool localFunction;
+    const uint32_t contextId;
     ThreadLocal<ThreadContext,true> threadContext;
-    TypeMap typeMap;
+    TypeTable typeTable;
     StateMap stateMap;
     AddedMap addedMap;
-    SpinLock typeLock;
-    SpinLock gcLock;
-    SpinLock crossLock;
-    SpinLock addLock;
-    SpinLock loggerLock;
+    AdaptiveLock typeLock;
+    AdaptiveLock gcLock;
+    AdaptiveLock crossLock;
+    AdaptiveLock addLock;
+    AdaptiveLock loggerLock;
     CrossThreadMap crossThreadMap;
+    EvictMap evictedFunctions;
+    volatile at_ptr codeCache = nullptr;
 
     JavaType *HashMapClass = nullptr;
     JavaType *FunctionClass = nullptr;
@@ -212,6 +254,8 @@ class ScriptContext {
     jweak errLogger = nullptr;
     char16_t * javaLogBuffer= nullptr;
 
+    static uint32_t newContextId();
+
     JavaType *getVoidClass(TJNIEnv *env);
     JavaType *const byteClass;
     JavaType *const shortClass;
@@ -234,6 +278,19 @@ public:
     JavaType *const ObjectClass;
     intptr_t logID;
     jobject const javaRef;
+    volatile at_counter deductCacheHits = 0;
+    volatile at_counter deductCacheMisses = 0;
+    volatile at_counter evictVersion = 0;
+    volatile at_counter liveObjects = 0;
+    volatile at_counter identityHits = 0;
+    volatile at_counter identityMisses = 0;
+    uintptr_t objectLimit = DEFAULT_OBJECT_LIMIT;
+    volatile bool identityCache = false;
+    volatile bool generationalGC = false;
+    volatile bool temporaryArena = true;
+    volatile bool directTables = true;//see LazyTable::toJavaDirect
+    HeapAccount heapAccount;
+    volatile at_counter addedVersion = 0;//bumped when addedMap gains a name
 
     JavaType *ensureType(TJNIEnv *env, jclass type);
 
@@ -242,8 +299,15 @@ public:
     lua_State *getLua();
 
     void saveLuaObject(CrossThreadLuaObject &object, const char *name) {
-        ScopeLock sentry(crossLock);
-        crossThreadMap[name]=std::move(object);
+        auto *entry = new CrossThreadEntry(std::move(object));
+        CrossThreadEntry *old;
+        {
+            ScopeLock sentry(crossLock);
+            CrossThreadEntry *&slot = crossThreadMap[name];
+            old = slot;
+            slot = entry;
+        }
+        if (old) old->release();
     }
 
     void removeCurrent(){
@@ -251,26 +315,45 @@ public:
         auto id=pthread_self();
         auto L=stateMap.find(id)->second;
         stateMap.erase(id);
-        lua_close(L);
+        evictedFunctions.erase(id);
+        LuaHeap::closeState(L);
     }
 
+    static const char *const lockNames[LOCK_COUNT];
+
+    void getLockStats(LockStats *out);
 
-    CrossThreadLuaObject *getLuaObject(const char *name) {
+    static void evictLuaFunction(const FuncInfo *func);
+
+    void dropEvictedFunctions(lua_State *L, ThreadContext *context);
+
+
+    //the returned entry should be released after use
+    CrossThreadEntry *getLuaObject(const char *name) {
         ScopeLock sentry(crossLock);
-         auto &&iter = crossThreadMap.find(String(name));
+        auto &&iter = crossThreadMap.find(String(name));
         if (iter == crossThreadMap.end()) return nullptr;
-        else return &(iter->second);
+        iter->second->addRef();
+        return iter->second;
     }
 
     void deleteLuaObject(const char *name) {
-        ScopeLock sentry(crossLock);
-        crossThreadMap.erase(String(name));
+        CrossThreadEntry *old;
+        {
+            ScopeLock sentry(crossLock);
+            auto &&iter = crossThreadMap.find(String(name));
+            if (iter == crossThreadMap.end()) return;
+            old = iter->second;
+            crossThreadMap.erase(String(name));
+        }
+        old->release();
     }
     ThreadContext* getThreadContext(){
         ThreadContext* context= threadContext.get();
         if(context==nullptr){
             context=new ThreadContext();
             context->scriptContext=this;
+            context->arena.enabled=temporaryArena;
             threadContext.rawSet(context);
         }
         return context;
@@ -281,6 +364,21 @@ public:
 
     void pushAddedObject(TJNIEnv *env, lua_State *L, const char *name,const AddInfo& addInfo);
 
+    bool pushLazyGlobal(lua_State *L, const char *name, int kind);
+
+    void loadAddedNames(lua_State *L, int nameIndex);
+
+    void openLazyGlobals(lua_State *L, int nameIndex);
+
+    //can only be set once
+    bool setCodeCache(CodeCache *cache) {
+        return at_ptr_cas(&codeCache, nullptr, cache);
+    }
+
+    CodeCache *getCodeCache() {
+        return (CodeCache *) at_ptr_load(&codeCache);
+    }
+
     void registerLogger(TJNIEnv *env, jobject out, jobject err);
 
     void writeLog(TJNIEnv *env, const char *data, bool isError);
@@ -3,12 +3,16 @@
 #include "jtype.h"
 #include "java_type.h"
 #include "utf8.h"
+#include "StringCache.h"
 #include <sys/system_properties.h>
 #include <dlfcn.h>
 #include <assert.h>
 
 jmethodID ScriptContext::sWriteLog;
-TJNIEnv* ScriptContext::sTypeEnv;
+__thread ScriptContext::TypeCacheEntry ScriptContext::sTypeCache[TYPE_CACHE_SIZE];
+AdaptiveLock ScriptContext::sContextLock;
+Vector<ScriptContext*> ScriptContext::sContexts;
+uint32_t ScriptContext::sContextId;
 static jmethodID sProxy;
 TJNIEnv* _GCEnv;
 jmethodID charValue;
@@ -29,8 +33,10 @@ static void handleAdd(int, siginfo *, void *) {
     const char *name = sAddInfo.name;
     AutoJNIEnv env;
     ScriptContext *context = sAddInfo.context;
+    //only sent to the threads that already have a state
     lua_State *L = context->getLua();
-    context->pushAddedObject(env, L, name, sAddInfo.info);
+    if (L != nullptr)
+        context->pushAddedObject(env, L, name, sAddInfo.info);
     pthread_cond_signal(&sAddInfo.cond);
     pthread_mutex_unlock(&sAddInfo.mutex);
 }
@@ -46,6 +52,7 @@ ScriptContext::addJavaObject(TJNIEnv *env, const char *name, const char *methodN
     } else if(!currentOnly){
         addedMap[name]= {type,object, methodName== nullptr? nullptr:
                                        (member=type->ensureMember(env,methodName,object== nullptr))};
+        at_counter_inc(&addedVersion);
     }
     addLock.unlock();
     pthread_mutex_lock(&sAddInfo.mutex);
@@ -90,6 +97,7 @@ ScriptContext::addJavaObject(TJNIEnv *env, const char *name, const char *methodN
 #define BOX_INIT(Type) Type##Class(ensureType(env,env->FindClass("java/lang/"#Type)))
 ScriptContext::ScriptContext(TJNIEnv *env, jobject javaObject, bool importAll, bool localFunction) :
         importAll((init(env, javaObject),importAll)), localFunction(localFunction),
+        contextId(newContextId()),
         javaRef( env->NewWeakGlobalRef(javaObject)),
         byteClass(ensureType(env, JavaType::getComponentType(env, env->FindClass("[B")))),
         shortClass(ensureType(env, JavaType::getComponentType(env, env->FindClass("[S")))),
@@ -152,6 +160,8 @@ ScriptContext::ScriptContext(TJNIEnv *env, jobject javaObject, bool importAll, b
     BooleanClass->typeID=JavaType::BOX_BOOLEAN;
     ObjectClass->typeID=JavaType::BOX_OBJECT;
     ensureType(env,env->FindClass("java/lang/Number"))->typeID=JavaType::BOX_NUMBER;
+    ScopeLock sentry(sContextLock);
+    sContexts.push_back(this);
 }
 
 
@@ -164,6 +174,10 @@ void ScriptContext::init(TJNIEnv *env, const jobject javaObject) {
         JClass cThr = env->FindClass("java/lang/Throwable");
         throwableType = (jclass) env->NewGlobalRef(cThr);
     }
+    if (byteBufferType == nullptr) {
+        JClass cBuf = env->FindClass("java/nio/ByteBuffer");
+        byteBufferType = (jclass) env->NewGlobalRef(cBuf);
+    }
     if (classType == nullptr) {
         JClass cClass = env->GetObjectClass(stringType);
         classType = (jclass) env->NewGlobalRef(cClass);
@@ -179,6 +193,8 @@ void ScriptContext::init(TJNIEnv *env, const jobject javaObject) {
                 "[Ljava/lang/reflect/Method;[JJZJLjava/lang/Object;)Ljava/lang/Object;");
         JavaType::sFindMembers = env->GetStaticMethodID(cl, "findMembers"
                 , "(Ljava/lang/Class;Ljava/lang/String;ZZ)[Ljava/lang/Object;");
+        JavaType::sFindAllMembers = env->GetStaticMethodID(cl, "findAllMembers"
+                , "(Ljava/lang/Class;Z)[Ljava/lang/Object;");
 
         JavaType::sFindMockName = env->GetStaticMethodID(cl, "findMockName"
                 , "(Ljava/lang/Class;Ljava/lang/String;)[Ljava/lang/String;");
@@ -213,23 +229,76 @@ lua_State *ScriptContext::getLua() {
     const auto &iter = stateMap.find(tid);
     lua_State *state;
     if (iter == nullptr) {
-        state = luaL_newstate();
+        state = LuaHeap::newState(&heapAccount);
+        if (unlikely(state == nullptr)) {
+            //thrown to java by the caller
+            getThreadContext()->setPendingException("Not enough memory to create a lua state");
+            return nullptr;
+        }
         config(state);
+        if (LuaHeap *heap = LuaHeap::of(state))
+            heap->setEnforced(true);
         stateMap.emplace(tid, state);
     } else state = iter->second;
     return state;
 }
 
 
+const char *const ScriptContext::lockNames[LOCK_COUNT] = {"typeLock", "gcLock", "crossLock", "addLock",
+                                                          "loggerLock", "contextLock", "logLock"};
+
+void ScriptContext::getLockStats(LockStats *out) {
+    out[0] = typeLock.getStats();
+    out[1] = gcLock.getStats();
+    out[2] = crossLock.getStats();
+    out[3] = addLock.getStats();
+    out[4] = loggerLock.getStats();
+    out[5] = sContextLock.getStats();
+    out[6] = loggerLockStats();
+}
+
+uint32_t ScriptContext::newContextId() {
+    ScopeLock sentry(sContextLock);
+    return ++sContextId;
+}
+
+struct TypeMatcher {
+    TJNIEnv *env;
+    jclass type;
+
+    bool operator()(JavaType *javaType) const {
+        return env->IsSameObject(javaType->getType(), type);
+    }
+};
+
 JavaType *ScriptContext::ensureType(TJNIEnv *env, jclass type) {
-    ScopeLock sentry(typeLock);
-    sTypeEnv=env;
-    const auto &iter = typeMap.find(type);
-    if (iter != nullptr) {
-        return iter->second;
-    }
-    JavaType *ret = new JavaType(env, type, this);
-    typeMap.emplace(ret->type, ret);
+    //the recent types are matched by reference,which needs no upcall into java.
+    //a hit moves up one slot,so the hot types of a thread stay in the first probes
+    for (uint32_t i = 0; i < TYPE_CACHE_SIZE; ++i) {
+        TypeCacheEntry &entry = sTypeCache[i];
+        if (entry.contextId != contextId) continue;
+        jclass cached = entry.type->getType();
+        if (cached == type || env->IsSameObject(cached, type)) {
+            JavaType *ret = entry.type;
+            if (i > 0) std::swap(entry, sTypeCache[i - 1]);
+            return ret;
+        }
+    }
+    //Class doesn't override hashCode so it's the identity hash and stable
+    uint32_t hash = (uint32_t) env->CallIntMethod(type, objectHash);
+    TypeMatcher matcher{env, type};
+    JavaType *ret = typeTable.find(hash, matcher);
+    if (ret == nullptr) {
+        ScopeLock sentry(typeLock);
+        ret = typeTable.find(hash, matcher);
+        if (ret == nullptr) {
+            ret = new JavaType(env, type, this);
+            typeTable.insert(hash, ret);
+        }
+    }
+    //JNI has no native identity key for a class,so only the types missing here pay the hashCode upcall.
+    //a new one takes the last slot and has to be hit to stay
+    sTypeCache[TYPE_CACHE_SIZE - 1] = {contextId, ret};
     return ret;
 }
 
@@ -484,7 +553,13 @@ jvalue ThreadContext::luaObjectToJValue(ValidLuaObject &luaObject, JavaType *typ
                 isOwner = true;
             }
             auto &&iter = current->find(luaObject.lazyTable);
-            if (iter == nullptr) {
+            jobject direct;
+            bool directFailed = false;
+            if (iter == nullptr &&
+                (direct = luaObject.lazyTable->toJavaDirect(this, type, realType)) != INVALID_OBJECT) {
+                ret.l = direct;
+                directFailed = direct == nullptr;
+            } else if (iter == nullptr) {
                 JavaType *mapType = MapType();
                 auto &&table = luaObject.lazyTable->getTable(this)->get();
                 static jmethodID initMap = env->GetMethodID(mapType->type, "<init>", "(I)V");
@@ -510,6 +585,7 @@ jvalue ThreadContext::luaObjectToJValue(ValidLuaObject &luaObject, JavaType *typ
                 delete current;
                 setValue(ContextStorage::PARSED_TABLE, nullptr);
             }
+            if (directFailed) goto ERROR_HANDLE;
         } else if (type->isInterface(env)) {
             ret.l = luaObject.lazyTable->asInterface(this, type);
         } else ret.l = nullptr;
@@ -520,7 +596,7 @@ jvalue ThreadContext::luaObjectToJValue(ValidLuaObject &luaObject, JavaType *typ
         ret.l = nullptr;
     } else if (luaObject.type == T_STRING) {
         luaObject.shouldRelease = true;
-        ret.l = env->NewStringUTF(luaObject.string).invalidate();
+        ret.l = newString(luaObject.string);
     } else if (luaObject.type == T_OBJECT) {
         ret.l = luaObject.objectRef->object;
     } else {
@@ -591,6 +667,39 @@ JavaType *ThreadContext::FunctionType() {
     return scriptContext->FunctionClass;
 }
 
+jstring ThreadContext::newString(const char *s) {
+    size_t length = strlen(s);
+    bool cacheable = StringCache::cacheable(length);
+    uint32_t hash = 0;
+    if (cacheable) {
+        if (stringCache == nullptr) stringCache = new StringCache();
+        hash = StringCache::hashOf(s, length);
+        jstring cached = stringCache->get(env, s, length, hash);
+        if (cached != nullptr) return cached;
+    }
+    jstring ret;
+    //modified utf-8 only matches standard utf-8 for ascii
+    if (asciiPrefix(s, length) == length) {
+        ret = (jstring) env->NewStringUTF(s).invalidate();
+    } else if (length <= STRING_SCRATCH_SIZE) {
+        char16_t units[STRING_SCRATCH_SIZE];
+        ret = env->NewString((const jchar *) units, jsize(utf8to16(units, s, length)));
+    } else {
+        auto *units = new char16_t[length];
+        ret = env->NewString((const jchar *) units, jsize(utf8to16(units, s, length)));
+        delete[] units;
+    }
+    if (cacheable && ret != nullptr) stringCache->put(env, s, length, hash, ret);
+    return ret;
+}
+
+void ThreadContext::clearStringCache() {
+    if (stringCache == nullptr) return;
+    stringCache->clear(env);
+    delete stringCache;
+    stringCache = nullptr;
+}
+
 jobject ThreadContext::luaObjectToJObject(ValidLuaObject &luaObject) {
     switch (luaObject.type) {
         case T_NIL:
@@ -1,6 +1,15 @@
 
 #include <malloc.h>
+#include <cstdint>
+#include <cstring>
 #include "utf8.h"
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define UTF8_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define UTF8_SSE2
+#endif
 
 
 /**
@@ -223,3 +232,135 @@ char16_t *strcpy8to16(char16_t *utf16Str, const char *utf8Str,
 
     return utf16Str;
 }
+
+#define ASCII_MASK8 0x8080808080808080ULL
+#define ASCII_MASK16 0xff80ff80ff80ff80ULL
+
+/**
+ * Count of the leading bytes below 0x80,
+ * checked 16 at a time with simd and 8 at a time otherwise.
+ */
+size_t asciiPrefix(const char *s, size_t len) {
+    size_t i = 0;
+#if defined(UTF8_NEON)
+    for (; i + 16 <= len; i += 16) {
+        uint64x2_t v = vreinterpretq_u64_u8(vld1q_u8((const uint8_t *) s + i));
+        if ((vgetq_lane_u64(v, 0) | vgetq_lane_u64(v, 1)) & ASCII_MASK8) break;
+    }
+#elif defined(UTF8_SSE2)
+    for (; i + 16 <= len; i += 16) {
+        if (_mm_movemask_epi8(_mm_loadu_si128((const __m128i *) (s + i)))) break;
+    }
+#endif
+    for (; i + 8 <= len; i += 8) {
+        uint64_t v;
+        memcpy(&v, s + i, 8);
+        if (v & ASCII_MASK8) break;
+    }
+    while (i < len && (uint8_t) s[i] < 0x80) ++i;
+    return i;
+}
+
+size_t asciiPrefix16(const char16_t *s, size_t len) {
+    size_t i = 0;
+#if defined(UTF8_NEON)
+    uint16x8_t mask = vdupq_n_u16(0xff80);
+    for (; i + 8 <= len; i += 8) {
+        uint64x2_t v = vreinterpretq_u64_u16(vandq_u16(vld1q_u16((const uint16_t *) s + i), mask));
+        if (vgetq_lane_u64(v, 0) | vgetq_lane_u64(v, 1)) break;
+    }
+#elif defined(UTF8_SSE2)
+    __m128i mask = _mm_set1_epi16((short) 0xff80);
+    __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= len; i += 8) {
+        __m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i *) (s + i)), mask);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(v, zero)) != 0xffff) break;
+    }
+#endif
+    for (; i + 4 <= len; i += 4) {
+        uint64_t v;
+        memcpy(&v, s + i, 8);
+        if (v & ASCII_MASK16) break;
+    }
+    while (i < len && s[i] < 0x80) ++i;
+    return i;
+}
+
+size_t utf8to16(char16_t *out, const char *s, size_t len) {
+    auto *p = (const uint8_t *) s;
+    char16_t *start = out;
+    size_t i = 0;
+    while (i < len) {
+        size_t ascii = asciiPrefix(s + i, len - i);
+        for (size_t k = 0; k < ascii; ++k) out[k] = p[i + k];
+        out += ascii;
+        i += ascii;
+        if (i == len) break;
+        uint32_t c = p[i++];
+        uint32_t need;
+        uint32_t min;
+        if (c < 0xc2) {
+            *out++ = UTF16_REPLACEMENT_CHAR;
+            continue;
+        } else if (c < 0xe0) {
+            need = 1;
+            min = 0x80;
+            c &= 0x1f;
+        } else if (c < 0xf0) {
+            need = 2;
+            min = 0x800;
+            c &= 0x0f;
+        } else if (c < 0xf5) {
+            need = 3;
+            min = 0x10000;
+            c &= 0x07;
+        } else {
+            *out++ = UTF16_REPLACEMENT_CHAR;
+            continue;
+        }
+        uint32_t got = 0;
+        for (; got < need && i < len && (p[i] & 0xc0) == 0x80; ++got, ++i) {
+            UTF8_SHIFT_AND_MASK(c, p[i]);
+        }
+        if (got < need || c < min || c > UNICODE_UPPER_LIMIT) {
+            *out++ = UTF16_REPLACEMENT_CHAR;
+        } else if (c >= 0x10000) {
+            *out++ = char16_t(0xd800 | ((c - 0x10000) >> 10));
+            *out++ = char16_t(0xdc00 | ((c - 0x10000) & 0x3ff));
+        } else *out++ = char16_t(c);
+    }
+    return out - start;
+}
+
+size_t utf16to8(char *out, const char16_t *s, size_t len) {
+    char *start = out;
+    size_t i = 0;
+    while (i < len) {
+        size_t ascii = asciiPrefix16(s + i, len - i);
+        for (size_t k = 0; k < ascii; ++k) out[k] = char(s[i + k]);
+        out += ascii;
+        i += ascii;
+        if (i == len) break;
+        uint32_t c = s[i++];
+        if (c < 0x800) {
+            *out++ = char(0xc0 | (c >> 6));
+            *out++ = char(0x80 | (c & 0x3f));
+            continue;
+        }
+        if (c >= 0xd800 && c <= 0xdfff) {
+            if (c <= 0xdbff && i < len && s[i] >= 0xdc00 && s[i] <= 0xdfff) {
+                c = 0x10000 + ((c - 0xd800) << 10) + (s[i++] - 0xdc00);
+                *out++ = char(0xf0 | (c >> 18));
+                *out++ = char(0x80 | ((c >> 12) & 0x3f));
+                *out++ = char(0x80 | ((c >> 6) & 0x3f));
+                *out++ = char(0x80 | (c & 0x3f));
+                continue;
+            }
+            c = UTF16_REPLACEMENT_CHAR;
+        }
+        *out++ = char(0xe0 | (c >> 12));
+        *out++ = char(0x80 | ((c >> 6) & 0x3f));
+        *out++ = char(0x80 | (c & 0x3f));
+    }
+    return out - start;
+}
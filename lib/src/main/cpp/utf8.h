@@ -5,6 +5,8 @@
 #ifndef LUADROID_UFT8_H
 #define LUADROID_UFT8_H
 
+#include <cstddef>
+
 size_t strnlen16to8(const char16_t *utf16Str, size_t len);
 
 char *strndup16to8(const char16_t *s, size_t n);
@@ -18,4 +20,23 @@ char16_t *strcpy8to16(char16_t *utf16Str, const char *utf8Str,
 
 char *strncpy16to8(char *utf8Str, const char16_t *utf16Str, size_t len);
 
+//strings up to this many utf-16 units are converted on the stack
+#define STRING_SCRATCH_SIZE 256
+
+size_t asciiPrefix(const char *s, size_t len);
+
+size_t asciiPrefix16(const char16_t *s, size_t len);
+
+/**
+ * Standard utf-8 to utf-16,invalid sequences become U+FFFD.
+ * "out" needs "len" units,returns the count written.
+ */
+size_t utf8to16(char16_t *out, const char *s, size_t len);
+
+/**
+ * Utf-16 to standard utf-8,an unpaired surrogate becomes U+FFFD.
+ * "out" needs 3*"len" bytes,returns the count written.
+ */
+size_t utf16to8(char *out, const char16_t *s, size_t len);
+
 #endif //LUADROID_UFT8_H
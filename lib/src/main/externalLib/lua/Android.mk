@@ -13,7 +13,16 @@ MY_SRC_LIST  := $(filter-out $(EXPLICIT_SRC_EXCLUDES), $(MY_SRC_LIST))
 
 LOCAL_SRC_FILES := $(MY_SRC_LIST:$(LOCAL_PATH)/%=%)
 LOCAL_C_INCLUDES := $(LOCAL_PATH)
-LOCAL_CFLAGS += -DLUA_USE_LINUX -Os -fno-math-errno -Wall -DLUA_USE_LONGJMP -DLUA_COMPAT_5_2 -DLUA_COMPAT_5_1 -DLUA_COMPAT_FLOATSTRING
+LOCAL_CFLAGS += -DLUA_USE_LINUX -Os -fno-math-errno -Wall -DLUA_USE_LONGJMP
+#the vm build config,exported so that the luadroid module sees it too(the code cache tags its dumps with it)
+LUA_VM_CFLAGS := -DLUA_COMPAT_5_2 -DLUA_COMPAT_5_1 -DLUA_COMPAT_FLOATSTRING
+#the vm dispatches with computed goto by default,add -DLUA_USE_JUMPTABLE=0 to use the switch
+#fused instruction pairs,see vmfuse in lvm.c
+LUA_VM_CFLAGS += -DLUA_USE_SUPERINSTRUCTIONS
+#hash short strings with farmhash,see lstring.c
+LUA_VM_CFLAGS += -DLUA_FARMHASH
+LOCAL_CFLAGS += $(LUA_VM_CFLAGS)
+LOCAL_EXPORT_CFLAGS := $(LUA_VM_CFLAGS)
 LOCAL_EXPORT_C_INCLUDES := $(LOCAL_PATH)
 LOCAL_MODULE :=lua
 $(info local c includes=$(LOCAL_C_INCLUDES))
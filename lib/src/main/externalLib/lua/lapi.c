@@ -1105,6 +1105,8 @@ LUA_API int lua_gc(lua_State *L, int what, int data) {
         case LUA_GCSTEP: {
             l_mem debt = 1;  /* =1 to signal that it did an actual step */
             lu_byte oldrunning = g->gcrunning;
+            /* in generational mode, signal the end of a major collection */
+            unsigned long majors = g->gcpauses.majors;
             g->gcrunning = 1;  /* allow GC to run */
             if (data == 0) {
                 luaE_setdebt(g, -GCSTEPSIZE);  /* to do a "small" step */
@@ -1115,7 +1117,8 @@ LUA_API int lua_gc(lua_State *L, int what, int data) {
                 luaC_checkGC(L);
             }
             g->gcrunning = oldrunning;  /* restore previous state */
-            if (debt > 0 && g->gcstate == GCSpause)  /* end of cycle? */
+            if (debt > 0 && ((g->gcstate == GCSpause && !g->genmajor) ||
+                             g->gcpauses.majors != majors))  /* end of cycle? */
                 res = 1;  /* signal it */
             break;
         }
@@ -1130,10 +1133,27 @@ LUA_API int lua_gc(lua_State *L, int what, int data) {
             g->gcstepmul = data;
             break;
         }
+        case LUA_GCSETMAJORINC: {
+            res = g->gcmajorinc;
+            g->gcmajorinc = data;
+            break;
+        }
         case LUA_GCISRUNNING: {
             res = g->gcrunning;
             break;
         }
+        case LUA_GCGEN:  /* change collector to generational mode */
+        case LUA_GCINC: {  /* change collector to incremental mode */
+            if (g->gcinfin) {  /* cannot change it from a finalizer */
+                res = -1;
+                break;
+            }
+            res = isgenmode(g) ? LUA_GCGEN : LUA_GCINC;  /* previous mode */
+            if (what == LUA_GCGEN && data != 0)
+                g->genminormul = data;  /* young memory between minor collections */
+            luaC_changemode(L, what == LUA_GCGEN ? KGC_GEN : KGC_NORMAL);
+            break;
+        }
         default:
             res = -1;  /* invalid option */
     }
@@ -1142,6 +1162,25 @@ LUA_API int lua_gc(lua_State *L, int what, int data) {
 }
 
 
+LUA_API void lua_strtabstats(lua_State *L, lua_StrTabStats *stats) {
+    lua_lock(L);
+    luaS_stats(L, stats);
+    lua_unlock(L);
+}
+
+
+LUA_API void lua_gcpausestats(lua_State *L, lua_GCPauseStats *stats, int reset) {
+    global_State *g;
+    lua_lock(L);
+    g = G(L);
+    *stats = g->gcpauses;
+    stats->generational = isgenmode(g);
+    if (reset)
+        memset(&g->gcpauses, 0, sizeof(g->gcpauses));
+    lua_unlock(L);
+}
+
+
 
 /*
 ** miscellaneous functions
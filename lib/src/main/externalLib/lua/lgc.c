@@ -9,6 +9,7 @@
 
 
 #include <string.h>
+#include <time.h>
 
 #include "lua.h"
 
@@ -58,10 +59,29 @@
 
 
 /*
-** 'makewhite' erases all color bits then sets only the current white
-** bit
+** macro to adjust 'gcmajorinc': a major collection runs when memory
+** use hits 'gcmajorinc / MAJORADJ' times the memory in use after the
+** previous one
 */
-#define maskcolors    (~(bitmask(BLACKBIT) | WHITEBITS))
+#define MAJORADJ        100
+
+
+/*
+** maximum memory (in bytes) of young objects between two minor
+** collections: each minor collection sweeps all its young objects in a
+** single pause, so on a large heap 'genminormul' alone would make that
+** pause grow with the heap
+*/
+#if !defined(LUAI_GENMINORMAX)
+#define LUAI_GENMINORMAX    (512 * 1024)
+#endif
+
+
+/*
+** 'makewhite' erases all color bits (and the old bit) then sets only
+** the current white bit
+*/
+#define maskcolors    (~(bit2mask(BLACKBIT, OLDBIT) | WHITEBITS))
 #define makewhite(g, x)    \
  (x->marked = cast_byte((x->marked & maskcolors) | luaC_white(g)))
 
@@ -374,6 +394,8 @@ static void traverseweakvalue(global_State *g, Table *h) {
         linkgclist(h, g->grayagain);  /* must retraverse it in atomic phase */
     else if (hasclears)
         linkgclist(h, g->weak);  /* has to be cleared later */
+    else if (isgenerational(g))  /* an old table is not marked again */
+        linkgclist(h, g->grayagain);  /* so it must stay in a gray list */
 }
 
 
@@ -421,6 +443,8 @@ static int traverseephemeron(global_State *g, Table *h) {
         linkgclist(h, g->ephemeron);  /* have to propagate again */
     else if (hasclears)  /* table has white keys? */
         linkgclist(h, g->allweak);  /* may have to clean white keys */
+    else if (isgenerational(g))  /* see 'traverseweakvalue' */
+        linkgclist(h, g->grayagain);
     return marked;
 }
 
@@ -599,6 +623,13 @@ static void propagateall(global_State *g) {
 }
 
 
+static void propagatelist(global_State *g, GCObject *l) {
+    lua_assert(g->gray == NULL);  /* no grays left */
+    g->gray = l;
+    propagateall(g);  /* traverse all elements from 'l' */
+}
+
+
 static void convergeephemerons(global_State *g) {
     int changed;
     do {
@@ -735,19 +766,34 @@ static GCObject **sweeplist(lua_State *L, GCObject **p, lu_mem count);
 ** white; change all non-dead objects back to white, preparing for next
 ** collection cycle. Return where to continue the traversal or NULL if
 ** list is finished.
+** In generational mode, surviving objects keep their colors and become
+** old instead, and the sweep stops at the first old object (new objects
+** are always added at the beginning of a list, see MOVE OLD rule).
 */
 static GCObject **sweeplist(lua_State *L, GCObject **p, lu_mem count) {
     global_State *g = G(L);
     int ow = otherwhite(g);
-    int white = luaC_white(g);  /* current white */
+    int toclear, toset;  /* bits to clear and to set in all live objects */
+    int tostop;  /* stop sweep when this is true */
+    if (isgenerational(g)) {  /* generational mode? */
+        toclear = ~0;  /* clear nothing */
+        toset = bitmask(OLDBIT);  /* set the old bit of all surviving objects */
+        tostop = bitmask(OLDBIT);  /* do not sweep old generation */
+    } else {  /* normal mode */
+        toclear = maskcolors;  /* clear all color bits + old bit */
+        toset = luaC_white(g);  /* make object white */
+        tostop = 0;  /* do not stop */
+    }
     while (*p != NULL && count-- > 0) {
         GCObject *curr = *p;
         int marked = curr->marked;
         if (isdeadm(ow, marked)) {  /* is 'curr' dead? */
             *p = curr->next;  /* remove 'curr' from list */
             freeobj(L, curr);  /* erase 'curr' */
-        } else {  /* change mark to 'white' */
-            curr->marked = cast_byte((marked & maskcolors) | white);
+        } else {
+            if (testbits(marked, tostop))
+                return NULL;  /* stop sweeping this list */
+            curr->marked = cast_byte((marked & toclear) | toset);
             p = &curr->next;  /* go to next element */
         }
     }
@@ -795,6 +841,7 @@ static GCObject *udata2finalize(global_State *g) {
     o->next = g->allgc;  /* return it to 'allgc' list */
     g->allgc = o;
     resetbit(o->marked, FINALIZEDBIT);  /* object is "normal" again */
+    resetoldbit(o);  /* see MOVE OLD rule */
     if (issweepphase(g))
         makewhite(g, o);  /* "sweep" object */
     return o;
@@ -817,8 +864,10 @@ static void GCTM(lua_State *L, int propagateerrors) {
         int status;
         lu_byte oldah = L->allowhook;
         int running = g->gcrunning;
+        lu_byte infin = g->gcinfin;
         L->allowhook = 0;  /* stop debug hooks during GC metamethod */
         g->gcrunning = 0;  /* avoid GC steps */
+        g->gcinfin = 1;  /* avoid mode changes in the middle of a cycle */
         setobj2s(L, L->top, tm);  /* push finalizer... */
         setobj2s(L, L->top + 1, &v);  /* ... and its argument */
         L->top += 2;  /* and (next line) call the finalizer */
@@ -827,6 +876,7 @@ static void GCTM(lua_State *L, int propagateerrors) {
         L->ci->callstatus &= ~CIST_FIN;  /* not running a finalizer anymore */
         L->allowhook = oldah;  /* restore hooks */
         g->gcrunning = running;  /* restore state */
+        g->gcinfin = infin;
         if (status != LUA_OK && propagateerrors) {  /* error while running __gc? */
             if (status == LUA_ERRRUN) {  /* is there an error object? */
                 const char *msg = (ttisstring(L->top - 1))
@@ -890,6 +940,7 @@ static void separatetobefnz(global_State *g, int all) {
             p = &curr->next;  /* don't bother with it */
         else {
             *p = curr->next;  /* remove 'curr' from 'finobj' list */
+            resetoldbit(curr);  /* may be old when 'all' is true */
             curr->next = *lastnext;  /* link at the end of 'tobefnz' list */
             *lastnext = curr;
             lastnext = &curr->next;
@@ -910,7 +961,10 @@ void luaC_checkfinalizer(lua_State *L, GCObject *o, Table *mt) {
     else {  /* move 'o' to 'finobj' list */
         GCObject **p;
         if (issweepphase(g)) {
-            makewhite(g, o);  /* "sweep" object 'o' */
+            if (!isgenerational(g))
+                makewhite(g, o);  /* "sweep" object 'o' */
+            else  /* the sweep of a major collection would make a young 'o' */
+                markobject(g, o);  /* old while still white; keep it alive */
             if (g->sweepgc == &o->next)  /* should not remove 'sweepgc' object */
                 g->sweepgc = sweeptolive(L, g->sweepgc);  /* change 'sweepgc' */
         }
@@ -920,6 +974,7 @@ void luaC_checkfinalizer(lua_State *L, GCObject *o, Table *mt) {
         o->next = g->finobj;  /* link it in 'finobj' list */
         g->finobj = o;
         l_setbit(o->marked, FINALIZEDBIT);  /* mark it as such */
+        resetoldbit(o);  /* see MOVE OLD rule */
     }
 }
 
@@ -954,16 +1009,16 @@ static void setpause(global_State *g) {
 
 /*
 ** Enter first sweep phase.
-** The call to 'sweeplist' tries to make pointer point to an object
-** inside the list (instead of to the header), so that the real sweep do
-** not need to skip objects created between "now" and the start of the
-** real sweep.
+** The call to 'sweeptolive' makes pointer point to an object inside
+** the list (instead of to the header), so that the real sweep do not
+** need to skip objects created between "now" and the start of the real
+** sweep (in generational mode, it must not make them old).
 */
 static void entersweep(lua_State *L) {
     global_State *g = G(L);
     g->gcstate = GCSswpallgc;
     lua_assert(g->sweepgc == NULL);
-    g->sweepgc = sweeplist(L, &g->allgc, 1);
+    g->sweepgc = sweeptolive(L, &g->allgc);
 }
 
 
@@ -986,10 +1041,13 @@ static l_mem atomic(lua_State *L) {
     global_State *g = G(L);
     l_mem work;
     GCObject *origweak, *origall;
-    GCObject *grayagain = g->grayagain;  /* save original list */
-    lua_assert(g->ephemeron == NULL && g->weak == NULL);
+    GCObject *grayagain = g->grayagain;  /* save original lists */
+    GCObject *weak = g->weak;  /* (weak tables of previous cycles are */
+    GCObject *ephemeron = g->ephemeron;  /* only kept in generational mode) */
+    lua_assert(isgenerational(g) || (ephemeron == NULL && weak == NULL));
     lua_assert(!iswhite(g->mainthread));
     g->gcstate = GCSinsideatomic;
+    g->grayagain = g->weak = g->ephemeron = NULL;
     g->GCmemtrav = 0;  /* start counting work */
     markobject(g, L);  /* mark running thread */
     /* registry and global metatables may be changed by API */
@@ -999,8 +1057,10 @@ static l_mem atomic(lua_State *L) {
     remarkupvals(g);
     propagateall(g);  /* propagate changes */
     work = g->GCmemtrav;  /* stop counting (do not recount 'grayagain') */
-    g->gray = grayagain;
-    propagateall(g);  /* traverse 'grayagain' list */
+    /* traverse objects caught by write barrier and old weak tables */
+    propagatelist(g, grayagain);
+    propagatelist(g, weak);
+    propagatelist(g, ephemeron);
     g->GCmemtrav = 0;  /* restart counting */
     convergeephemerons(g);
     /* at this point, all strongly accessible objects are marked. */
@@ -1066,6 +1126,8 @@ static lu_mem singlestep(lua_State *L) {
         case GCSatomic: {
             lu_mem work;
             propagateall(g);  /* make sure gray list is empty */
+            if (g->genmajor)  /* major collection of generational mode? */
+                g->gckind = KGC_GEN;  /* its survivors become old in the sweep */
             work = atomic(L);  /* work is what was traversed by 'atomic' */
             entersweep(L);
             g->GCestimate = gettotalbytes(g);  /* first estimate */;
@@ -1081,7 +1143,8 @@ static lu_mem singlestep(lua_State *L) {
             return sweepstep(L, g, GCSswpend, NULL);
         }
         case GCSswpend: {  /* finish sweeps */
-            makewhite(g, g->mainthread);  /* sweep main thread */
+            if (!isgenerational(g))  /* (it stays gray in generational mode) */
+                makewhite(g, g->mainthread);  /* sweep main thread */
             checkSizes(L, g);
             g->gcstate = GCScallfin;
             return 0;
@@ -1129,15 +1192,68 @@ static l_mem getdebt(global_State *g) {
 }
 
 /*
-** performs a basic GC step when collector is running
+** microseconds from a monotonic clock, to measure the pauses
 */
-void luaC_step(lua_State *L) {
+static lu_mem gcclock(void) {
+#if defined(LUA_USE_POSIX)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return cast(lu_mem, ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+#else
+    return cast(lu_mem, cast(double, clock()) * 1000000 / CLOCKS_PER_SEC);
+#endif
+}
+
+
+/*
+** account a pause started at 'start' into the histogram, whose
+** buckets are 4 times wider each
+*/
+static void recordpause(global_State *g, lu_mem start) {
+    lua_GCPauseStats *s = &g->gcpauses;
+    lu_mem pause = gcclock() - start;
+    int i = 0;
+    while (i < LUA_GCPAUSEHIST - 1 && pause >= (cast(lu_mem, 16) << (2 * i)))
+        i++;
+    s->pauses[i]++;
+    s->totalpause += pause;
+    if (pause > s->maxpause)
+        s->maxpause = pause;
+}
+
+
+/*
+** In generational mode, the next minor collection runs when the young
+** objects take 'genminormul'% of the memory in use, but no more than
+** LUAI_GENMINORMAX bytes
+*/
+static void setminorpause(global_State *g) {
+    l_mem estimate = g->GCestimate / PAUSEADJ;  /* adjust 'estimate' */
+    l_mem young = estimate * g->genminormul;
+    if (young > LUAI_GENMINORMAX)
+        young = LUAI_GENMINORMAX;
+    luaE_setdebt(g, gettotalbytes(g) - (cast(l_mem, g->GCestimate) + young));
+}
+
+
+/*
+** does a minor collection (a whole cycle over the young objects)
+*/
+static void minorcollection(lua_State *L) {
+    global_State *g = G(L);
+    lua_assert(g->gcstate == GCSpropagate);
+    g->gcstate = GCSatomic;  /* the gray lists have all there is to traverse */
+    luaC_runtilstate(L, bitmask(GCSpause));  /* run complete cycle */
+    g->gcstate = GCSpropagate;  /* skip restart */
+    if (gettotalbytes(g) > (g->GCmajorbase / MAJORADJ) * g->gcmajorinc)
+        g->GCmajorbase = 0;  /* signal for a major collection */
+    setminorpause(g);
+}
+
+
+static void incstep(lua_State *L) {
     global_State *g = G(L);
     l_mem debt = getdebt(g);  /* GC deficit (be paid now) */
-    if (!g->gcrunning) {  /* not running? */
-        luaE_setdebt(g, -GCSTEPSIZE * 10);  /* avoid being called too often */
-        return;
-    }
     do {  /* repeat until pause or enough "credit" (negative debt) */
         lu_mem work = singlestep(L);  /* perform one single step */
         debt -= work;
@@ -1152,6 +1268,74 @@ void luaC_step(lua_State *L) {
 }
 
 
+/*
+** starts a major collection of generational mode, which runs in steps
+** as a normal cycle: it first sweeps all objects back to white and young
+** (as white has not changed, nothing is collected) and then marks them
+** again; its atomic phase returns to generational mode, so that the
+** final sweep makes the survivors old (see 'singlestep')
+*/
+static void entermajor(lua_State *L) {
+    global_State *g = G(L);
+    lua_assert(isgenerational(g) && g->gcstate == GCSpropagate);
+    g->gckind = KGC_NORMAL;
+    g->genmajor = 1;
+    entersweep(L);
+}
+
+
+/*
+** does a step of an incremental major collection. When the first sweep
+** ends, marking starts at once; when the final sweep ends, minor
+** collections resume. Returns whether the collection is over
+*/
+static int majorstep(lua_State *L) {
+    global_State *g = G(L);
+    incstep(L);
+    if (g->gcstate != GCSpause)
+        return 0;
+    if (!isgenerational(g)) {  /* all objects are white again? */
+        luaC_runtilstate(L, bitmask(GCSpropagate));  /* mark from the roots */
+        luaE_setdebt(g, -GCSTEPSIZE);  /* keep stepping (not a real pause) */
+        return 0;
+    }
+    g->genmajor = 0;
+    g->gcstate = GCSpropagate;  /* skip restart */
+    g->GCmajorbase = gettotalbytes(g);
+    setminorpause(g);
+    return 1;
+}
+
+
+/*
+** performs a basic GC step when collector is running
+*/
+void luaC_step(lua_State *L) {
+    global_State *g = G(L);
+    lu_mem start;
+    if (!g->gcrunning) {  /* not running? */
+        luaE_setdebt(g, -GCSTEPSIZE * 10);  /* avoid being called too often */
+        return;
+    }
+    start = gcclock();
+    if (isgenerational(g) && !g->genmajor && g->GCmajorbase == 0)
+        entermajor(L);  /* memory grew too much since the last major one */
+    if (g->genmajor) {
+        if (majorstep(L))
+            g->gcpauses.majors++;
+        else
+            g->gcpauses.steps++;
+    } else if (!isgenerational(g)) {
+        incstep(L);
+        g->gcpauses.steps++;
+    } else {
+        minorcollection(L);
+        g->gcpauses.minors++;
+    }
+    recordpause(g, start);
+}
+
+
 /*
 ** Performs a full GC cycle; if 'isemergency', set a flag to avoid
 ** some operations which could change the interpreter state in some
@@ -1159,24 +1343,75 @@ void luaC_step(lua_State *L) {
 ** Before running the collection, check 'keepinvariant'; if it is true,
 ** there may be some objects marked as black, so the collector has
 ** to sweep all objects to turn them back to white (as white has not
-** changed, nothing will be collected).
+** changed, nothing will be collected). In generational mode, that also
+** makes all objects young again, and (unless in an emergency) the
+** collection returns to generational mode in its atomic phase, so that
+** its survivors are old when it ends.
 */
 void luaC_fullgc(lua_State *L, int isemergency) {
     global_State *g = G(L);
-    lua_assert(g->gckind == KGC_NORMAL);
-    if (isemergency) g->gckind = KGC_EMERGENCY;  /* set flag */
-    if (keepinvariant(g)) {  /* black objects? */
+    int origkind = isgenmode(g) ? KGC_GEN : g->gckind;
+    int black = keepinvariant(g);  /* (always in generational mode) */
+    lu_mem start = gcclock();
+    lua_assert(origkind != KGC_EMERGENCY);
+    g->genmajor = 0;  /* this collection replaces a pending major one */
+    /* a full collection runs in normal mode */
+    g->gckind = isemergency ? KGC_EMERGENCY : KGC_NORMAL;
+    if (black) {  /* black objects? */
+        g->sweepgc = NULL;  /* (drop the sweep of a major collection) */
         entersweep(L); /* sweep everything to turn them back to white */
     }
     /* finish any pending sweep phase to start a new cycle */
     luaC_runtilstate(L, bitmask(GCSpause));
+    g->genmajor = (origkind == KGC_GEN && !isemergency);
     luaC_runtilstate(L, ~bitmask(GCSpause));  /* start new collection */
     luaC_runtilstate(L, bitmask(GCScallfin));  /* run up to finalizers */
     /* estimate must be correct after a full GC cycle */
     lua_assert(g->GCestimate == gettotalbytes(g));
     luaC_runtilstate(L, bitmask(GCSpause));  /* finish collection */
-    g->gckind = KGC_NORMAL;
-    setpause(g);
+    g->genmajor = 0;
+    if (origkind == KGC_GEN) {  /* generational mode? */
+        /* generational mode must be kept in propagate phase */
+        if (isgenerational(g))  /* survivors are old? */
+            g->gcstate = GCSpropagate;  /* skip restart */
+        else
+            luaC_runtilstate(L, bitmask(GCSpropagate));
+        g->GCmajorbase = gettotalbytes(g);
+    }
+    g->gckind = origkind;
+    if (isgenerational(g))
+        setminorpause(g);
+    else
+        setpause(g);
+    g->gcpauses.majors++;
+    recordpause(g, start);
+}
+
+
+/*
+** Changes the collector between generational mode (KGC_GEN) and
+** incremental mode (KGC_NORMAL). Generational mode starts with a major
+** collection, which continues the current cycle: its atomic phase makes
+** every survivor old, instead of a first minor collection doing that
+** over the whole heap in a single pause
+*/
+void luaC_changemode(lua_State *L, int mode) {
+    global_State *g = G(L);
+    if (mode == (isgenmode(g) ? KGC_GEN : KGC_NORMAL)) return;  /* nothing to change */
+    if (mode == KGC_GEN)  /* change to generational mode */
+        g->genmajor = 1;
+    else if (g->genmajor && !isgenerational(g))  /* major collection marking? */
+        g->genmajor = 0;  /* it just finishes as a normal cycle */
+    else {  /* change to incremental mode */
+        g->genmajor = 0;
+        /* sweep all objects to turn them back to white
+           (as white has not changed, nothing extra will be collected) */
+        g->gckind = KGC_NORMAL;
+        g->sweepgc = NULL;  /* (drop the sweep of a major collection) */
+        entersweep(L);
+        luaC_runtilstate(L, ~(bitmask(GCSswpallgc) | bitmask(GCSswpfinobj) |
+                              bitmask(GCSswptobefnz) | bitmask(GCSswpend)));
+    }
 }
 
 /* }====================================================== */
@@ -50,15 +50,21 @@
     (GCSswpallgc <= (g)->gcstate && (g)->gcstate <= GCSswpend)
 
 
+#define isgenerational(g)    ((g)->gckind == KGC_GEN)
+
+/* generational mode, maybe in the middle of an incremental major collection */
+#define isgenmode(g)    (isgenerational(g) || (g)->genmajor)
+
 /*
 ** macro to tell when main invariant (white objects cannot point to black
 ** ones) must be kept. During a collection, the sweep
 ** phase may break the invariant, as objects turned white may point to
 ** still-black objects. The invariant is restored when sweep ends and
-** all objects are white again.
+** all objects are white again. During a generational collection, the
+** invariant must be kept all times (old black objects are not swept).
 */
 
-#define keepinvariant(g)    ((g)->gcstate <= GCSatomic)
+#define keepinvariant(g)    (isgenerational(g) || (g)->gcstate <= GCSatomic)
 
 
 /*
@@ -79,6 +85,7 @@
 #define WHITE1BIT    1  /* object is white (type 1) */
 #define BLACKBIT    2  /* object is black */
 #define FINALIZEDBIT    3  /* object has been marked for finalization */
+#define OLDBIT    4  /* object is old (only in generational mode) */
 /* bit 7 is currently used by tests (luaL_checkmemory) */
 
 #define WHITEBITS    bit2mask(WHITE0BIT, WHITE1BIT)
@@ -91,6 +98,12 @@
 
 #define tofinalize(x)    testbit((x)->marked, FINALIZEDBIT)
 
+#define isold(x)    testbit((x)->marked, OLDBIT)
+
+/* MOVE OLD rule: whenever an object is moved to the beginning of
+   a GC list, its old bit must be cleared */
+#define resetoldbit(o)    resetbit((o)->marked, OLDBIT)
+
 #define otherwhite(g)    ((g)->currentwhite ^ WHITEBITS)
 #define isdeadm(ow, m)    (!(((m) ^ WHITEBITS) & (ow)))
 #define isdead(g, v)    isdeadm(otherwhite(g), (v)->marked)
@@ -141,6 +154,8 @@ LUAI_FUNC void luaC_runtilstate(lua_State *L, int statesmask);
 
 LUAI_FUNC void luaC_fullgc(lua_State *L, int isemergency);
 
+LUAI_FUNC void luaC_changemode(lua_State *L, int mode);
+
 LUAI_FUNC GCObject *luaC_newobj(lua_State *L, int tt, size_t sz);
 
 LUAI_FUNC void luaC_barrier_(lua_State *L, GCObject *o, GCObject *v);
@@ -34,6 +34,14 @@
 #define LUAI_GCMUL    200 /* GC runs 'twice the speed' of memory allocation */
 #endif
 
+#if !defined(LUAI_GCMAJOR)
+#define LUAI_GCMAJOR    200  /* 200% */
+#endif
+
+#if !defined(LUAI_GENMINORMUL)
+#define LUAI_GENMINORMUL    20  /* 20% */
+#endif
+
 
 /*
 ** a macro to help the creation of a unique random seed when a state is
@@ -245,6 +253,7 @@ static void close_state(lua_State *L) {
     if (g->version)  /* closing a fully built state? */
         luai_userstateclose(L);
     luaM_freearray(L, G(L)->strt.hash, G(L)->strt.size);
+    luaM_freearray(L, G(L)->strt.old, G(L)->strt.oldsize);
     freestack(L);
     lua_assert(gettotalbytes(g) == sizeof(LG));
     (*g->frealloc)(g->ud, fromstate(L), sizeof(LG), 0);  /* free main block */
@@ -309,9 +318,14 @@ LUA_API lua_State *lua_newstate(lua_Alloc f, void *ud) {
     g->mainthread = L;
     g->seed = makeseed(L);
     g->gcrunning = 0;  /* no GC while building state */
+    g->gcinfin = 0;
+    g->genmajor = 0;
     g->GCestimate = 0;
+    g->GCmajorbase = 0;
     g->strt.size = g->strt.nuse = 0;
     g->strt.hash = NULL;
+    g->strt.oldsize = g->strt.moved = 0;
+    g->strt.old = NULL;
     setnilvalue(&g->l_registry);
     g->panic = NULL;
     g->version = NULL;
@@ -327,6 +341,9 @@ LUA_API lua_State *lua_newstate(lua_Alloc f, void *ud) {
     g->gcfinnum = 0;
     g->gcpause = LUAI_GCPAUSE;
     g->gcstepmul = LUAI_GCMUL;
+    g->gcmajorinc = LUAI_GCMAJOR;
+    g->genminormul = LUAI_GENMINORMUL;
+    memset(&g->gcpauses, 0, sizeof(g->gcpauses));
     for (i = 0; i < LUA_NUMTAGS; i++) g->mt[i] = NULL;
     if (luaD_rawrunprotected(L, f_luaopen, NULL) != LUA_OK) {
         /* memory allocation error: free partial state */
@@ -73,12 +73,16 @@ struct lua_longjmp;  /* defined in ldo.c */
 /* kinds of Garbage Collection */
 #define KGC_NORMAL    0
 #define KGC_EMERGENCY    1    /* gc was forced by an allocation failure */
+#define KGC_GEN        2    /* generational collection */
 
 
 typedef struct stringtable {
     TString **hash;
     int nuse;  /* number of elements */
     int size;
+    TString **old;  /* previous array while a resize moves its buckets */
+    int oldsize;
+    int moved;  /* buckets of 'old' already moved into 'hash' */
 } stringtable;
 
 
@@ -143,6 +147,7 @@ typedef struct global_State {
     l_mem GCdebt;  /* bytes allocated not yet compensated by the collector */
     lu_mem GCmemtrav;  /* memory traversed by the GC */
     lu_mem GCestimate;  /* an estimate of the non-garbage memory in use */
+    lu_mem GCmajorbase;  /* memory in use after the last major collection (0 to force one) */
     stringtable strt;  /* hash table for strings */
     TValue l_registry;
     unsigned int seed;  /* randomized seed for hashes */
@@ -150,6 +155,8 @@ typedef struct global_State {
     lu_byte gcstate;  /* state of garbage collector */
     lu_byte gckind;  /* kind of GC running */
     lu_byte gcrunning;  /* true if GC is running */
+    lu_byte gcinfin;  /* true while a finalizer is running */
+    lu_byte genmajor;  /* true while a major collection of gen. mode runs as a normal cycle */
     GCObject *allgc;  /* list of all collectable objects */
     GCObject **sweepgc;  /* current position of sweep in list */
     GCObject *finobj;  /* list of collectable objects with finalizers */
@@ -164,6 +171,9 @@ typedef struct global_State {
     unsigned int gcfinnum;  /* number of finalizers to call in each GC step */
     int gcpause;  /* size of pause between successive GCs */
     int gcstepmul;  /* GC 'granularity' */
+    int gcmajorinc;  /* pause between major collections (only in gen. mode) */
+    int genminormul;  /* young memory allowed between minor collections (% of the heap) */
+    lua_GCPauseStats gcpauses;  /* how long the mutator was stopped by the collector */
     lua_CFunction panic;  /* to be called in unprotected errors */
     struct lua_State *mainthread;
     const lua_Number *version;  /* pointer to version number */
@@ -32,6 +32,153 @@
 #endif
 
 
+/*
+** LUA_FARMHASH hashes every byte of short strings with farmhash (the
+** portable 'farmhashmk' variant of Hash32WithSeed), instead of the
+** shift-xor hash above, which mixes keys with long common parts poorly.
+** Words are read in host order, hashes never leave the process
+*/
+#if defined(LUA_FARMHASH)
+
+#define FH_C1    0xcc9e2d51u
+#define FH_C2    0x1b873593u
+
+static unsigned int fh_fetch (const char *p) {
+    unsigned int v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static unsigned int fh_rotate (unsigned int v, int shift) {
+    return shift == 0 ? v : ((v >> shift) | (v << (32 - shift)));
+}
+
+static unsigned int fh_fmix (unsigned int h) {
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+static unsigned int fh_mur (unsigned int a, unsigned int h) {
+    a *= FH_C1;
+    a = fh_rotate(a, 17);
+    a *= FH_C2;
+    h ^= a;
+    h = fh_rotate(h, 19);
+    return h * 5 + 0xe6546b64u;
+}
+
+static unsigned int fh_len13to24 (const char *s, size_t len, unsigned int seed) {
+    unsigned int a = fh_fetch(s - 4 + (len >> 1));
+    unsigned int b = fh_fetch(s + 4);
+    unsigned int c = fh_fetch(s + len - 8);
+    unsigned int d = fh_fetch(s + (len >> 1));
+    unsigned int e = fh_fetch(s);
+    unsigned int f = fh_fetch(s + len - 4);
+    unsigned int h = d * FH_C1 + (unsigned int)len + seed;
+    a = fh_rotate(a, 12) + f;
+    h = fh_mur(c, h) + a;
+    a = fh_rotate(a, 3) + c;
+    h = fh_mur(e, h) + a;
+    a = fh_rotate(a + f, 12) + d;
+    h = fh_mur(b ^ seed, h) + a;
+    return fh_fmix(h);
+}
+
+static unsigned int fh_len0to4 (const char *s, size_t len, unsigned int seed) {
+    unsigned int b = seed;
+    unsigned int c = 9;
+    size_t i;
+    for (i = 0; i < len; i++) {
+        signed char v = (signed char)s[i];
+        b = b * FH_C1 + (unsigned int)v;
+        c ^= b;
+    }
+    return fh_fmix(fh_mur(b, fh_mur((unsigned int)len, c)));
+}
+
+static unsigned int fh_len5to12 (const char *s, size_t len, unsigned int seed) {
+    unsigned int a = (unsigned int)len, b = (unsigned int)len * 5, c = 9, d = b + seed;
+    a += fh_fetch(s);
+    b += fh_fetch(s + len - 4);
+    c += fh_fetch(s + ((len >> 1) & 4));
+    return fh_fmix(seed ^ fh_mur(c, fh_mur(b, fh_mur(a, d))));
+}
+
+static unsigned int fh_hash32 (const char *s, size_t len) {
+    unsigned int h, g, f, a0, a1, a2, a3, a4;
+    size_t iters;
+    if (len <= 24)
+        return len <= 12 ?
+               (len <= 4 ? fh_len0to4(s, len, 0) : fh_len5to12(s, len, 0)) :
+               fh_len13to24(s, len, 0);
+    h = (unsigned int)len; g = FH_C1 * h; f = g;
+    a0 = fh_rotate(fh_fetch(s + len - 4) * FH_C1, 17) * FH_C2;
+    a1 = fh_rotate(fh_fetch(s + len - 8) * FH_C1, 17) * FH_C2;
+    a2 = fh_rotate(fh_fetch(s + len - 16) * FH_C1, 17) * FH_C2;
+    a3 = fh_rotate(fh_fetch(s + len - 12) * FH_C1, 17) * FH_C2;
+    a4 = fh_rotate(fh_fetch(s + len - 20) * FH_C1, 17) * FH_C2;
+    h ^= a0;
+    h = fh_rotate(h, 19) * 5 + 0xe6546b64u;
+    h ^= a2;
+    h = fh_rotate(h, 19) * 5 + 0xe6546b64u;
+    g ^= a1;
+    g = fh_rotate(g, 19) * 5 + 0xe6546b64u;
+    g ^= a3;
+    g = fh_rotate(g, 19) * 5 + 0xe6546b64u;
+    f += a4;
+    f = fh_rotate(f, 19) + 113;
+    iters = (len - 1) / 20;
+    do {
+        unsigned int a = fh_fetch(s);
+        unsigned int b = fh_fetch(s + 4);
+        unsigned int c = fh_fetch(s + 8);
+        unsigned int d = fh_fetch(s + 12);
+        unsigned int e = fh_fetch(s + 16);
+        h += a;
+        g += b;
+        f += c;
+        h = fh_mur(d, h) + e;
+        g = fh_mur(c, g) + a;
+        f = fh_mur(b + e * FH_C1, f) + d;
+        f += g;
+        g += f;
+        s += 20;
+    } while (--iters != 0);
+    g = fh_rotate(g, 11) * FH_C1;
+    g = fh_rotate(g, 17) * FH_C1;
+    f = fh_rotate(f, 11) * FH_C1;
+    f = fh_rotate(f, 17) * FH_C1;
+    h = fh_rotate(h + g, 19) * 5 + 0xe6546b64u;
+    h = fh_rotate(h, 17) * FH_C1;
+    h = fh_rotate(h + f, 19) * 5 + 0xe6546b64u;
+    h = fh_rotate(h, 17) * FH_C1;
+    return h;
+}
+
+static unsigned int luai_farmhash32 (const char *s, size_t len, unsigned int seed) {
+    if (len <= 24) {
+        if (len >= 13) return fh_len13to24(s, len, seed * FH_C1);
+        else if (len >= 5) return fh_len5to12(s, len, seed);
+        else return fh_len0to4(s, len, seed);
+    }
+    return fh_mur(fh_hash32(s + 24, len - 24) + seed,
+                  fh_len13to24(s, 24, seed ^ (unsigned int)len));
+}
+
+#define shrhash(str, l, seed)    luai_farmhash32(str, l, seed)
+#else
+#define shrhash(str, l, seed)    luaS_hash(str, l, seed)
+#endif
+
+
+/* buckets moved by each new short string while the table is resized */
+#define MOVESTEP    4
+
+
 /*
 ** equality for long strings
 */
@@ -64,16 +211,38 @@ unsigned int luaS_hashlongstr(TString *ts) {
 
 
 /*
-** resizes the string table
+** moves up to 'n' buckets of the previous array into the current one,
+** freeing the previous array once it is empty
 */
-void luaS_resize(lua_State *L, int newsize) {
-    int i;
-    stringtable *tb = &G(L)->strt;
-    if (newsize > tb->size) {  /* grow table if needed */
-        luaM_reallocvector(L, tb->hash, tb->size, newsize, TString *);
-        for (i = tb->size; i < newsize; i++)
-            tb->hash[i] = NULL;
+static void movebuckets(lua_State *L, stringtable *tb, int n) {
+    if (tb->old == NULL) return;
+    for (; n > 0 && tb->moved < tb->oldsize; n--) {
+        TString *p = tb->old[tb->moved];
+        tb->old[tb->moved++] = NULL;
+        while (p) {  /* for each node in the list */
+            TString *hnext = p->u.hnext;  /* save next */
+            unsigned int h = lmod(p->hash, tb->size);  /* new position */
+            p->u.hnext = tb->hash[h];  /* chain it */
+            tb->hash[h] = p;
+            p = hnext;
+        }
     }
+    if (tb->moved == tb->oldsize) {
+        luaM_freearray(L, tb->old, tb->oldsize);
+        tb->old = NULL;
+        tb->oldsize = tb->moved = 0;
+    }
+}
+
+
+/*
+** shrinks the string table in place like the stock one. It runs inside a
+** collection step, so it must not allocate: only the previous array is
+** freed and the current one reallocated down, which cannot fail
+*/
+static void shrinktable(lua_State *L, stringtable *tb, int newsize) {
+    int i;
+    movebuckets(L, tb, tb->oldsize);  /* finish a previous resize */
     for (i = 0; i < tb->size; i++) {  /* rehash */
         TString *p = tb->hash[i];
         tb->hash[i] = NULL;
@@ -85,12 +254,63 @@ void luaS_resize(lua_State *L, int newsize) {
             p = hnext;
         }
     }
-    if (newsize < tb->size) {  /* shrink table if needed */
-        /* vanishing slice should be empty */
-        lua_assert(tb->hash[newsize] == NULL && tb->hash[tb->size - 1] == NULL);
-        luaM_reallocvector(L, tb->hash, tb->size, newsize, TString *);
+    lua_assert(tb->hash[newsize] == NULL && tb->hash[tb->size - 1] == NULL);
+    luaM_reallocvector(L, tb->hash, tb->size, newsize, TString *);
+    tb->size = newsize;
+}
+
+
+/*
+** resizes the string table. A growing table is not rehashed at once: the
+** buckets of the previous array are moved a few at a time by the next
+** insertions, and until then lookups also check their bucket there.
+*/
+void luaS_resize(lua_State *L, int newsize) {
+    int i;
+    stringtable *tb = &G(L)->strt;
+    TString **hash;
+    if (newsize < tb->size) {
+        shrinktable(L, tb, newsize);
+        return;
     }
+    movebuckets(L, tb, tb->oldsize);  /* finish a previous resize */
+    hash = luaM_newvector(L, newsize, TString *);
+    for (i = 0; i < newsize; i++)
+        hash[i] = NULL;
+    tb->old = tb->hash;
+    tb->oldsize = tb->size;
+    tb->moved = 0;
+    tb->hash = hash;
     tb->size = newsize;
+    movebuckets(L, tb, MOVESTEP);
+}
+
+
+/*
+** pointer to the link holding 'ts' in the chain of 'p', or NULL
+*/
+static TString **findlink(TString **p, TString *ts) {
+    while (*p != NULL && *p != ts)
+        p = &(*p)->u.hnext;
+    return *p == NULL ? NULL : p;
+}
+
+
+void luaS_stats(lua_State *L, lua_StrTabStats *stats) {
+    stringtable *tb = &G(L)->strt;
+    int i;
+    memset(stats, 0, sizeof(lua_StrTabStats));
+    stats->size = tb->size;
+    stats->nuse = tb->nuse;
+    stats->moving = tb->oldsize - tb->moved;
+    for (i = -stats->moving; i < tb->size; i++) {
+        int n = 0;
+        TString *p = i < 0 ? tb->old[tb->oldsize + i] : tb->hash[i];
+        for (; p != NULL; p = p->u.hnext)
+            n++;
+        if (n > stats->maxchain) stats->maxchain = n;
+        stats->chains[n < LUA_STRTABHIST ? n : LUA_STRTABHIST - 1]++;
+    }
 }
 
 
@@ -150,24 +370,22 @@ TString *luaS_createlngstrobj(lua_State *L, size_t l) {
 
 void luaS_remove(lua_State *L, TString *ts) {
     stringtable *tb = &G(L)->strt;
-    TString **p = &tb->hash[lmod(ts->hash, tb->size)];
-    while (*p != ts)  /* find previous element */
-        p = &(*p)->u.hnext;
+    TString **p = NULL;
+    if (tb->old != NULL) {  /* may still be in the previous array */
+        int i = lmod(ts->hash, tb->oldsize);
+        if (i >= tb->moved)
+            p = findlink(&tb->old[i], ts);
+    }
+    if (p == NULL)
+        p = findlink(&tb->hash[lmod(ts->hash, tb->size)], ts);
+    lua_assert(p != NULL);
     *p = (*p)->u.hnext;  /* remove element from its list */
     tb->nuse--;
 }
 
 
-/*
-** checks whether short string exists and reuses it or creates a new one
-*/
-static TString *internshrstr(lua_State *L, const char *str, size_t l) {
-    TString *ts;
-    global_State *g = G(L);
-    unsigned int h = luaS_hash(str, l, g->seed);
-    TString **list = &g->strt.hash[lmod(h, g->strt.size)];
-    lua_assert(str != NULL);  /* otherwise 'memcmp'/'memcpy' are undefined */
-    for (ts = *list; ts != NULL; ts = ts->u.hnext) {
+static TString *findshrstr(global_State *g, TString *ts, const char *str, size_t l) {
+    for (; ts != NULL; ts = ts->u.hnext) {
         if (l == ts->shrlen &&
             (memcmp(str, getstr(ts), l * sizeof(char)) == 0)) {
             /* found! */
@@ -176,16 +394,39 @@ static TString *internshrstr(lua_State *L, const char *str, size_t l) {
             return ts;
         }
     }
-    if (g->strt.nuse >= g->strt.size && g->strt.size <= MAX_INT / 2) {
-        luaS_resize(L, g->strt.size * 2);
-        list = &g->strt.hash[lmod(h, g->strt.size)];  /* recompute with new size */
+    return NULL;
+}
+
+
+/*
+** checks whether short string exists and reuses it or creates a new one
+*/
+static TString *internshrstr(lua_State *L, const char *str, size_t l) {
+    TString *ts;
+    global_State *g = G(L);
+    stringtable *tb = &g->strt;
+    unsigned int h = shrhash(str, l, g->seed);
+    TString **list;
+    lua_assert(str != NULL);  /* otherwise 'memcmp'/'memcpy' are undefined */
+    if (tb->old != NULL) {  /* bucket not moved yet? */
+        int i = lmod(h, tb->oldsize);
+        if (i >= tb->moved && (ts = findshrstr(g, tb->old[i], str, l)) != NULL)
+            return ts;
     }
+    ts = findshrstr(g, tb->hash[lmod(h, tb->size)], str, l);
+    if (ts != NULL)
+        return ts;
+    if (tb->old != NULL)
+        movebuckets(L, tb, MOVESTEP);
+    else if (tb->nuse >= tb->size && tb->size <= MAX_INT / 2)
+        luaS_resize(L, tb->size * 2);
+    list = &tb->hash[lmod(h, tb->size)];
     ts = createstrobj(L, l, LUA_TSHRSTR, h);
     memcpy(getstr(ts), str, l * sizeof(char));
     ts->shrlen = cast_byte(l);
     ts->u.hnext = *list;
     *list = ts;
-    g->strt.nuse++;
+    tb->nuse++;
     return ts;
 }
 
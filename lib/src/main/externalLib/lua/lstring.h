@@ -41,6 +41,8 @@ LUAI_FUNC int luaS_eqlngstr(TString *a, TString *b);
 
 LUAI_FUNC void luaS_resize(lua_State *L, int newsize);
 
+LUAI_FUNC void luaS_stats(lua_State *L, lua_StrTabStats *stats);
+
 LUAI_FUNC void luaS_clearcache(global_State *g);
 
 LUAI_FUNC void luaS_init(lua_State *L);
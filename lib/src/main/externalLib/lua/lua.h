@@ -362,11 +362,50 @@ LUA_API int (lua_isyieldable)(lua_State *L);
 #define LUA_GCSTEP        5
 #define LUA_GCSETPAUSE        6
 #define LUA_GCSETSTEPMUL    7
+#define LUA_GCSETMAJORINC    8
 #define LUA_GCISRUNNING        9
+#define LUA_GCGEN        10
+#define LUA_GCINC        11
 
 LUA_API int (lua_gc)(lua_State *L, int what, int data);
 
 
+/*
+** statistics of the short string table (not in stock lua)
+*/
+#define LUA_STRTABSTATS
+#define LUA_STRTABHIST    8
+
+typedef struct lua_StrTabStats {
+    int size;  /* number of buckets */
+    int nuse;  /* number of strings */
+    int moving;  /* buckets of the previous array still to be moved */
+    int maxchain;  /* longest collision chain */
+    int chains[LUA_STRTABHIST];  /* buckets with i strings, the last also counts longer chains */
+} lua_StrTabStats;
+
+LUA_API void (lua_strtabstats)(lua_State *L, lua_StrTabStats *stats);
+
+
+/*
+** pauses of the garbage collector (not in stock lua)
+*/
+#define LUA_GCPAUSESTATS
+#define LUA_GCPAUSEHIST    8
+
+typedef struct lua_GCPauseStats {
+    int generational;  /* true if the collector is in generational mode */
+    unsigned long steps;  /* incremental steps */
+    unsigned long minors;  /* minor collections in generational mode */
+    unsigned long majors;  /* full collections */
+    unsigned long maxpause;  /* longest pause in microseconds */
+    unsigned long totalpause;  /* sum of all pauses in microseconds */
+    unsigned long pauses[LUA_GCPAUSEHIST];  /* pauses shorter than 16<<(2*i) us, the last counts the longer ones too */
+} lua_GCPauseStats;
+
+LUA_API void (lua_gcpausestats)(lua_State *L, lua_GCPauseStats *stats, int reset);
+
+
 /*
 ** miscellaneous functions
 */
@@ -755,6 +755,10 @@ void luaV_finishOp(lua_State *L) {
 /* for test instructions, execute the jump instruction that follows it */
 #define donextjump(ci)    { i = *ci->u.l.savedpc; dojump(ci, i, 1); }
 
+/* comparison already done in place, then the same as above */
+#define fusedjump(ci, i, res) \
+  { if ((res) != GETARG_A(i)) ci->u.l.savedpc++; else donextjump(ci); }
+
 
 #define Protect(x)    { {x;}; base = ci->u.l.base; }
 
@@ -779,6 +783,37 @@ void luaV_finishOp(lua_State *L) {
 #define vmbreak        break
 
 
+/*
+** LUA_USE_JUMPTABLE selects the computed goto dispatch, where each
+** opcode jumps to the next one itself. It is on by default with
+** gcc/clang; define it as 0 to get the switch back.
+*/
+#if !defined(LUA_USE_JUMPTABLE)
+#if defined(__GNUC__)
+#define LUA_USE_JUMPTABLE    1
+#else
+#define LUA_USE_JUMPTABLE    0
+#endif
+#endif
+
+
+/*
+** LUA_USE_SUPERINSTRUCTIONS fuses hot instruction pairs: the first one
+** runs the second straight from its label 'lb' when the second has
+** opcode 'o', skipping a dispatch. The bytecode is left as it is, so
+** dumps and debug info don't change. Hooks always take the normal path.
+*/
+#if defined(LUA_USE_SUPERINSTRUCTIONS)
+#define vmfuse(o, lb)    { Instruction ni = *ci->u.l.savedpc; \
+  if (GET_OPCODE(ni) == (o) && !(L->hookmask & (LUA_MASKLINE | LUA_MASKCOUNT))) { \
+    i = ni; ci->u.l.savedpc++; ra = RA(i); goto lb; } }
+#define vmfuselabel(lb)    lb:
+#else
+#define vmfuse(o, lb)    ((void)0)
+#define vmfuselabel(lb)
+#endif
+
+
 /*
 ** copy of 'luaV_gettable', but protecting the call to potential
 ** metamethod (which can reallocate the stack)
@@ -805,6 +840,9 @@ void luaV_execute(lua_State *L) {
     cl = clLvalue(ci->func);  /* local reference to function's closure */
     k = cl->p->k;  /* local reference to function's constant table */
     base = ci->u.l.base;  /* local copy of function's base */
+#if LUA_USE_JUMPTABLE
+#include "ljumptab.h"
+#endif
     /* main loop of interpreter */
     for (;;) {
         Instruction i;
@@ -848,12 +886,14 @@ void luaV_execute(lua_State *L) {
                 TValue *upval = cl->upvals[GETARG_B(i)]->v;
                 TValue *rc = RKC(i);
                 gettableProtected(L, upval, rc, ra);
+                vmfuse(OP_CALL, l_call);
                 vmbreak;
             }
             vmcase(OP_GETTABLE) {
                 StkId rb = RB(i);
                 TValue *rc = RKC(i);
                 gettableProtected(L, rb, rc, ra);
+                vmfuse(OP_CALL, l_call);
                 vmbreak;
             }
             vmcase(OP_SETTABUP) {
@@ -873,6 +913,7 @@ void luaV_execute(lua_State *L) {
                 TValue *rb = RKB(i);
                 TValue *rc = RKC(i);
                 settableProtected(L, ra, rb, rc);
+                vmfuse(OP_FORLOOP, l_forloop);
                 vmbreak;
             }
             vmcase(OP_NEWTABLE) {
@@ -894,6 +935,7 @@ void luaV_execute(lua_State *L) {
                 if (luaV_fastget(L, rb, key, aux, luaH_getstr)) {
                     setobj2s(L, ra, aux);
                 } else Protect(luaV_finishget(L, rb, rc, ra, aux));
+                vmfuse(OP_CALL, l_call);
                 vmbreak;
             }
             vmcase(OP_ADD) {
@@ -908,6 +950,7 @@ void luaV_execute(lua_State *L) {
                 } else if (tonumber(rb, &nb) && tonumber(rc, &nc)) {
                     setfltvalue(ra, luai_numadd(L, nb, nc));
                 } else {Protect(luaT_trybinTM(L, rb, rc, ra, TM_ADD)); }
+                vmfuse(OP_FORLOOP, l_forloop);
                 vmbreak;
             }
             vmcase(OP_SUB) {
@@ -922,6 +965,7 @@ void luaV_execute(lua_State *L) {
                 } else if (tonumber(rb, &nb) && tonumber(rc, &nc)) {
                     setfltvalue(ra, luai_numsub(L, nb, nc));
                 } else {Protect(luaT_trybinTM(L, rb, rc, ra, TM_SUB)); }
+                vmfuse(OP_FORLOOP, l_forloop);
                 vmbreak;
             }
             vmcase(OP_MUL) {
@@ -936,6 +980,7 @@ void luaV_execute(lua_State *L) {
                 } else if (tonumber(rb, &nb) && tonumber(rc, &nc)) {
                     setfltvalue(ra, luai_nummul(L, nb, nc));
                 } else {Protect(luaT_trybinTM(L, rb, rc, ra, TM_MUL)); }
+                vmfuse(OP_FORLOOP, l_forloop);
                 vmbreak;
             }
             vmcase(OP_DIV) {  /* float division (always with floats) */
@@ -1091,6 +1136,16 @@ void luaV_execute(lua_State *L) {
             vmcase(OP_EQ) {
                 TValue *rb = RKB(i);
                 TValue *rc = RKC(i);
+#if defined(LUA_USE_SUPERINSTRUCTIONS)
+                if (ttisinteger(rb) && ttisinteger(rc)) {
+                    fusedjump(ci, i, ivalue(rb) == ivalue(rc));
+                    vmbreak;
+                }
+                if (ttisshrstring(rb) && ttisshrstring(rc)) {
+                    fusedjump(ci, i, eqshrstr(tsvalue(rb), tsvalue(rc)));
+                    vmbreak;
+                }
+#endif
                 Protect(
                         if (luaV_equalobj(L, rb, rc) != GETARG_A(i))
                             ci->u.l.savedpc++;
@@ -1100,6 +1155,18 @@ void luaV_execute(lua_State *L) {
                 vmbreak;
             }
             vmcase(OP_LT) {
+#if defined(LUA_USE_SUPERINSTRUCTIONS)
+                TValue *rb = RKB(i);
+                TValue *rc = RKC(i);
+                if (ttisinteger(rb) && ttisinteger(rc)) {
+                    fusedjump(ci, i, ivalue(rb) < ivalue(rc));
+                    vmbreak;
+                }
+                if (ttisfloat(rb) && ttisfloat(rc)) {
+                    fusedjump(ci, i, luai_numlt(fltvalue(rb), fltvalue(rc)));
+                    vmbreak;
+                }
+#endif
                 Protect(
                         if (luaV_lessthan(L, RKB(i), RKC(i)) != GETARG_A(i))
                             ci->u.l.savedpc++;
@@ -1109,6 +1176,18 @@ void luaV_execute(lua_State *L) {
                 vmbreak;
             }
             vmcase(OP_LE) {
+#if defined(LUA_USE_SUPERINSTRUCTIONS)
+                TValue *rb = RKB(i);
+                TValue *rc = RKC(i);
+                if (ttisinteger(rb) && ttisinteger(rc)) {
+                    fusedjump(ci, i, ivalue(rb) <= ivalue(rc));
+                    vmbreak;
+                }
+                if (ttisfloat(rb) && ttisfloat(rc)) {
+                    fusedjump(ci, i, luai_numle(fltvalue(rb), fltvalue(rc)));
+                    vmbreak;
+                }
+#endif
                 Protect(
                         if (luaV_lessequal(L, RKB(i), RKC(i)) != GETARG_A(i))
                             ci->u.l.savedpc++;
@@ -1133,7 +1212,7 @@ void luaV_execute(lua_State *L) {
                 }
                 vmbreak;
             }
-            vmcase(OP_CALL) {
+            vmcase(OP_CALL) vmfuselabel(l_call) {
                 int b = GETARG_B(i);
                 int nresults = GETARG_C(i) - 1;
                 if (b != 0) L->top = ra + b;  /* else previous instruction set top */
@@ -1191,7 +1270,7 @@ void luaV_execute(lua_State *L) {
                     goto newframe;  /* restart luaV_execute over new Lua function */
                 }
             }
-            vmcase(OP_FORLOOP) {
+            vmcase(OP_FORLOOP) vmfuselabel(l_forloop) {
                 if (ttisinteger(ra)) {  /* integer loop? */
                     lua_Integer step = ivalue(ra + 2);
                     lua_Integer idx = intop(+, ivalue(ra), step); /* increment index */
@@ -12,7 +12,6 @@ import java.io.IOException;
 import java.lang.annotation.ElementType;
 import java.lang.reflect.Constructor;
 import java.lang.reflect.Field;
-import java.lang.reflect.InvocationHandler;
 import java.lang.reflect.Method;
 import java.lang.reflect.Modifier;
 import java.util.ArrayList;
@@ -32,15 +31,6 @@ public class ClassBuilder {
     private static Object sUnsafe;
     private static Method sAllocInstance;
     private static final Map<TypeId<?>, TypeId<?>> PRIMITIVE_TO_BOXED;
-    private static final Map<TypeId<?>, MethodId<?, ?>> PRIMITIVE_TYPE_TO_BOX_METHOD;
-    /**
-     * Map from primitive type to method used to unbox a boxed version of the primitive.
-     * <p>
-     * This is required for methods whose return type is primitive, since the
-     * {@link InvocationHandler} will return us a boxed result, and we'll need to convert it back to
-     * primitive value.
-     */
-    private static final Map<TypeId<?>, MethodId<?, ?>> PRIMITIVE_TO_UNBOX_METHOD;
     private static final String FUNC_REFS = "$_funcRefs_";
 
     static {
@@ -55,29 +45,6 @@ public class ClassBuilder {
         PRIMITIVE_TO_BOXED.put(TypeId.CHAR, TypeId.get(Character.class));
     }
 
-    static {
-        PRIMITIVE_TYPE_TO_BOX_METHOD = new HashMap<>();
-        for (Map.Entry<TypeId<?>, TypeId<?>> entry : PRIMITIVE_TO_BOXED.entrySet()) {
-            TypeId<?> primitiveType = entry.getKey();
-            TypeId<?> boxedType = entry.getValue();
-            MethodId<?, ?> valueOfMethod = boxedType.getMethod(boxedType, "valueOf", primitiveType);
-            PRIMITIVE_TYPE_TO_BOX_METHOD.put(primitiveType, valueOfMethod);
-        }
-    }
-
-    static {
-        Map<TypeId<?>, MethodId<?, ?>> map = new HashMap<>();
-        map.put(TypeId.BOOLEAN, TypeId.get(Boolean.class).getMethod(TypeId.BOOLEAN, "booleanValue"));
-        map.put(TypeId.INT, TypeId.get(Integer.class).getMethod(TypeId.INT, "intValue"));
-        map.put(TypeId.BYTE, TypeId.get(Byte.class).getMethod(TypeId.BYTE, "byteValue"));
-        map.put(TypeId.LONG, TypeId.get(Long.class).getMethod(TypeId.LONG, "longValue"));
-        map.put(TypeId.SHORT, TypeId.get(Short.class).getMethod(TypeId.SHORT, "shortValue"));
-        map.put(TypeId.FLOAT, TypeId.get(Float.class).getMethod(TypeId.FLOAT, "floatValue"));
-        map.put(TypeId.DOUBLE, TypeId.get(Double.class).getMethod(TypeId.DOUBLE, "doubleValue"));
-        map.put(TypeId.CHAR, TypeId.get(Character.class).getMethod(TypeId.CHAR, "charValue"));
-        PRIMITIVE_TO_UNBOX_METHOD = map;
-    }
-
     private DexMaker maker;
     private TypeId<?> type;
     private Class superType;
@@ -255,35 +222,6 @@ public class ClassBuilder {
         return "Lgenerated" + (int) (Math.random() * 1000) + ";";
     }
 
-    private static void generateCodeForReturnStatement(Code code, TypeId<?> methodReturnType,
-                                                       Local<?> localForResultOfInvoke,Local aBoxedResult,
-                                                       Local localOfMethodReturnType) {
-        if (PRIMITIVE_TO_BOXED.containsKey(methodReturnType)) {
-            code.cast(aBoxedResult, localForResultOfInvoke);
-            MethodId<Object,?> unboxingMethodFor = (MethodId<Object, ?>) getUnboxMethodForPrimitive(methodReturnType);
-            code.invokeVirtual(unboxingMethodFor, localOfMethodReturnType, aBoxedResult);
-            code.returnValue(localOfMethodReturnType);
-        } else if (TypeId.VOID.equals(methodReturnType)) {
-            code.returnVoid();
-        } else {
-            code.cast(localOfMethodReturnType, localForResultOfInvoke);
-            code.returnValue(localOfMethodReturnType);
-        }
-    }
-
-    private static MethodId<?, ?> getUnboxMethodForPrimitive(TypeId<?> methodReturnType) {
-        return PRIMITIVE_TO_UNBOX_METHOD.get(methodReturnType);
-    }
-
-    private static Local<?> boxIfRequired(Code code, Local<?> parameter, Local<Object> temp) {
-        MethodId<?, ?> unboxMethod = PRIMITIVE_TYPE_TO_BOX_METHOD.get(parameter.getType());
-        if (unboxMethod == null) {
-            return parameter;
-        }
-        code.invokeStatic(unboxMethod, temp, parameter);
-        return temp;
-    }
-
     private static String qualifyName(String name) {
         name = name.substring(1, name.length() - 1);
         name = name.replace('/', '.');
@@ -433,34 +371,77 @@ public class ClassBuilder {
 
     private void generateCode(Code code, int pos, TypeId returnType, TypeId<?>[] argTypes) {
         FieldId funcRefs = type.getField(TypeId.get(ScriptContext.Func[].class), FUNC_REFS);
-        Local<Integer> v0 = code.newLocal(TypeId.INT);
-        Local<Object> v1 = code.newLocal(TypeId.get(Object.class));
-        Local<Object[]> v2 = code.newLocal(TypeId.get(Object[].class));
-        Local<Object> temp = code.newLocal(TypeId.OBJECT);
         TypeId<ScriptContext.Func> funcTypeId = TypeId.get(ScriptContext.Func.class);
-        Local<ScriptContext.Func> v4 = code.newLocal(funcTypeId);
-        TypeId<?> boxType = PRIMITIVE_TO_BOXED.get(returnType);
-        Local<?> aBoxedResult=null;
-        if(boxType!=null)
-            aBoxedResult = code.newLocal(boxType);
-        Local<Object> localOfMethodReturnType = (Local<Object>) code.newLocal(returnType);
+        TypeId<ScriptContext.ArgFrame> frameTypeId = TypeId.get(ScriptContext.ArgFrame.class);
+        Local<Integer> v0 = code.newLocal(TypeId.INT);
+        Local<Object> v1 = code.newLocal(TypeId.OBJECT);
+        Local<ScriptContext.Func> func = code.newLocal(funcTypeId);
+        Local<ScriptContext.ArgFrame> frame = code.newLocal(frameTypeId);
+        TypeId<?> callType = getDirectCallType(returnType);
+        Local result = callType == TypeId.VOID ? null : code.newLocal(callType);
+        Local intResult = null;
+        Local castResult = null;
+        if (callType == TypeId.LONG && returnType != TypeId.LONG) {
+            if (returnType != TypeId.INT)
+                intResult = code.newLocal(TypeId.INT);
+            castResult = code.newLocal(returnType);
+        } else if (returnType == TypeId.FLOAT || callType == TypeId.OBJECT && !TypeId.OBJECT.equals(returnType)) {
+            castResult = code.newLocal(returnType);
+        }
         Local<?> thiz = code.getThis(this.type);
         code.loadConstant(v0, pos);
         code.iget(funcRefs, v1, thiz);
         code.aget(v1, v1, v0);
-        code.loadConstant(v0, argTypes.length);
-        code.newArray(v2, v0);
+        code.cast(func, v1);
+        code.invokeVirtual(funcTypeId.getMethod(frameTypeId, "frame"), frame, func);
         for (int p = 0; p < argTypes.length; ++p) {
             code.loadConstant(v0, p);
             Local<?> parameter = code.getParameter(p, argTypes[p]);
-            Local<?> unboxedIfNecessary = boxIfRequired(code, parameter, temp);
-            code.aput(v2, v0, unboxedIfNecessary);
+            MethodId<ScriptContext.ArgFrame, Void> setter = frameTypeId.getMethod(TypeId.VOID, "set",
+                    TypeId.INT, getFrameSlotType(argTypes[p]));
+            code.invokeVirtual(setter, null, frame, v0, parameter);
+        }
+        String callName = callType == TypeId.DOUBLE ? "callDouble" : callType == TypeId.BOOLEAN ? "callBoolean"
+                : callType == TypeId.OBJECT ? "callObject" : "callLong";
+        TypeId<?> callReturn = callType == TypeId.VOID ? TypeId.LONG : callType;
+        code.invokeVirtual(funcTypeId.getMethod(callReturn, callName, TypeId.OBJECT, frameTypeId),
+                result, func, thiz, frame);
+        if (result == null) {
+            code.returnVoid();
+            return;
+        }
+        if (castResult == null) {
+            code.returnValue(result);
+            return;
         }
-        MethodId<ScriptContext.Func, Object> methodId = funcTypeId.getMethod(TypeId.OBJECT, "call", TypeId.OBJECT,
-                TypeId.get(Object[].class));
-        code.cast(v4, v1);
-        code.invokeVirtual(methodId, v1, v4, thiz, v2);
-        generateCodeForReturnStatement(code, returnType, v1,aBoxedResult,localOfMethodReturnType);
+        if (intResult != null) {
+            code.cast(intResult, result);
+            result = intResult;
+        }
+        code.cast(castResult, result);
+        code.returnValue(castResult);
+    }
+
+    /**
+     * Generated methods write args into {@link ScriptContext.ArgFrame} and get primitive
+     * results back unboxed,only object returns need to be fixed in java.
+     */
+    private static TypeId<?> getDirectCallType(TypeId<?> returnType) {
+        if (returnType == TypeId.VOID || returnType == TypeId.BOOLEAN || returnType == TypeId.DOUBLE)
+            return returnType;
+        if (returnType == TypeId.FLOAT)
+            return TypeId.DOUBLE;
+        if (PRIMITIVE_TO_BOXED.containsKey(returnType))
+            return TypeId.LONG;
+        return TypeId.OBJECT;
+    }
+
+    private static TypeId<?> getFrameSlotType(TypeId<?> argType) {
+        if (argType == TypeId.BYTE || argType == TypeId.SHORT)
+            return TypeId.INT;
+        if (PRIMITIVE_TO_BOXED.containsKey(argType))
+            return argType;
+        return TypeId.OBJECT;
     }
 
     private List<AnnotationId<?, ?>> getAnnotationIds(List<Map<Object, Object>> annotations, ElementType elementType) {
@@ -1,24 +1,44 @@
 package com.oslorde.luadroid;
 
-import java.lang.reflect.Array;
 import java.util.*;
-import java.util.ListIterator;
 
+/**
+ * Insertion ordered map of the lua tables passed to java.
+ * Entries are kept in put order in an array and found through an open addressed
+ * table of their positions.Removed entries leave holes,which are compacted
+ * when the array is full.
+ */
 class DataMap<K,V> implements Map<K,V> ,Iterable<DataMap.CustomEntry<K,V>>{
-    private ArrayList<CustomEntry<K,V>> entries;
+    private CustomEntry<K,V>[] entries;
+    private int used;//taken slots of entries,holes included
+    private int size;
+    private int[] index;//position+1 of an entry,0 for a free slot
+    private int mask;
 
-    //DataMap(){entries=new ArrayList<>();}
+    //DataMap(){this(4);}
     DataMap(int len){
-        entries=new ArrayList<>(len);
+        entries=newEntries(Math.max(len,4));
+        rebuildIndex();
     }
+
+    @SuppressWarnings("unchecked")
+    private static <K,V> CustomEntry<K,V>[] newEntries(int len){
+        return (CustomEntry<K,V>[]) new CustomEntry[len];
+    }
+
+    private static int hash(Object key){
+        int h=key==null?0:key.hashCode()*0x9E3779B9;
+        return h^(h>>>16);
+    }
+
     @Override
     public int size() {
-        return entries.size();
+        return size;
     }
 
     @Override
     public boolean isEmpty() {
-        return entries.isEmpty();
+        return size==0;
     }
 
     private static boolean Equals(Object f,Object s){
@@ -26,77 +46,164 @@ class DataMap<K,V> implements Map<K,V> ,Iterable<DataMap.CustomEntry<K,V>>{
         return f.equals(s);
     }
 
+    //the slot holding the key,or ~slot of the free slot it would take
+    private int findSlot(Object key,int hash){
+        for(int slot=hash&mask;;slot=(slot+1)&mask){
+            int pos=index[slot];
+            if(pos==0) return ~slot;
+            CustomEntry<K,V> entry=entries[pos-1];
+            if(entry.hash==hash&&Equals(entry.key,key))
+                return slot;
+        }
+    }
+
+    private CustomEntry<K,V> find(Object key){
+        int slot=findSlot(key,hash(key));
+        return slot<0?null:entries[index[slot]-1];
+    }
+
+    //less than half of the index is ever taken
+    private void rebuildIndex(){
+        int capacity=Integer.highestOneBit(entries.length)<<2;
+        if(index==null||index.length!=capacity)
+            index=new int[capacity];
+        else Arrays.fill(index,0);
+        mask=capacity-1;
+        for(int i=0;i<used;++i){
+            CustomEntry<K,V> entry=entries[i];
+            if(entry==null) continue;
+            int slot=findSlot(entry.key,entry.hash);
+            if(slot>=0){//keys changed into an earlier one,the later entry wins
+                entries[index[slot]-1]=null;
+                --size;
+                index[slot]=i+1;
+            }else index[~slot]=i+1;
+        }
+    }
+
+    private void resize(int len){
+        CustomEntry<K,V>[] old=entries;
+        entries=newEntries(len);
+        int count=0;
+        for(int i=0;i<used;++i){
+            if(old[i]!=null) entries[count++]=old[i];
+        }
+        used=count;
+        rebuildIndex();
+    }
+
+    //called after keys are changed through CustomEntry.setKey
+    void rehash(){
+        for(int i=0;i<used;++i){
+            CustomEntry<K,V> entry=entries[i];
+            if(entry!=null) entry.hash=hash(entry.key);
+        }
+        rebuildIndex();
+    }
+
     @Override
     public boolean containsKey( Object key) {
-      return indexOf(key)!=-1;
+        return findSlot(key,hash(key))>=0;
     }
 
     @Override
     public boolean containsValue( Object value) {
-        for(int i=entries.size()-1;i>=0;--i){
-            if(Equals(entries.get(i).getValue(),value))
+        for(int i=used-1;i>=0;--i){
+            CustomEntry<K,V> entry=entries[i];
+            if(entry!=null&&Equals(entry.value,value))
                 return true;
         }
         return false;
     }
 
-    private int indexOf(Object key){
-        for(int i=entries.size()-1;i>=0;--i){
-            CustomEntry<K,V> entry = entries.get(i);
-            if(Equals(entry.getKey(),key))
-                return i;
-        }
-        return -1;
-    }
-    
     @Override
     public V get( Object key) {
-        for(int i=entries.size()-1;i>=0;--i){
-            CustomEntry<K,V> entry = entries.get(i);
-            if(Equals(entry.getKey(),key))
-                return entry.getValue();
-        }
-        return null;
+        CustomEntry<K,V> entry=find(key);
+        return entry==null?null:entry.value;
     }
 
-    
     @Override
     public V put( K key,  V value) {
-       entries.add(new CustomEntry<>(key,value));
-        return null;//never check for duplicate value
+        int hash=hash(key);
+        int slot=findSlot(key,hash);
+        if(slot>=0)
+            return entries[index[slot]-1].setValue(value);
+        if(used==entries.length){
+            resize(size<used>>1?entries.length:entries.length<<1);
+            slot=findSlot(key,hash);
+        }
+        entries[used]=new CustomEntry<>(key,value,hash);
+        index[~slot]=++used;
+        ++size;
+        return null;
     }
 
-    
     @Override
     public V remove( Object key) {
-        int index=indexOf(key);
-        return entries.remove(index).value;
+        int slot=findSlot(key,hash(key));
+        if(slot<0) return null;
+        int pos=index[slot]-1;
+        CustomEntry<K,V> entry=entries[pos];
+        entries[pos]=null;
+        if(pos==used-1) --used;
+        --size;
+        //shifts back the entries probed past the freed slot
+        for(int next=(slot+1)&mask;index[next]!=0;next=(next+1)&mask){
+            int home=entries[index[next]-1].hash&mask;
+            if(((next-home)&mask)>=((next-slot)&mask)){
+                index[slot]=index[next];
+                slot=next;
+            }
+        }
+        index[slot]=0;
+        return entry.value;
     }
 
     @Override
     public void putAll( Map<? extends K, ? extends V> m) {
         for(Entry<? extends K, ? extends V> entry:m.entrySet()){
-            entries.add(new CustomEntry<>(entry.getKey(),entry.getValue()));
+            put(entry.getKey(),entry.getValue());
         }
     }
 
     @Override
     public void clear() {
-       entries.clear();
+        Arrays.fill(entries,0,used,null);
+        Arrays.fill(index,0);
+        used=0;
+        size=0;
+    }
+
+    private abstract class Walker<T> implements Iterator<T>{
+        private int next=skip(0);
+
+        private int skip(int i){
+            while(i<used&&entries[i]==null) ++i;
+            return i;
+        }
+
+        @Override
+        public boolean hasNext() {
+            return next<used;
+        }
+
+        @Override
+        public T next() {
+            if(next>=used) throw new NoSuchElementException();
+            CustomEntry<K,V> entry=entries[next];
+            next=skip(next+1);
+            return pick(entry);
+        }
+
+        abstract T pick(CustomEntry<K,V> entry);
     }
 
-    
     @Override
     public Set<K> keySet() {
-        return new Set<K>() {
+        return new AbstractSet<K>() {
             @Override
             public int size() {
-                return entries.size();
-            }
-
-            @Override
-            public boolean isEmpty() {
-                return entries.isEmpty();
+                return size;
             }
 
             @Override
@@ -104,191 +211,61 @@ class DataMap<K,V> implements Map<K,V> ,Iterable<DataMap.CustomEntry<K,V>>{
                 return containsKey(o);
             }
 
-            
             @Override
             public Iterator<K> iterator() {
-                Iterator<CustomEntry<K,V>> iterator=entries.iterator();
-                return new Iterator<K>() {
-                    @Override
-                    public boolean hasNext() {
-                        return iterator.hasNext();
-                    }
-
+                return new Walker<K>() {
                     @Override
-                    public K next() {
-                        return iterator.next().getKey();
+                    K pick(CustomEntry<K, V> entry) {
+                        return entry.key;
                     }
                 };
             }
-
-            
-            @Override
-            public Object[] toArray() {
-                Object[] ret=new Object[size()];
-                for (int i=0,len=size();i<len;++i){
-                    ret[i]=entries.get(i).getKey();
-                }
-                return ret;
-            }
-
-            @Override
-            public <T> T[] toArray( T[] a) {
-                T[] ret=a.length<size()?(T[])Array.newInstance(a.getClass().getComponentType(),size()) :a;
-                for (int i=0,len=size();i<len;++i){
-                    ret[i]=(T)entries.get(i).getKey();
-                }
-                return ret;
-            }
-
-            @Override
-            public boolean add(K k) {
-                throw new UnsupportedOperationException();
-            }
-
-            @Override
-            public boolean remove( Object o) {
-                throw new UnsupportedOperationException();
-            }
-
-            @Override
-            public boolean containsAll( Collection<?> c) {
-                for (Object v:c){
-                    if(!containsKey(v))
-                        return false;
-                }
-                return true;
-            }
-
-            @Override
-            public boolean addAll( Collection<? extends K> c) {
-                throw new UnsupportedOperationException();
-            }
-
-            @Override
-            public boolean retainAll( Collection<?> c) {
-                throw new UnsupportedOperationException();
-            }
-
-            @Override
-            public boolean removeAll( Collection<?> c) {
-                throw new UnsupportedOperationException();
-            }
-
-            @Override
-            public void clear() {
-                throw new UnsupportedOperationException();
-            }
         };
     }
 
-    
     @Override
     public Collection<V> values() {
-        return new Collection<V>() {
+        return new AbstractCollection<V>() {
             @Override
             public int size() {
-                return entries.size();
-            }
-
-            @Override
-            public boolean isEmpty() {
-                return entries.isEmpty();
+                return size;
             }
 
             @Override
             public boolean contains( Object o) {
-                return containsKey(o);
+                return containsValue(o);
             }
 
-
             @Override
             public Iterator<V> iterator() {
-                Iterator<CustomEntry<K,V>> iterator=entries.iterator();
-                return new Iterator<V>() {
-                    @Override
-                    public boolean hasNext() {
-                        return iterator.hasNext();
-                    }
-
+                return new Walker<V>() {
                     @Override
-                    public V next() {
-                        return iterator.next().getValue();
+                    V pick(CustomEntry<K, V> entry) {
+                        return entry.value;
                     }
                 };
             }
-
-
-            @Override
-            public Object[] toArray() {
-                Object[] ret=new Object[size()];
-                for (int i=0,len=size();i<len;++i){
-                    ret[i]=entries.get(i).getValue();
-                }
-                return ret;
-            }
-
-            @Override
-            public <T> T[] toArray( T[] a) {
-                T[] ret=a.length<size()?(T[])Array.newInstance(a.getClass().getComponentType(),size()) :a;
-                for (int i=0,len=size();i<len;++i){
-                    ret[i]=(T)entries.get(i).getValue();
-                }
-                return ret;
-            }
-
-            @Override
-            public boolean add(V k) {
-                throw new UnsupportedOperationException();
-            }
-
-            @Override
-            public boolean remove( Object o) {
-                throw new UnsupportedOperationException();
-            }
-
-            @Override
-            public boolean containsAll( Collection<?> c) {
-                for (Object v:c){
-                    if(!containsKey(v))
-                        return false;
-                }
-                return true;
-            }
-
-            @Override
-            public boolean addAll( Collection<? extends V> c) {
-                throw new UnsupportedOperationException();
-            }
-
-            @Override
-            public boolean retainAll( Collection<?> c) {
-                throw new UnsupportedOperationException();
-            }
-
-            @Override
-            public boolean removeAll( Collection<?> c) {
-                throw new UnsupportedOperationException();
-            }
-
-            @Override
-            public void clear() {
-                throw new UnsupportedOperationException();
-            }
         };
     }
 
-
     @Override
-    public ListIterator<CustomEntry<K,V>> iterator() {
-        return entries.listIterator();
+    public Iterator<CustomEntry<K,V>> iterator() {
+        return new Walker<CustomEntry<K, V>>() {
+            @Override
+            CustomEntry<K, V> pick(CustomEntry<K, V> entry) {
+                return entry;
+            }
+        };
     }
 
     static class CustomEntry<T,P> implements Map.Entry<T,P>{
         T key;
         P value;
-        CustomEntry(T k,P v){
+        int hash;
+        CustomEntry(T k,P v,int h){
             key=k;
             value=v;
+            hash=h;
         }
         @Override
         public T getKey() {
@@ -300,6 +277,7 @@ class DataMap<K,V> implements Map<K,V> ,Iterable<DataMap.CustomEntry<K,V>>{
             return value;
         }
 
+        //the map must be rehashed after that
         public void setKey(T key) {
             this.key = key;
         }
@@ -311,90 +289,32 @@ class DataMap<K,V> implements Map<K,V> ,Iterable<DataMap.CustomEntry<K,V>>{
             return old;
         }
     }
-    
+
     @Override
     public Set<Entry<K, V>> entrySet() {
-
-        return new Set<Entry<K, V>>() {
+        return new AbstractSet<Entry<K, V>>() {
             @Override
             public int size() {
-                return entries.size();
-            }
-
-            @Override
-            public boolean isEmpty() {
-                return size()>0;
+                return size;
             }
 
             @Override
             public boolean contains( Object o) {
-                return entries.contains(o);
+                if(!(o instanceof Entry)) return false;
+                Entry<?,?> other=(Entry<?,?>)o;
+                CustomEntry<K,V> entry=find(other.getKey());
+                return entry!=null&&Equals(entry.value,other.getValue());
             }
 
-            
             @Override
             public Iterator<Entry<K, V>> iterator() {
-                Iterator<CustomEntry<K,V>> iterator=entries.iterator();
-                return new Iterator<Entry<K, V>>() {
+                return new Walker<Entry<K, V>>() {
                     @Override
-                    public boolean hasNext() {
-                        return iterator.hasNext();
-                    }
-
-                    @Override
-                    public Entry<K, V> next() {
-                        return iterator.next();
+                    Entry<K, V> pick(CustomEntry<K, V> entry) {
+                        return entry;
                     }
                 };
             }
-
-            
-            @Override
-            public Object[] toArray() {
-                return entries.toArray();
-            }
-
-            @Override
-            public <T> T[] toArray( T[] a) {
-                return  entries.toArray(a);
-            }
-
-            @Override
-            public boolean add(Entry<K, V> kvEntry) {
-                throw new UnsupportedOperationException();
-            }
-
-            @Override
-            public boolean remove( Object o) {
-                throw new UnsupportedOperationException();
-            }
-
-            @Override
-            public boolean containsAll( Collection<?> c) {
-                return entries.contains(c);
-            }
-
-            @Override
-            public boolean addAll( Collection<? extends Entry<K, V>> c) {
-                throw new UnsupportedOperationException();
-            }
-
-            @Override
-            public boolean retainAll( Collection<?> c) {
-                throw new UnsupportedOperationException();
-            }
-
-            @Override
-            public boolean removeAll( Collection<?> c) {
-                throw new UnsupportedOperationException();
-            }
-
-            @Override
-            public void clear() {
-                throw new UnsupportedOperationException();
-            }
         };
     }
-
-
 }
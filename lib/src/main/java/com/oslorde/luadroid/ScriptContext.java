@@ -1,7 +1,9 @@
 package com.oslorde.luadroid;
 
 
+import android.content.res.AssetFileDescriptor;
 import android.os.Build;
+import android.os.ParcelFileDescriptor;
 import android.util.SparseArray;
 import android.util.SparseBooleanArray;
 import android.util.SparseIntArray;
@@ -37,17 +39,25 @@ import java.nio.ByteOrder;
 import java.nio.CharBuffer;
 import java.util.ArrayDeque;
 import java.util.ArrayList;
+import java.util.Arrays;
 import java.util.Collection;
 import java.util.Deque;
 import java.util.HashMap;
 import java.util.HashSet;
+import java.util.IdentityHashMap;
 import java.util.Iterator;
 import java.util.LinkedHashMap;
 import java.util.List;
 import java.util.Map;
 import java.util.Queue;
 import java.util.Set;
+import java.util.concurrent.CancellationException;
 import java.util.concurrent.ConcurrentHashMap;
+import java.util.concurrent.ExecutionException;
+import java.util.concurrent.Future;
+import java.util.concurrent.RejectedExecutionException;
+import java.util.concurrent.TimeUnit;
+import java.util.concurrent.TimeoutException;
 
 /**
  * For running a lua context
@@ -96,6 +106,8 @@ public class ScriptContext {
             return true;
         }
     };
+    //the shared caches above keep one class only,so members are pinned while a class is bulk loaded
+    private static final ThreadLocal<PinnedMembers> sPinnedMembers = new ThreadLocal<>();
     private static Method sEqualNameAndParameters;
     //Optimize  for the redundant call in new Class Api
     private static Method sUnchecked;
@@ -158,12 +170,20 @@ public class ScriptContext {
 
     private static native long compile(long ptr, String s, boolean isFile) throws RuntimeException;
 
+    private static native long compileBuffer(long ptr, ByteBuffer buffer) throws RuntimeException;
+
+    private static native long compileFd(long ptr, int fd, long offset, long length) throws RuntimeException;
+
     private static native void addObject(long ptr, String s, Object ob, boolean local);
 
     private static native void addMember(long ptr, String name, String method, Object inst, Class type, boolean local);
 
     private static native Object invokeLuaFunction(long ptr, long funcRef,boolean multiRet, Object proxy, String name,int[] types, Object[] args);
 
+    private static native long invokeLuaDirect(long ptr, long funcRef, Object proxy, String name, int[] types, long[] args, Object[] objectArgs, int returnType);
+
+    private static native Object invokeLuaDirectObject(long ptr, long funcRef, Object proxy, String name, int[] types, long[] args, Object[] objectArgs);
+
     private static native Object invokeSuper(Object thiz,Method m,int mid,Object[] args);//Only for calling ObjectMethod
 
     private static native Object constructChild(long ptr, Class proxyClass, long nativeInfo);
@@ -172,6 +192,27 @@ public class ScriptContext {
 
     private static native int getClassType(long ptr,Class c);
 
+    private static native void setObjectLimit(long ptr,int limit);
+
+    private static native void setIdentityCache(long ptr,boolean enabled);
+
+    private static native void setGenerationalGC(long ptr,boolean enabled);
+    private static native void setMemoryLimit(long ptr,long limit);
+    private static native void setTemporaryArena(long ptr,boolean enabled);
+    private static native void setDirectTables(long ptr,boolean enabled);
+
+    private static native long[] getLockStats(long ptr);
+
+    private static native void preloadClasses(long ptr, Class[] classes);
+
+    private static native long startExecutor(long ptr, int threads);
+
+    private static native boolean submitTask(long executor, Object script, Object[] args, Object future);
+
+    private static native boolean shutdownExecutor(long executor);
+
+    private static native boolean setCodeCache(long ptr, String dir, boolean strip);
+
     private static native boolean sameSigMethod(Method m,Method f,Method worker);
 
     private static  int classCompare(String orig,String other){
@@ -437,6 +478,15 @@ public class ScriptContext {
     }
 
     private static Field[] getDeclaredFields(Class c){
+        PinnedMembers pinned = sPinnedMembers.get();
+        if (pinned != null) {
+            Field[] ret = pinned.fields.get(c);
+            if (ret == null) {
+                ret = c.getDeclaredFields();
+                pinned.fields.put(c, ret);
+            }
+            return ret;
+        }
         synchronized (sFieldCache){
             Field [] ret =sFieldCache.get(c);
             if(ret!=null)
@@ -448,30 +498,44 @@ public class ScriptContext {
     }
 
     private static Method[] getDeclaredMethods(Class c){
+        PinnedMembers pinned = sPinnedMembers.get();
+        if (pinned != null) {
+            Method[] ret = pinned.methods.get(c);
+            if (ret == null) {
+                ret = loadDeclaredMethods(c);
+                pinned.methods.put(c, ret);
+            }
+            return ret;
+        }
         synchronized (sMethodCache){
             Method [] ret= sMethodCache.get(c);
             if(ret!=null) return ret;
-            Out:{
-                if(sUnchecked!=null){
-                    try {
-                        if(sUseList){
-                            List<Method> methods=new ArrayList<>();
-                            sUnchecked.invoke(c,false,methods);
-                            ret= methods.toArray(EMPTY_METHODS);
-                        } else ret=  (Method[]) sUnchecked.invoke(c,false);
-                        break Out;
-                    } catch (Throwable ignored) {
-                    }
-                }
-                ret= c.getDeclaredMethods();
-            }
-            ret= ret==null?EMPTY_METHODS:ret;
+            ret = loadDeclaredMethods(c);
             sMethodCache.put(c,ret);
             return ret;
         }
 
     }
 
+    private static Method[] loadDeclaredMethods(Class c) {
+        Method[] ret;
+        Out:{
+            if(sUnchecked!=null){
+                try {
+                    if(sUseList){
+                        List<Method> methods=new ArrayList<>();
+                        sUnchecked.invoke(c,false,methods);
+                        ret= methods.toArray(EMPTY_METHODS);
+                    } else ret=  (Method[]) sUnchecked.invoke(c,false);
+                    break Out;
+                } catch (Throwable ignored) {
+                }
+            }
+            ret= c.getDeclaredMethods();
+        }
+        return ret==null?EMPTY_METHODS:ret;
+    }
+
     private static boolean findMockNameRecursive(Class c, String[] names, String[] out) {
         Method[] methods = getDeclaredMethods(c);
         if (methods.length == 0) return false;
@@ -554,6 +618,116 @@ public class ScriptContext {
         return retList.isEmpty() ? null : retList.toArray();
     }
 
+    /**
+     * Packs all members of the class into one descriptor,see JavaType::loadAllMembers for the layout.
+     * Each name is resolved the same way as findMembers.
+     */
+    private static Object[] findAllMembers(Class cl, boolean isStatic) {
+        HashSet<String> fieldNames = new HashSet<>();
+        HashSet<String> methodNames = new HashSet<>();
+        sPinnedMembers.set(new PinnedMembers());
+        try {
+            collectMemberNames(cl, isStatic, fieldNames, methodNames);
+            if (!isStatic && (cl.isInterface() || cl.isArray()))
+                collectMemberNames(Object.class, false, null, methodNames);
+            HashSet<String> names = new HashSet<>(fieldNames);
+            names.addAll(methodNames);
+            MemberPacker packer = new MemberPacker();
+            for (String name : names) {
+                packer.add(name, fieldNames.contains(name) ? findMembers(cl, name, true, isStatic) : null,
+                        methodNames.contains(name) ? findMembers(cl, name, false, isStatic) : null);
+            }
+            return packer.finish();
+        } finally {
+            sPinnedMembers.remove();
+        }
+    }
+
+    private static void collectMemberNames(Class c, boolean isStatic, Set<String> fieldNames, Set<String> methodNames) {
+        do {
+            if (fieldNames != null) {
+                for (Field f : getDeclaredFields(c)) {
+                    if (Modifier.isStatic(f.getModifiers()) == isStatic)
+                        fieldNames.add(f.getName());
+                }
+            }
+            for (Method m : getDeclaredMethods(c)) {
+                if (!isStatic || isDirect(m.getModifiers()))
+                    methodNames.add(m.getName());
+            }
+            for (Class inter : c.getInterfaces()) {
+                collectMemberNames(inter, isStatic, isStatic ? fieldNames : null, methodNames);
+            }
+        } while ((c = c.getSuperclass()) != null);
+    }
+
+    private static final class PinnedMembers {
+        final HashMap<Class, Method[]> methods = new HashMap<>();
+        final HashMap<Class, Field[]> fields = new HashMap<>();
+    }
+
+    private static final class MemberPacker {
+        //slot 0 is for the descriptor
+        private final ArrayList<Object> refs = new ArrayList<>();
+        private final IdentityHashMap<Object, Integer> indices = new IdentityHashMap<>();
+        private int[] desc = new int[256];
+        private int size = 1;
+
+        MemberPacker() {
+            refs.add(null);
+        }
+
+        private int ref(Object o) {
+            if (o == null) return -1;
+            Integer index = indices.get(o);
+            if (index == null) {
+                index = refs.size();
+                refs.add(o);
+                indices.put(o, index);
+            }
+            return index;
+        }
+
+        private void put(int v) {
+            if (size == desc.length)
+                desc = Arrays.copyOf(desc, size << 1);
+            desc[size++] = v;
+        }
+
+        void add(String name, Object[] fields, Object[] methods) {
+            int fieldCount = fields == null ? 0 : fields.length / 3;
+            int methodCount = methods == null ? 0 : methods.length / 6;
+            if (fieldCount + methodCount == 0) return;
+            ++desc[0];
+            put(ref(name));
+            put(fieldCount);
+            put(methodCount);
+            for (int i = 0; i < fieldCount * 3; ++i) {
+                put(ref(fields[i]));
+            }
+            for (int i = 0; i < methodCount * 6; i += 6) {
+                put(ref(methods[i]));
+                put(ref(methods[i + 1]));
+                put(ref(methods[i + 2]));
+                Class[] params = (Class[]) methods[i + 3];
+                Type[] genericParams = (Type[]) methods[i + 4];
+                put(params.length);
+                for (int j = 0; j < params.length; ++j) {
+                    put(ref(params[j]));
+                    put(ref(genericParams[j]));
+                }
+                put(ref(methods[i + 5]));
+            }
+        }
+
+        Object[] finish() {
+            ByteBuffer buffer = ByteBuffer.allocateDirect(size << 2).order(ByteOrder.nativeOrder());
+            buffer.asIntBuffer().put(desc, 0, size);
+            refs.set(0, buffer);
+            return refs.toArray();
+        }
+    }
+
     private static Object[] convertConstructors(Constructor[] constructors) {
         Object[] ret=new Object[constructors.length*6];
         int i=0;
@@ -1175,6 +1349,10 @@ public class ScriptContext {
      * @param <F> sub type of T
      */
     public <T, F extends T> TableConverter putTableConverter(Class<T> type, TableConverter<F> converter) {
+        //flat tables skip the converters of these types in native code
+        if (type.isArray() || type == Map.class || type == HashMap.class || type == List.class
+                || type == ArrayList.class || type == Collection.class)
+            setDirectTables(nativePtr, false);
         return lazyConverts().put(type, converter);
     }
 
@@ -1347,14 +1525,17 @@ public class ScriptContext {
                 if(keyType!=null){
                     Class rawType = resolveType(keyType);
                     boolean shouldFixTable=isTableType(rawType);
+                    boolean keyChanged=false;
                     for (DataMap.CustomEntry<Object,Object> entry :
                             table) {
                         Object key = entry.getKey();
                         Object newKey=fixValue2(key,rawType,keyType,shouldFixTable);
                         if(newKey!=key){
-                            entry.setKey(key);
+                            entry.setKey(newKey);
+                            keyChanged=true;
                         }
                     }
+                    if(keyChanged) table.rehash();
                 }
             }
             return converter.convert(table);
@@ -1487,6 +1668,112 @@ public class ScriptContext {
         logger.onNewLog(log,raw);
     }
 
+    /**
+     * @param limit max count of java objects alive in all lua states of this context,
+     *              a lua error is raised when it's reached even after a full gc.
+     *              Non-positive for no limit. Default is 32768
+     */
+    public void setJavaObjectLimit(int limit) {
+        setObjectLimit(nativePtr, limit);
+    }
+
+    /**
+     * @param enabled push the same userdata for a java object still alive in the lua state
+     *                instead of a new one with its own global ref.
+     *                Hits and misses are reported by java.stats(). Default is false
+     */
+    public void setIdentityCache(boolean enabled) {
+        setIdentityCache(nativePtr, enabled);
+    }
+
+    /**
+     * Minor collections only visit the young objects and at most 512KB of them,while major
+     * collections run in steps like the incremental mode. That pays off when the old objects are
+     * mostly read: on the "readmostly" workload of gcpausebench.lua over a 200k entry heap the
+     * generational mode paused for up to 3.5ms(55ms in total),the incremental one for up to
+     * 8.1ms(160ms in total). A store into an old table makes the next minor collection traverse
+     * the whole table again,so on the "mutating" workload,which stores into the 200k entry table
+     * every round,it paused for 440ms in total against 180ms. Keep the default for such states.
+     * @param enabled collect the lua states in generational mode,whose minor collections
+     *                only sweep the objects made since the previous one,instead of the
+     *                incremental mode. Applies to the state of the calling thread and to
+     *                the states created afterwards. Pauses are reported by java.stats().gc.
+     *                Default is false
+     */
+    public void setGenerationalGC(boolean enabled) {
+        setGenerationalGC(nativePtr, enabled);
+    }
+
+    /**
+     * @param bytes max memory taken from the system by all lua states of this context,
+     *              an allocation beyond it raises a lua memory error after an emergency gc.
+     *              Per state usage is reported by java.stats().memory.
+     *              Non-positive for no limit. Default is no limit
+     */
+    public void setMemoryLimit(long bytes) {
+        setMemoryLimit(nativePtr, bytes);
+    }
+
+    /**
+     * @param enabled allocate the temporaries of a bridge call from a per thread arena
+     *                instead of the heap. Applies to the calling thread and to the threads
+     *                entering this context afterwards. Heap fallbacks are reported by
+     *                java.stats().arenaFallbacks. Default is true
+     */
+    public void setTemporaryArena(boolean enabled) {
+        setTemporaryArena(nativePtr, enabled);
+    }
+
+    private static final String[] LOCK_NAMES = {"typeLock", "gcLock", "crossLock", "addLock",
+            "loggerLock", "contextLock", "logLock"};
+
+    /**
+     * @return contention stats of the native locks,keyed by lock name.
+     * Each value is {acquireCount,contendedCount,waitNanos}
+     */
+    public Map<String, long[]> getLockStats() {
+        long[] stats = getLockStats(nativePtr);
+        Map<String, long[]> ret = new LinkedHashMap<>();
+        for (int i = 0; i < LOCK_NAMES.length; i++) {
+            ret.put(LOCK_NAMES[i], new long[]{stats[i * 3], stats[i * 3 + 1], stats[i * 3 + 2]});
+        }
+        return ret;
+    }
+
+    /**
+     * Loads all members of the classes at once,so that the first access from lua
+     * needs no reflection. Can be called on any thread.
+     */
+    public void preload(Class<?>... classes) {
+        preloadClasses(nativePtr, classes);
+    }
+
+    /**
+     * Runs {@link #preload(Class[])} on a background thread
+     * @return the started thread
+     */
+    public Thread preloadAsync(final Class<?>... classes) {
+        Thread thread = new Thread("LuaPreload") {
+            @Override
+            public void run() {
+                preload(classes);
+            }
+        };
+        thread.setDaemon(true);
+        thread.start();
+        return thread;
+    }
+
+    /**
+     * Starts a fixed pool of worker threads running scripts of this context,
+     * each in its own lua state configured once.
+     * The context is kept alive until the executor is shut down.
+     * @param threads worker count,non-positive for the cpu count
+     */
+    public ScriptExecutor newExecutor(int threads) {
+        return new ScriptExecutor(startExecutor(nativePtr, threads));
+    }
+
     /**
      * flush log
      */
@@ -1500,6 +1787,33 @@ public class ScriptContext {
         }
     }
 
+    /**
+     * Keeps the bytecode of every script compiled or run from source in the directory,
+     * so that later loads of the same source skip parsing,even in another process.
+     * Dumps of another vm build are dropped here. The dumps keep their debug info,
+     * so errors still report line numbers.
+     * @param dir cache directory,created if absent
+     * @throws IllegalStateException if a cache directory has already been set
+     * @see #setCodeCache(File, boolean)
+     */
+    public void setCodeCache(File dir) {
+        setCodeCache(dir, false);
+    }
+
+    /**
+     * Same as {@link #setCodeCache(File)},but the dumps can be stripped of their debug info.
+     * Stripped dumps are smaller and load faster,but the scripts loaded from them
+     * report no line numbers or local names in errors and in the debug library.
+     * Switching the setting drops the dumps made with the other one.
+     * @param dir cache directory,created if absent
+     * @param strip whether to strip the debug info from the dumps
+     * @throws IllegalStateException if a cache directory has already been set
+     */
+    public void setCodeCache(File dir, boolean strip) {
+        if (!setCodeCache(nativePtr, dir.getPath(), strip))
+            throw new IllegalStateException("Code cache has already been set or is unsupported");
+    }
+
     /**
      *
      * @param script script string
@@ -1531,6 +1845,45 @@ public class ScriptContext {
         return runScript(nativePtr, script, false, args);
     }
 
+    /**
+     * Compiles the remaining bytes of the buffer without copying them into a java string.
+     * Direct and mapped buffers are parsed in place,the others are read chunk by chunk.
+     * @param script script source or bytecode
+     * @return Compiled Script
+     */
+    public CompiledScript compile(ByteBuffer script) {
+        return new CompiledScript(compileBuffer(nativePtr, script));
+    }
+
+    /**
+     * Streams the whole file into the parser without loading it into memory.
+     * The position of the descriptor is left unchanged.
+     * @param fd script file
+     * @return Compiled Script
+     */
+    public CompiledScript compile(ParcelFileDescriptor fd) {
+        return new CompiledScript(compileFd(nativePtr, fd.getFd(), 0, -1));
+    }
+
+    /**
+     * Streams the asset into the parser without loading it into memory.
+     * @param fd script asset,must be uncompressed
+     * @return Compiled Script
+     */
+    public CompiledScript compile(AssetFileDescriptor fd) {
+        return new CompiledScript(compileFd(nativePtr, fd.getParcelFileDescriptor().getFd(),
+                fd.getStartOffset(), fd.getLength()));
+    }
+
+    /**
+     * @param script script source or bytecode,see {@link #compile(ByteBuffer)}
+     * @param args script arguments
+     * @return script result,conversion see README
+     */
+    public Object[] run(ByteBuffer script, Object... args) {
+        return runScript(nativePtr, script, false, args);
+    }
+
     /**
      *
      * @param script script
@@ -1692,6 +2045,126 @@ public class ScriptContext {
 
 
 
+    /**
+     * Runs scripts on the workers of {@link #newExecutor(int)}
+     */
+    public static class ScriptExecutor {
+        private long address;
+
+        ScriptExecutor(long address) {
+            this.address = address;
+        }
+
+        /**
+         * @param script script
+         * @param args script arguments
+         * @return future of the script result,conversion see README
+         */
+        public Future<Object[]> submit(CompiledScript script, Object... args) {
+            return submitScript(script, args);
+        }
+
+        /**
+         * @param script script
+         * @param args script arguments
+         * @return future of the script result,conversion see README
+         */
+        public Future<Object[]> submit(String script, Object... args) {
+            return submitScript(script, args);
+        }
+
+        private synchronized Future<Object[]> submitScript(Object script, Object[] args) {
+            ScriptFuture future = new ScriptFuture();
+            if (address == 0 || !submitTask(address, script, args, future))
+                throw new RejectedExecutionException("Executor has been shut down");
+            return future;
+        }
+
+        /**
+         * Waits for the queued scripts and stops the workers.
+         * @throws IllegalStateException if called from a script run by this executor
+         */
+        public synchronized void shutdown() {
+            long address = this.address;
+            if (address == 0) return;
+            if (!shutdownExecutor(address))
+                throw new IllegalStateException("Executor can't be shut down by its own worker");
+            this.address = 0;
+        }
+
+        @Override
+        protected void finalize() throws Throwable {
+            super.finalize();
+            shutdown();
+        }
+    }
+
+    private static class ScriptFuture implements Future<Object[]> {
+        private static final int PENDING = 0;
+        private static final int RUNNING = 1;
+        private static final int DONE = 2;
+        private static final int CANCELLED = 3;
+        private int state = PENDING;
+        private Object[] result;
+        private Throwable error;
+
+        //native callback
+        private synchronized boolean begin() {
+            if (state != PENDING) return false;
+            state = RUNNING;
+            return true;
+        }
+
+        //native callback
+        private synchronized void done(Object[] result, Throwable error) {
+            this.result = result;
+            this.error = error;
+            state = DONE;
+            notifyAll();
+        }
+
+        @Override
+        public synchronized boolean cancel(boolean mayInterruptIfRunning) {
+            if (state != PENDING) return false;
+            state = CANCELLED;
+            notifyAll();
+            return true;
+        }
+
+        @Override
+        public synchronized boolean isCancelled() {
+            return state == CANCELLED;
+        }
+
+        @Override
+        public synchronized boolean isDone() {
+            return state >= DONE;
+        }
+
+        @Override
+        public synchronized Object[] get() throws InterruptedException, ExecutionException {
+            while (state < DONE) wait();
+            return report();
+        }
+
+        @Override
+        public synchronized Object[] get(long timeout, TimeUnit unit) throws InterruptedException, ExecutionException, TimeoutException {
+            long deadline = System.nanoTime() + unit.toNanos(timeout);
+            while (state < DONE) {
+                long left = deadline - System.nanoTime();
+                if (left <= 0) throw new TimeoutException();
+                TimeUnit.NANOSECONDS.timedWait(this, left);
+            }
+            return report();
+        }
+
+        private Object[] report() throws ExecutionException {
+            if (state == CANCELLED) throw new CancellationException();
+            if (error != null) throw new ExecutionException(error);
+            return result;
+        }
+    }
+
     /**
      * A compiled script for future call
      */
@@ -1849,6 +2322,62 @@ public class ScriptContext {
         }
     }
 
+    /**
+     * Per thread argument frame used by generated methods,primitives are stored as raw bits
+     * so that they need not be boxed.It's consumed before the lua function runs,
+     * hence reentrant calls can share it.
+     */
+    public static final class ArgFrame {
+        long[] args = new long[8];
+        Object[] objectArgs = new Object[8];
+
+        void ensure(int size) {
+            if (args.length < size) {
+                args = new long[size];
+                objectArgs = new Object[size];
+            }
+        }
+
+        void clear(int size) {
+            Arrays.fill(objectArgs, 0, size, null);
+        }
+
+        public void set(int index, int value) {
+            args[index] = value;
+        }
+
+        public void set(int index, long value) {
+            args[index] = value;
+        }
+
+        public void set(int index, float value) {
+            args[index] = Double.doubleToRawLongBits(value);
+        }
+
+        public void set(int index, double value) {
+            args[index] = Double.doubleToRawLongBits(value);
+        }
+
+        public void set(int index, boolean value) {
+            args[index] = value ? 1 : 0;
+        }
+
+        public void set(int index, char value) {
+            args[index] = value;
+        }
+
+        public void set(int index, Object value) {
+            objectArgs[index] = value;
+        }
+    }
+
+    private static final ThreadLocal<ArgFrame> sArgFrame = new ThreadLocal<ArgFrame>() {
+        @Override
+        protected ArgFrame initialValue() {
+            return new ArgFrame();
+        }
+    };
+
     public class Func{
         long funcRef;
         String methodName;
@@ -1856,17 +2385,62 @@ public class ScriptContext {
         Class returnClass;
         int[] argTypes;
         int classType;
+        int returnLuaType;
         private Func(long funcRef,String name,TypeId[] argTypes,TypeId returnType){
             this.funcRef=funcRef;
             this.methodName=name;
             this.returnType=returnType;
+            this.returnLuaType=getTypeLuaType(returnType);
             this.argTypes=new int[argTypes.length];
             for (int i = 0; i < argTypes.length; i++) {
                 this.argTypes[i]=getTypeLuaType(argTypes[i]);
             }
         }
 
+        public ArgFrame frame() {
+            ArgFrame frame = sArgFrame.get();
+            frame.ensure(argTypes.length);
+            return frame;
+        }
+
+        /**
+         * For integral,char and void returns
+         */
+        public long callLong(Object thiz, ArgFrame frame) {
+            try {
+                return invokeLuaDirect(nativePtr, funcRef, thiz, methodName, argTypes,
+                        frame.args, frame.objectArgs, returnLuaType);
+            } finally {
+                frame.clear(argTypes.length);
+            }
+        }
+
+        public double callDouble(Object thiz, ArgFrame frame) {
+            return Double.longBitsToDouble(callLong(thiz, frame));
+        }
+
+        public boolean callBoolean(Object thiz, ArgFrame frame) {
+            return callLong(thiz, frame) != 0;
+        }
+
+        public Object callObject(Object thiz, ArgFrame frame) throws Throwable {
+            Object ret;
+            try {
+                ret = invokeLuaDirectObject(nativePtr, funcRef, thiz, methodName, argTypes,
+                        frame.args, frame.objectArgs);
+            } finally {
+                frame.clear(argTypes.length);
+            }
+            resolveReturnClass(thiz);
+            return fixValue(ret, classType, returnClass, returnClass);
+        }
+
         public Object call(Object thiz,Object... args) throws Throwable{
+            resolveReturnClass(thiz);
+            return fixValue(invokeLuaFunction(nativePtr, funcRef,false, thiz, methodName, argTypes, args),classType,returnClass,returnClass);
+        }
+
+        private void resolveReturnClass(Object thiz) throws ClassNotFoundException {
             if(returnClass==null){
                 String name = returnType.getName();
                 switch (name.charAt(0)) {
@@ -1906,7 +2480,6 @@ public class ScriptContext {
                 }
                 classType=getClassType(nativePtr,returnClass);
             }
-            return fixValue(invokeLuaFunction(nativePtr, funcRef,false, thiz, methodName, argTypes, args),classType,returnClass,returnClass);
         }
 
         @Override
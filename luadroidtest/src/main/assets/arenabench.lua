@@ -0,0 +1,13 @@
+--heap allocations of bridge temporaries per call,run with the arena on and off
+local mode=...
+local map=java.new(java.type('java.util.HashMap'))
+local count=100000
+local before=java.stats()
+local t=os.clock()
+for i=1,count do
+    map.putAll({a=i,b=i})
+end
+local after=java.stats()
+print("putAll",mode,count,os.clock()-t)
+local mallocs=after.arenaMallocs+after.arenaFallbacks-before.arenaMallocs-before.arenaFallbacks
+print("heap allocations per call",mode,mallocs/count)
@@ -0,0 +1,42 @@
+--compares per element access of java arrays with the bulk transfer api
+local count=100000
+local arr=java.newArray(java.type('float'),count)
+local t=os.clock()
+for i=0,count-1 do
+    arr[i]=i
+end
+print("element set",count,os.clock()-t)
+
+local values={}
+for i=1,count do
+    values[i]=(i-1)*0.5
+end
+t=os.clock()
+java.fill(arr,values)
+print("fill",count,os.clock()-t)
+assert(arr[2]==1.0)
+
+t=os.clock()
+local sum=0
+for i=0,count-1 do
+    sum=sum+arr[i]
+end
+print("element get",count,os.clock()-t)
+
+t=os.clock()
+local tab=java.toTable(arr)
+print("toTable",count,os.clock()-t)
+assert(#tab==count and tab[count]==(count-1)*0.5)
+assert(#java.toTable(arr,10,20)==10)
+
+t=os.clock()
+local view=java.view(arr)
+for i=0,#view-1 do
+    view[i]=view[i]*2
+end
+view.commit()
+print("view",count,os.clock()-t)
+assert(arr[3]==3.0)
+arr[3]=0
+view:refresh()
+assert(view[3]==0)
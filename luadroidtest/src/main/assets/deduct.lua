@@ -1,3 +1,169 @@
 import 'com.oslorde.luadroidtest.DeductTest'
 
-assert(DeductTest.string("a"))
\ No newline at end of file
+assert(DeductTest.string("a"))
+
+--each feature runs in its own block,a failing block is reported by name and the others still run
+local failed={}
+local function test(name,block)
+    local ok,err=pcall(block)
+    if ok then
+        print("pass "..name)
+    else
+        print("FAIL "..name..": "..tostring(err))
+        failed[#failed+1]=name
+    end
+end
+
+test("overloadCache",function()
+    local before=java.stats()
+    for _=1,4 do
+        assert(DeductTest.overload(1)=="int")
+        assert(DeductTest.overload(0x100000000)=="long")
+        assert(DeductTest.overload(1.5)=="double")
+        assert(DeductTest.overload("str")=="string")
+    end
+    local after=java.stats()
+    assert(after.deductCacheHits-before.deductCacheHits>=12)
+    assert(after.deductCacheMisses-before.deductCacheMisses<=4)
+end)
+
+test("primitiveArgs",function()
+    local builder=java.type('com.oslorde.luadroid.ClassBuilder').declare()
+    builder.addMethod('mix','D',{'I','J','F','Z','C','java.lang.String'},function(_,_,i,l,f,z,c,s)
+        assert(math.type(i)=='integer' and math.type(l)=='integer')
+        assert(z==true and c=='x' and s=='s')
+        return i+l+f
+    end)
+    builder.addMethod('half','I',{'I'},function(_,_,i) return i//2 end)
+    local mixer=builder.newInstance(java.new(java.type('java.lang.Object')))
+    assert(mixer.mix(1,2,0.5,true,'x','s')==3.5)
+    assert(mixer.half(7)==3)
+end)
+
+test("preload",function()
+    java.preload({'java.lang.StringBuilder',DeductTest})
+    local sb=java.new(java.type('java.lang.StringBuilder'))
+    sb.append('a').append(1)
+    assert(sb.toString()=='a1' and sb.length()==2)
+    assert(DeductTest.overload(1)=="int")
+    java.preload({'java.util.ArrayList'},true).join()
+    local list=java.new(java.type('java.util.ArrayList'))
+    list.add(1)
+    assert(list.size()==1)
+end)
+
+test("frozenTables",function()
+    local config=java.freeze({name='cfg',list={1,2,3},nested={deep={true}}})
+    cross.config=config
+    local shared=cross.config
+    assert(shared==config and shared.name=='cfg' and shared.nested.deep[1]==true)
+    assert(#shared.list==3 and shared.list[2]==2)
+    assert(not pcall(function() shared.name='x' end))
+    local keys=0
+    for _ in pairs(shared) do keys=keys+1 end
+    assert(keys==3)
+    cross.config=nil
+end)
+
+test("channels",function()
+    local jobs=java.channel(4)
+    assert(jobs:send(1,0) and jobs:recv(0)==1)
+    assert(jobs:sendAll({2,3,4,5},0)==4 and #jobs==4)
+    assert(select(2,jobs:send(6,0))=='timeout')
+    local taken=jobs:recvAll(8)
+    assert(#taken==4 and taken[4]==5)
+    local producer=java.new(java.type('java.lang.Thread'),function()
+        for i=1,100 do jobs:send(i) end
+        jobs:close()
+    end)
+    producer.start()
+    local sum=0
+    while true do
+        local _,v=java.select({jobs},1000)
+        if v==nil then break end
+        sum=sum+v
+    end
+    assert(sum==5050 and jobs:isClosed())
+end)
+
+test("lazyGlobals",function()
+    assert(getmetatable(_G)==nil)
+    assert(rawget(_G,'notDefined')==nil and notDefined==nil)
+    assert(require('math')==math and math.floor(1.5)==1)
+    assert(rawget(_G,'math')==math and lfs and os.time())
+    assert(rawget(_G,'utf8')==utf8 and utf8.char(65)=='A')
+    --a sandboxed global stays removed,resolved or not
+    local savedOs=os
+    os=nil
+    assert(os==nil and rawget(_G,'os')==nil)
+    os=savedOs
+    debug=nil
+    assert(debug==nil)
+    local seen={}
+    for k in pairs(_G) do seen[k]=true end
+    assert(seen.io and seen.coroutine and seen.utf8)
+end)
+
+test("flatTables",function()
+    assert(DeductTest.sum({1,2,3})==6 and DeductTest.sum({})==0)
+    assert(DeductTest.size({'a','b'})==2 and DeductTest.size({{1},{2}})==2)
+    assert(DeductTest.lookup({x=1,y='z'},'y')=='z')
+    --not a sequence,so the generic conversion keeps the hash part
+    assert(DeductTest.size({1,nil,3,x=5})==3 and DeductTest.at({1,nil,3,x=5},2)==5)
+end)
+
+test("localFrames",function()
+    local refs=java.new(java.type('java.util.ArrayList'))
+    for i=1,1000 do refs.add(tostring(i)) end
+    for _=1,20 do
+        for i=0,999 do assert(refs.get(i)) end
+    end
+    for _=1,1000 do assert(not pcall(function() return refs.get(-1) end)) end
+    assert(refs.size()==1000)
+end)
+
+test("strings",function()
+    assert(tostring(DeductTest.string("héllo 😀"))=="héllo 😀")
+    local long=string.rep("😀a",300)
+    assert(tostring(DeductTest.string(long))==long)
+    local keys=java.new(java.type('java.util.HashMap'))
+    for i=1,100 do keys.put("key"..(i%10),i) end
+    assert(keys.size()==10 and tostring(keys.get("key0"))=="100")
+end)
+
+test("stringTable",function()
+    local strtab=java.stats().stringTable
+    if not strtab then return end
+    local keys={}
+    for i=1,2000 do keys[string.format("item_%06d_label",i)]=i end
+    strtab=java.stats().stringTable
+    assert(strtab.nuse>2000 and strtab.maxChain<16)
+end)
+
+test("generationalGC",function()
+    if not java.stats().gc then return end
+    assert(collectgarbage("generational")=="incremental")
+    assert(java.stats().gc.mode=="generational")
+    --a full collection leaves the survivors old,so the next step is a minor one
+    collectgarbage()
+    local majorinc=collectgarbage("setmajorinc",1000)
+    local weak=setmetatable({},{__mode="v"})
+    local minors=java.stats().gc.minors
+    for i=1,1000 do weak[i]={i} end
+    collectgarbage("step")
+    collectgarbage("setmajorinc",majorinc)
+    --young garbage is gone,but for the table each minor collection found still on the stack
+    local left=0
+    for _ in pairs(weak) do left=left+1 end
+    minors=java.stats().gc.minors-minors
+    assert(minors>0 and left<=minors)
+    assert(collectgarbage("incremental")=="generational")
+end)
+
+test("memoryAccount",function()
+    local count=collectgarbage("count")*1024
+    local memory=java.stats().memory
+    assert(memory.bytes>=count and memory.reserved>=memory.bytes and memory.allocs>memory.frees)
+end)
+
+assert(#failed==0,"failed: "..table.concat(failed,","))
@@ -0,0 +1,17 @@
+--iterates a large ArrayList to stress java object pushes and the gc pacer
+local list=...
+local t=os.clock()
+local count=0
+for _,v in pairs(list) do
+    count=count+1
+end
+assert(count==list.size())
+print("iterate",count,os.clock()-t)
+
+t=os.clock()
+local get=list.get
+for i=0,count-1 do
+    get(i)
+end
+print("get",count,os.clock()-t)
+print("live objects",java.stats().liveObjects)
@@ -0,0 +1,30 @@
+--pauses of the collector while bridge objects,tables and chunks are churned over a large old heap
+--mode "forced" collects fully after every compile,like the bridge used to do
+--workload "readmostly" only reads the old heap,"mutating" also stores a new table into it each round
+local list,mode,workload=...
+local old={}
+for i=1,200000 do old[i]={i,tostring(i),{x=i}} end
+java.stats(true)
+local t=os.clock()
+local get=list.get
+local sum=0
+for round=1,300 do
+    for i=1,2000 do
+        local w=setmetatable({id=i},{__index=old[i]})
+        w.value=get(i)
+        sum=sum+#("v"..i..round)
+    end
+    local f=load("local a=... return a+"..round)
+    sum=sum+f(1)
+    if mode=="forced" then collectgarbage() end
+    if workload=="mutating" then old[round*7]={round} end
+end
+local gc=java.stats().gc
+print(mode,workload,gc.mode,os.clock()-t)
+print("steps",gc.steps,"minors",gc.minors,"majors",gc.majors)
+print("max pause",gc.maxPauseUs,"us,total",gc.totalPauseUs,"us")
+local hist={}
+for i=1,#gc.pauses do
+    hist[i]=(i<#gc.pauses and "<"..(16<<(2*(i-1))).."us:" or "more:")..gc.pauses[i]
+end
+print(table.concat(hist," "))
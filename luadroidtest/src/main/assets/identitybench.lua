@@ -0,0 +1,17 @@
+--the same few objects pushed over and over,each hit saves a userdata and a global ref
+local list=...
+local count=list.size()
+local before=java.stats()
+local t=os.clock()
+for _=1,100 do
+    for i=0,count-1 do
+        local o=list.get(i)
+    end
+end
+local after=java.stats()
+local hits=after.identityHits-before.identityHits
+local misses=after.identityMisses-before.identityMisses
+print("get",100*count,os.clock()-t)
+print("hit rate",hits/math.max(hits+misses,1))
+print("global refs saved",hits)
+assert(list.get(0)==list.get(0) and rawequal(list.get(0),list.get(0)))
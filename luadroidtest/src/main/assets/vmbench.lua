@@ -0,0 +1,98 @@
+--interpreter bound loops to compare vm dispatch builds
+local function bench(name,f,...)
+    f(...)
+    local t=os.clock()
+    local ret=f(...)
+    print(name,os.clock()-t)
+    return ret
+end
+
+local function fib(n)
+    if n<2 then return n end
+    return fib(n-1)+fib(n-2)
+end
+
+local function nbody(steps)
+    local bodies={}
+    for i=1,5 do
+        bodies[i]={x=i,y=i*0.5,z=-i,vx=0,vy=0,vz=0,mass=1/i}
+    end
+    local n=#bodies
+    for _=1,steps do
+        for i=1,n do
+            local bi=bodies[i]
+            for j=i+1,n do
+                local bj=bodies[j]
+                local dx,dy,dz=bi.x-bj.x,bi.y-bj.y,bi.z-bj.z
+                local d2=dx*dx+dy*dy+dz*dz
+                local mag=0.01/(d2*math.sqrt(d2))
+                bi.vx=bi.vx-dx*bj.mass*mag
+                bi.vy=bi.vy-dy*bj.mass*mag
+                bi.vz=bi.vz-dz*bj.mass*mag
+                bj.vx=bj.vx+dx*bi.mass*mag
+                bj.vy=bj.vy+dy*bi.mass*mag
+                bj.vz=bj.vz+dz*bi.mass*mag
+            end
+        end
+        for i=1,n do
+            local b=bodies[i]
+            b.x=b.x+0.01*b.vx
+            b.y=b.y+0.01*b.vy
+            b.z=b.z+0.01*b.vz
+        end
+    end
+    return bodies[1].x
+end
+
+local function churn(rounds)
+    local sum=0
+    for r=1,rounds do
+        local t={}
+        for i=1,100 do t[i]=i+r end
+        for i=1,100 do sum=sum+t[i] end
+        t.key=r
+        if t.key==r then sum=sum+1 end
+    end
+    return sum
+end
+
+local Counter={}
+Counter.__index=Counter
+function Counter:get() return self.n end
+function Counter:inc() self.n=self.n+1 end
+
+local function methods(count)
+    local c=setmetatable({n=0},Counter)
+    local sum=0
+    for _=1,count do
+        c:inc()
+        sum=sum+c:get()
+    end
+    return sum
+end
+
+local function strings(count)
+    local parts={}
+    for i=1,count do
+        parts[#parts+1]="item"..i
+    end
+    local s=table.concat(parts,",")
+    local n=0
+    for _ in s:gmatch("[^,]+") do n=n+1 end
+    return n
+end
+
+local function loop(count)
+    local sum=0
+    for i=1,count do
+        if i%3==0 then sum=sum+i elseif i<count//2 then sum=sum-1 end
+    end
+    return sum
+end
+
+assert(bench("fib",fib,30)==832040)
+bench("nbody",nbody,100000)
+assert(bench("table churn",churn,20000)>0)
+assert(bench("methods",methods,1000000)==500000500000)
+assert(bench("string building",strings,200000)==200000)
+bench("loop",loop,5000000)
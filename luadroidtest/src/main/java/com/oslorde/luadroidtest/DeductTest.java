@@ -9,4 +9,38 @@ public class DeductTest {
     public static Object string(String str) {
         return str;
     }
+
+    public static String overload(int i) {
+        return "int";
+    }
+
+    public static String overload(long l) {
+        return "long";
+    }
+
+    public static String overload(double d) {
+        return "double";
+    }
+
+    public static String overload(String str) {
+        return "string";
+    }
+
+    public static long sum(int[] values) {
+        long sum = 0;
+        for (int v : values) sum += v;
+        return sum;
+    }
+
+    public static int size(java.util.List list) {
+        return list.size();
+    }
+
+    public static Object lookup(java.util.Map map, Object key) {
+        return map.get(key);
+    }
+
+    public static Object at(java.util.List list, int index) {
+        return list.get(index);
+    }
 }
@@ -33,6 +33,8 @@ import java.util.ArrayList;
 import java.util.Arrays;
 import java.util.Collections;
 import java.util.List;
+import java.util.concurrent.ExecutionException;
+import java.util.concurrent.Future;
 
 import javax.tools.Diagnostic;
 import javax.tools.DiagnosticListener;
@@ -199,30 +201,192 @@ public class MainActivity extends AppCompatActivity {
         }
     }
 
+    /**
+     * Runs a script of the assets with the args,failures are logged under the tag.
+     * @return whether the script ran without error
+     */
+    private boolean runAsset(ScriptContext context, String tag, String script, Object... args) {
+        boolean ok=false;
+        try(InputStream stream=getAssets().open(script)) {
+            context.run(readAll(stream),args);
+            ok=true;
+        }catch (Exception e){
+            context.flushLog();
+            Log.e(tag,script+" failed",e);
+        }
+        context.flushLog();
+        return ok;
+    }
+
     public void deductTest() {
+        if(runAsset(new ScriptContext(),"deduct","deduct.lua"))
+            Log.d("deduct","Test passed");
+    }
+
+    public void gcBenchmark() {
+        ArrayList<Integer> list=new ArrayList<>(1000000);
+        for (int i = 0; i < 1000000; i++) {
+            list.add(i);
+        }
+        runAsset(new ScriptContext(),"gcbench","gcbench.lua",list);
+    }
+
+    public void gcPauseBenchmark() {
+        ArrayList<Integer> list=new ArrayList<>(2001);
+        for (int i = 0; i <= 2000; i++) {
+            list.add(i);
+        }
+        for (String workload:new String[]{"readmostly","mutating"}) {
+            for (String mode:new String[]{"forced","incremental","generational"}) {
+                ScriptContext context=new ScriptContext();
+                context.setGenerationalGC(mode.equals("generational"));
+                runAsset(context,"gcpause","gcpausebench.lua",list,mode,workload);
+            }
+        }
+    }
+
+    public void identityBenchmark() {
         ScriptContext context=new ScriptContext();
-        AssetManager manager=getAssets();
-        try(InputStream stream=manager.open("deduct.lua")) {
-            context.run(readAll(stream));
+        context.setIdentityCache(true);
+        ArrayList<Object> list=new ArrayList<>(100);
+        for (int i = 0; i < 100; i++) {
+            list.add(new Object());
+        }
+        runAsset(context,"identitybench","identitybench.lua",list);
+    }
+
+    public void arenaBenchmark() {
+        for (boolean arena:new boolean[]{false,true}) {
+            ScriptContext context=new ScriptContext();
+            context.setTemporaryArena(arena);
+            runAsset(context,"arenabench","arenabench.lua",arena?"arena":"heap");
+        }
+    }
+
+    public void arrayBenchmark() {
+        runAsset(new ScriptContext(),"arraybench","arraybench.lua");
+    }
+
+    public void vmBenchmark() {
+        runAsset(new ScriptContext(),"vmbench","vmbench.lua");
+    }
+
+    public void stateBenchmark() {
+        final ScriptContext context=new ScriptContext();
+        final ScriptContext.CompiledScript script=context.compile("return 1");
+        final long[] times=new long[2];
+        int threads=100;
+        try {
+            for (int i = 0; i < threads; i++) {
+                Thread thread=new Thread(){
+                    @Override
+                    public void run() {
+                        long t=System.nanoTime();
+                        context.run(script);
+                        long cold=System.nanoTime();
+                        context.run(script);
+                        times[0]+=cold-t;
+                        times[1]+=System.nanoTime()-cold;
+                    }
+                };
+                thread.start();
+                thread.join();
+            }
         }catch (Exception e){
-            context.flushLog();
-            Log.e("deduct","Test failed",e);
+            Log.e("state","Benchmark failed",e);
         }
+        Log.d("state","first run "+times[0]/threads/1000+"us,next run "+times[1]/threads/1000+"us");
         context.flushLog();
-        Log.d("deduct","Test passed");
     }
 
-    public void ffitest() {
-        // Context of the app under test.
+    public void bufferTest() {
         ScriptContext context=new ScriptContext();
+        byte[] source="local a,b=...\nreturn a+b".getBytes();
+        ByteBuffer direct=ByteBuffer.allocateDirect(source.length);
+        direct.put(source).flip();
+        try {
+            if(!Long.valueOf(3).equals(context.run(direct,1,2)[0]))
+                throw new AssertionError("direct buffer");
+            ByteBuffer heap=ByteBuffer.allocate(source.length+4);
+            heap.position(4);
+            heap.slice().put(source);
+            if(!Long.valueOf(7).equals(context.run(context.compile(heap),3,4)[0]))
+                throw new AssertionError("heap buffer");
+        }catch (Exception e){
+            context.flushLog();
+            Log.e("buffer","Test failed",e);
+        }
+        context.flushLog();
+        Log.d("buffer","Test passed");
+    }
+
+    public void codeCacheBenchmark() {
         AssetManager manager=getAssets();
-        try(InputStream stream=manager.open("luaffitest.lua")) {
-            context.run(readAll(stream));
+        try(InputStream stream=manager.open("luadroidtest.lua")) {
+            String source=readAll(stream);
+            int count=100;
+            ScriptContext context=new ScriptContext();
+            long t=System.nanoTime();
+            for (int i = 0; i < count; i++) {
+                context.compile(source);
+            }
+            Log.d("codecache","source "+(System.nanoTime()-t)/count/1000+"us");
+            ScriptContext cached=new ScriptContext();
+            cached.setCodeCache(new File(getCacheDir(),"luac"));
+            cached.compile(source);
+            t=System.nanoTime();
+            for (int i = 0; i < count; i++) {
+                cached.compile(source);
+            }
+            Log.d("codecache","cached "+(System.nanoTime()-t)/count/1000+"us");
+        }catch (Exception e){
+            Log.e("codecache","Benchmark failed",e);
+        }
+    }
+
+    public void executorBenchmark() {
+        ScriptContext context=new ScriptContext();
+        ScriptContext.CompiledScript script=context.compile(
+                "local n=...\nlocal s=0\nfor i=1,n do s=s+i%7 end\nreturn s");
+        int tasks=64;
+        long t=System.nanoTime();
+        for (int i = 0; i < tasks; i++) {
+            context.run(script,200000);
+        }
+        Log.d("executor","serial "+(System.nanoTime()-t)/1000000+"ms");
+        ScriptContext.ScriptExecutor executor=context.newExecutor(0);
+        try {
+            List<Future<Object[]>> futures=new ArrayList<>(tasks);
+            t=System.nanoTime();
+            for (int i = 0; i < tasks; i++) {
+                futures.add(executor.submit(script,200000));
+            }
+            Object[] results=new Object[tasks];
+            for (int i = 0; i < tasks; i++) {
+                results[i]=futures.get(i).get()[0];
+            }
+            Log.d("executor","pooled "+(System.nanoTime()-t)/1000000+"ms");
+            Object expected=context.run(script,200000)[0];
+            for (Object result:results) {
+                if(!expected.equals(result))
+                    throw new AssertionError("wrong result");
+            }
+            try {
+                executor.submit("error('failed')").get();
+                throw new AssertionError("error not reported");
+            }catch (ExecutionException ignored){
+            }
         }catch (Exception e){
             context.flushLog();
-            Log.e("ffi","Test failed",e);
+            Log.e("executor","Benchmark failed",e);
+        }finally {
+            executor.shutdown();
         }
         context.flushLog();
-        Log.d("ffi","Test passed");
+    }
+
+    public void ffitest() {
+        if(runAsset(new ScriptContext(),"ffi","luaffitest.lua"))
+            Log.d("ffi","Test passed");
     }
 }